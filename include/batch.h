@@ -0,0 +1,10 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+
+// Function declarations
+bool batch_requested(int argc, char ** argv);
+int batch_run(int argc, char ** argv);
+
+#endif
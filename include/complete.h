@@ -0,0 +1,19 @@
+#ifndef COMPLETE_H
+#define COMPLETE_H
+
+#include <stdbool.h>
+
+#include <stddef.h>
+
+// Outcome of a Tab press
+typedef enum {
+  COMPLETE_NONE,    // Nothing matches
+  COMPLETE_DONE,    // The input was extended and/or candidates were listed
+  COMPLETE_PENDING  // A directory is still being indexed; retry next frame
+} CompleteStatus;
+
+// Function declarations
+CompleteStatus complete_line(char * inputBuffer, int * cursorPos, char * candidates, size_t candidatesSize);
+void complete_cleanup(void);
+
+#endif
@@ -9,6 +9,12 @@
 #define FONT_PATH "assets/Typewriter.ttf"
 #define FONT_SIZE 18
 
+// Font zoom settings
+#define FONT_ZOOM_MIN 8
+#define FONT_ZOOM_MAX 48
+#define FONT_ZOOM_STEP 2
+#define FONT_ZOOM_CACHED_SIZES 4 // Sizes kept open with their glyphs, FONT_SIZE included
+
 // Title font settings
 #define TITLE_FONT_PATH "assets/FiraCode-Bold.ttf"
 #define TITLE_FONT_SIZE 42
@@ -32,9 +38,89 @@
 #define MAX_LINES 100
 #define INPUT_BUFFER_SIZE 2048
 #define CLIPBOARD_SIZE 4096
+#define COPY_STRIP_ANSI 1  // 1 = drop colour escape sequences from copied text
+
+// Command history settings
+#define HISTORY_FILE_PATH ".octo_history"
+
+// Control socket settings
+#define CONTROL_SOCKET_ENABLED 1
+#define CONTROL_SOCKET_NAME "octo-shell.sock" // Created in the temp directory
+#define CONTROL_MAX_CLIENTS 8
+#define CONTROL_MAX_FRAME (1u << 20)     // Larger frames close the connection
+#define CONTROL_QUEUE_BYTES (8u << 20)   // Clients are not read while this much waits for the UI
+#define CONTROL_POLL_MS 50               // Listener wake-up to check for shutdown
+
+// Session settings
+#define SESSION_FILE_PATH ".octo_session"
+#define SESSION_AUTOSAVE 0  // 1 = save the session on exit and restore it on startup
+#define SESSION_MAX_TABS 9  // Open tabs, each with its own command worker and scrollback
+#define SESSION_TAB_COLUMNS 20 // Widest tab label, in columns
+#define SHELL_TITLE_LENGTH 64
+
+// Pane settings
+#define PANE_MAX 6            // Panes the window can be split into, each showing its own tab
+#define PANE_GAP 6            // Pixels between panes; the outlines are drawn in it
+#define PANE_PADDING 10       // Left margin of the output inside a pane
+#define PANE_INPUT_INDENT 80  // Where the input line starts, after the prompt
+
+// File viewer settings
+#define VIEW_PAGE_LINES 40  // Lines shown per `view` page
+
+// Follow settings
+#define FOLLOW_INITIAL_LINES 10  // Lines shown before following a file
+#define FOLLOW_POLL_MS 100       // Longest wait between checks for new data
+
+// Pager settings
+#define PAGER_INDEX_BYTES_PER_FRAME (4u << 20)   // Line index growth per frame
+#define PAGER_SEARCH_BYTES_PER_FRAME (32u << 20) // Search progress per frame
+#define PAGER_MAX_ROWS 256                       // Most rows the pager draws
+
+// Scrollback settings
+#define SCROLLBACK_BLOCK_LINES 1024  // Archived lines per block
+#define SCROLLBACK_HOT_BLOCKS 2      // Newest full blocks kept uncompressed
+#define SCROLLBACK_CACHE_BLOCKS 4    // Decompressed blocks kept for paging
+#define SCROLLBACK_SEARCH_BYTES_PER_FRAME (2u << 20) // Pager search progress per frame, expanding blocks as it goes
+#define SCROLLBACK_MEMORY_LIMIT (64u << 20)  // Compressed bytes kept in memory before the oldest spill to disk
+#define SCROLLBACK_SEGMENT_BYTES (64u << 20) // Size of each spill file in the temp directory
+#define SCROLLBACK_MAPPED_SEGMENTS 4         // Spill files kept mapped for reading
+
+// Completion settings
+#define COMPLETE_TRIE_NODES 512    // Nodes in the command trie
+#define COMPLETE_DIR_CACHE 8       // Directories whose listings are kept
+#define COMPLETE_MAX_LIST 64       // Candidates listed by an ambiguous Tab
+
+// History search settings
+#define HISTSEARCH_QUERY_SIZE 64           // Longest Ctrl+R query
+#define HISTSEARCH_MAX_ROWS 50             // Ranked candidates kept for display
+#define HISTSEARCH_SCAN_PER_FRAME 100000   // Entries scored per frame
+#define HISTSEARCH_INDEX_PER_FRAME 20000   // History file lines indexed per frame
+#define HISTSEARCH_BONUS_CONSECUTIVE 8     // Query character right after the previous one
+#define HISTSEARCH_BONUS_BOUNDARY 6        // Query character at the start of a word
+#define HISTSEARCH_MAX_GAP_PENALTY 4       // Most a single gap between matches costs
+
+// Watch settings
+#define WATCH_MAX_LINES 40         // Rows shown in the watch panel
+#define WATCH_MIN_INTERVAL_MS 50   // Shortest re-run interval
+
+// Search settings
+#define GREP_MAX_MATCHES 5000  // grep stops after this many matching lines
+
+// Flood settings
+#define FLOOD_BYTES_PER_SEC 262144  // Output rate above which intermediate frames are skipped
+#define FLOOD_WINDOW_MS 250         // Span the output rate is measured over
+#define FRAME_INTERVAL_MS 16        // Time between rendered frames (~60 FPS)
+
+// Batch mode settings
+#define BATCH_STRIP_ANSI 1  // 1 = drop colour escape sequences from batch output
 
 // Word wrap settings
 #define MAX_LINE_WIDTH 20  // Characters per line for word wrap
+#define REFLOW_MIN_CHUNK_LINES 16  // Fewest source lines per parallel reflow task
+
+// Thread pool settings
+#define MAX_WORKER_THREADS 16
+#define WORKER_THREADS 0   // 0 = one per CPU core, leaving one for the UI thread
 
 // Text selection structure
 typedef struct {
@@ -0,0 +1,29 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <SDL.h>
+
+#include <stdbool.h>
+
+#include "config.h"
+
+// Frame types on the control socket
+typedef enum {
+  CONTROL_FRAME_TEXT = 1,   // Lines separated by '\n', appended to the output
+  CONTROL_FRAME_COMMAND = 2 // One command line, run as if it had been typed
+} ControlFrameType;
+
+// Every frame starts with this header, little-endian, followed by length payload bytes
+typedef struct {
+  Uint32 length;
+  Uint16 type;
+  Uint16 flags; // Reserved, 0
+}
+ControlFrameHeader;
+
+// Function declarations
+bool control_start(void);
+void control_poll(char output[][INPUT_BUFFER_SIZE], int * lineCount);
+void control_stop(void);
+
+#endif
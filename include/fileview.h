@@ -0,0 +1,25 @@
+#ifndef FILEVIEW_H
+#define FILEVIEW_H
+
+#include <stdbool.h>
+
+#include "config.h"
+
+#include "mapfile.h"
+
+// File kept mapped between `view` calls so paging only extends the index; each session has its own
+typedef struct {
+  MappedFile file;
+  char path[INPUT_BUFFER_SIZE];
+  size_t size;
+  size_t nextLine;
+  bool open;
+}
+FileView;
+
+// Function declarations
+void fileview_cat(const char * path, char output[][INPUT_BUFFER_SIZE], int * lineCount);
+void fileview_view(const char * args, char output[][INPUT_BUFFER_SIZE], int * lineCount);
+void fileview_cleanup(FileView * view);
+
+#endif
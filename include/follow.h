@@ -0,0 +1,9 @@
+#ifndef FOLLOW_H
+#define FOLLOW_H
+
+#include "config.h"
+
+// Function declarations
+void follow_run(const char * path, char output[][INPUT_BUFFER_SIZE], int * lineCount);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef FONT_H
+#define FONT_H
+
+#include <SDL.h>
+
+#include <SDL_ttf.h>
+
+#include <stdbool.h>
+
+#include "config.h"
+
+// Function declarations
+TTF_Font * font_open(const char * path);
+TTF_Font * font_current(void);
+int font_size(void);
+bool font_set_size(int size);
+bool font_zoom(int steps);
+void font_cleanup(void);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef GREP_H
+#define GREP_H
+
+#include "config.h"
+
+// Function declarations
+void grep_run(const char * args, char output[][INPUT_BUFFER_SIZE], int * lineCount);
+
+#endif
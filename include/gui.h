@@ -11,6 +11,7 @@
 
 // Function declarations
 void gui_init(SDL_Renderer * renderer, TTF_Font * font);
+void gui_set_font(TTF_Font * font, int size);
 void gui_set_title_font(TTF_Font * titleFont);
 void gui_render(const char * prompt,
   const char * inputBuffer, char output[][INPUT_BUFFER_SIZE], int lineCount, int cursorPos, TextSelection * selection);
@@ -18,13 +19,21 @@ void gui_handle_mouse_event(SDL_Event * e, char output[][INPUT_BUFFER_SIZE],
   const char * inputBuffer, int lineCount, TextSelection * selection);
 void gui_get_selected_text(char output[][INPUT_BUFFER_SIZE],
   const char * inputBuffer, int lineCount, TextSelection * selection, char * buffer, int bufferSize);
+size_t gui_get_selected_text_length(char output[][INPUT_BUFFER_SIZE],
+  const char * inputBuffer, int lineCount, TextSelection * selection);
+size_t gui_write_selected_text(char output[][INPUT_BUFFER_SIZE],
+  const char * inputBuffer, int lineCount, TextSelection * selection, char * dest, size_t destSize, bool stripAnsi);
+void gui_reset_targets(void);
 void gui_cleanup(void);
 
 // Background image functions
 int gui_set_background_image(const char * imagePath);
+SDL_Surface * gui_load_background_surface(const char * imagePath);
+int gui_set_background_surface(SDL_Surface * surface);
 void gui_cleanup_background(void);
 void gui_render_background(void);
 void gui_set_background_opacity(float opacity);
+float gui_get_background_opacity(void);
 void gui_set_background_scale_mode(int mode);
 void gui_set_background_enabled(int enabled);
 void gui_update_background_config(const BackgroundConfig * config);
@@ -33,6 +42,7 @@ void gui_update_background_config(const BackgroundConfig * config);
 void render_text_colored(const char * text, int x, int y, SDL_Color fg, SDL_Color bg);
 void render_centered_title(const char * title, int y);
 void render_selection_highlight(int x, int y, int width, int height);
+void gui_selection_bounds(const TextSelection * selection, int * startLine, int * startChar, int * endLine, int * endChar);
 void render_cursor(int x, int y);
 int gui_get_char_width(void);
 
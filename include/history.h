@@ -0,0 +1,17 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+
+// Function declarations
+bool history_init(const char * path);
+void history_add(const char * command);
+int history_older(int position);
+int history_newer(int position);
+const char * history_entry(int position, int * length);
+bool history_index_step(int maxLines);
+int history_size(void);
+bool history_hidden(int position);
+void history_cleanup(void);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef HISTSEARCH_H
+#define HISTSEARCH_H
+
+#include <stdbool.h>
+
+#include <SDL.h>
+
+#include "config.h"
+
+// One ranked candidate; matches are the byte offsets of the query characters
+typedef struct {
+  const char * text;
+  int length;
+  bool selected;
+  int matches[HISTSEARCH_QUERY_SIZE];
+  int matchCount;
+}
+HistSearchRow;
+
+// Function declarations
+void histsearch_open(void);
+bool histsearch_active(void);
+void histsearch_close(void);
+void histsearch_handle_event(const SDL_Event * e, char * inputBuffer, int * cursorPos);
+void histsearch_update(void);
+int histsearch_rows(HistSearchRow * rows, int maxRows);
+const char * histsearch_status(void);
+
+#endif
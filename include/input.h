@@ -1,6 +1,8 @@
 #ifndef INPUT_H
 #define INPUT_H
 
+#include <stdbool.h>
+
 #include <SDL.h>
 
 #include "config.h"
@@ -11,6 +13,10 @@ void input_copy_to_clipboard(char output[][INPUT_BUFFER_SIZE],
   const char * inputBuffer, int lineCount, TextSelection * selection);
 void input_paste_from_clipboard(char * inputBuffer, int * cursorPos);
 void input_select_all(char output[][INPUT_BUFFER_SIZE], int lineCount, TextSelection * selection);
+void input_update(char * inputBuffer, int * cursorPos, char output[][INPUT_BUFFER_SIZE], int * lineCount);
+void input_insert_text(char * inputBuffer, int * cursorPos, const char * text);
+bool input_key_is_text(const SDL_Event * e);
+void input_reset(void);
 
 // undo/redo functions
 void save_input_state(const char * inputBuffer, int cursorPos);
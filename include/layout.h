@@ -0,0 +1,36 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <SDL.h>
+
+#include "config.h"
+
+// One display row: a wrapped segment of a source line
+typedef struct {
+  int line;   // Source line index
+  int start;  // Byte offset of the segment within the line
+  int length; // Segment length in bytes
+} LayoutRow;
+
+// Display rows for source lines [firstLine, lineCount)
+typedef struct {
+  int width;         // Wrap width in characters, 0 = no wrapping
+  Uint32 generation; // Output generation the rows were computed for
+  int firstLine;
+  int lineCount;
+  int rowCount;
+  int rowCapacity;
+  int * lineFirstRow; // Indexed by line - firstLine
+  int lineCapacity;
+  LayoutRow * rows;
+} Layout;
+
+// Function declarations
+void layout_request_reflow(char output[][INPUT_BUFFER_SIZE], int lineCount, int width);
+const Layout * layout_update(char output[][INPUT_BUFFER_SIZE], int lineCount, int width, int visibleRows);
+const Layout * layout_update_visible(char output[][INPUT_BUFFER_SIZE], int lineCount, int width, int visibleRows);
+void layout_invalidate(void);
+Uint32 layout_generation(void);
+void layout_cleanup(void);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stddef.h>
+
+#include <stdbool.h>
+
+// Function declarations
+size_t lz_bound(size_t length);
+size_t lz_compress(const char * source, size_t length, unsigned char * dest, size_t capacity);
+bool lz_decompress(const unsigned char * source, size_t length, char * dest, size_t rawLength);
+
+#endif
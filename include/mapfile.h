@@ -0,0 +1,33 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <stddef.h>
+
+#include <stdbool.h>
+
+#include <windows.h>
+
+// Read-only file mapping with a line-offset index built on demand
+typedef struct {
+  HANDLE file;
+  HANDLE mapping;
+  const char * data;
+  size_t size;
+  size_t * lineStarts;  // Byte offset of each indexed line
+  size_t lineCount;     // Lines indexed so far
+  size_t lineCapacity;
+  size_t indexedBytes;  // Bytes before this offset have been scanned
+  bool ownsData;        // data is a heap buffer rather than a file view
+}
+MappedFile;
+
+// Function declarations
+bool mapfile_open(MappedFile * file, const char * path);
+bool mapfile_open_memory(MappedFile * file, char * data, size_t size);
+void mapfile_close(MappedFile * file);
+bool mapfile_index_step(MappedFile * file, size_t maxBytes);
+bool mapfile_index_complete(const MappedFile * file);
+bool mapfile_line(const MappedFile * file, size_t line, const char ** text, size_t * length);
+size_t mapfile_tail_start(const MappedFile * file, size_t lines);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <SDL.h>
+
+#include <SDL_ttf.h>
+
+// Function declarations
+void metrics_set_font(TTF_Font * font);
+void metrics_forget_font(TTF_Font * font);
+int metrics_char_width(void);
+int metrics_line_length(const char * text, Uint32 version);
+int metrics_offset_to_x(const char * text, Uint32 version, int offset);
+int metrics_x_to_offset(const char * text, Uint32 version, int x);
+Uint32 metrics_text_version(const char * text);
+int metrics_escape_length(const char * text, int remaining);
+void metrics_cleanup(void);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef PAGER_H
+#define PAGER_H
+
+#include <stddef.h>
+
+#include <stdbool.h>
+
+#include <SDL.h>
+
+#include "config.h"
+
+// One visible pager row; text points into the paged source
+typedef struct {
+  const char * text;
+  int length;
+}
+PagerRow;
+
+// Function declarations
+bool pager_open_file(const char * path);
+bool pager_open_text(const char * text, size_t length, const char * title);
+bool pager_open_scrollback(char output[][INPUT_BUFFER_SIZE], int lineCount);
+bool pager_active(void);
+void pager_close(void);
+void pager_handle_event(const SDL_Event * e);
+void pager_update(int visibleRows);
+int pager_rows(PagerRow * rows, int maxRows);
+const char * pager_query(void);
+const char * pager_status(void);
+
+#endif
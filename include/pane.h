@@ -0,0 +1,39 @@
+#ifndef PANE_H
+#define PANE_H
+
+#include <SDL.h>
+
+#include <stdbool.h>
+
+#include "config.h"
+
+// Splits needed for PANE_MAX panes, plus the panes themselves
+#define PANE_NODES (PANE_MAX * 2 - 1)
+
+// Where a new pane opens, relative to the focused one
+typedef enum {
+  PANE_SPLIT_RIGHT,
+  PANE_SPLIT_DOWN
+} PaneSplit;
+
+// One pane as laid out for a frame
+typedef struct {
+  int id;            // Below PANE_NODES and kept while the pane is open
+  SDL_Rect viewport; // Window coordinates
+  int session;       // Tab shown, as an index for the session_* functions
+  bool focused;      // Shows the active tab and takes the input
+}
+PaneView;
+
+// Function declarations
+void pane_init(void);
+bool pane_split(PaneSplit split);
+bool pane_close(void);
+bool pane_new_tab(void);
+bool pane_show_session(int index);
+bool pane_focus_at(int x, int y);
+bool pane_focus_toward(int dx, int dy);
+int pane_views(SDL_Rect area, PaneView * views);
+int pane_count(void);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <SDL.h>
+
+#include <stdbool.h>
+
+// Function declarations
+bool recorder_start(const char * path);
+void recorder_event(const SDL_Event * e);
+void recorder_output_line(const char * line);
+void recorder_stop(void);
+
+bool replay_open(const char * path, bool fast);
+bool replay_active(void);
+bool replay_is_fast(void);
+bool replay_next_event(SDL_Event * e);
+void replay_frame_time(Uint64 ticks);
+bool replay_finished(char * summary, int summarySize);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef SCROLLBACK_H
+#define SCROLLBACK_H
+
+#include <stddef.h>
+
+#include <stdbool.h>
+
+#include <stdio.h>
+
+#include <SDL.h>
+
+#include "mapfile.h"
+
+// Sizes of the archived output, for the scrollback stats builtin
+typedef struct {
+  size_t lines;
+  int blocks;
+  int compressedBlocks;
+  int spilledBlocks;
+  size_t rawBytes;    // Size of all archived text
+  size_t storedBytes; // Memory it currently takes, raw and compressed
+  size_t diskBytes;   // Compressed bytes spilled to segment files
+}
+ScrollbackStats;
+
+// One compressed block as stored in a session file
+typedef struct {
+  Uint64 offset;       // From the start of the file
+  Uint32 packedLength;
+  Uint32 length;       // Size of the text, every line ending in '\n'
+  Uint32 lineCount;
+  Uint32 reserved;
+}
+ScrollbackBlockInfo;
+
+// The archive of one session; every function takes the archive it works on
+typedef struct Scrollback Scrollback;
+
+// Function declarations
+Scrollback * scrollback_create(void);
+void scrollback_destroy(Scrollback * archive);
+void scrollback_append(Scrollback * archive, const char * text, size_t length);
+void scrollback_update(Scrollback * archive);
+void scrollback_trim(Scrollback * archive);
+size_t scrollback_line_count(Scrollback * archive);
+bool scrollback_line(Scrollback * archive, size_t line, const char ** text, int * length);
+int scrollback_block_count(Scrollback * archive);
+char * scrollback_read_block(Scrollback * archive, int block, size_t * length);
+bool scrollback_write(Scrollback * archive, FILE * stream, size_t limit, size_t * lines);
+void scrollback_stats(Scrollback * archive, ScrollbackStats * stats);
+unsigned char * scrollback_pack_block(Scrollback * archive, int index, ScrollbackBlockInfo * info);
+bool scrollback_restore(Scrollback * archive, MappedFile * file, const ScrollbackBlockInfo * blocks, int count);
+bool scrollback_detach(Scrollback * archive);
+
+#endif
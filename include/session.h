@@ -0,0 +1,31 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <SDL.h>
+
+#include <stdbool.h>
+
+#include "config.h"
+
+// Function declarations
+void session_attach(char * inputBuffer, int * cursorPos, TextSelection * selection,
+  char output[][INPUT_BUFFER_SIZE], int * lineCount);
+bool session_open(void);
+bool session_close(void);
+bool session_activate(int index);
+int session_count(void);
+int session_active_index(void);
+const char * session_title(int index);
+bool session_unseen(int index);
+int session_id(int index);
+int session_find(int id);
+int session_line_count(int index);
+const char * session_line(int index, int line);
+Uint32 session_version(int index);
+void session_mark_seen(int index);
+void session_poll(void);
+void session_cleanup(void);
+bool session_save(const char * path, char output[][INPUT_BUFFER_SIZE], int lineCount);
+bool session_load(const char * path, char output[][INPUT_BUFFER_SIZE], int * lineCount);
+
+#endif
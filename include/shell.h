@@ -1,13 +1,65 @@
 #ifndef SHELL_H
 #define SHELL_H
 
+#include <stddef.h>
+
 #include <stdbool.h>
 
 #include "config.h"
 
+#include "scrollback.h"
+
+#include "fileview.h"
+
+#include "watch.h"
+
+// A session's command worker and its pending output
+typedef struct ShellContext ShellContext;
+
+// Receives output lines one at a time, e.g. to write them to stdout
+typedef void( * ShellLineSink)(const char * line);
+
+// Updates a watch command sends to its panel
+typedef enum {
+  SHELL_WATCH_OPEN, // text is the panel title
+  SHELL_WATCH_SIZE, // index is the new row count
+  SHELL_WATCH_LINE  // index is the row, text its new contents
+} ShellWatchUpdate;
+
 // Function declarations
 void shell_execute(const char * input, char output[][INPUT_BUFFER_SIZE], int * lineCount);
+void shell_print(char output[][INPUT_BUFFER_SIZE], int * lineCount, const char * format, ...);
+void shell_append_line(char output[][INPUT_BUFFER_SIZE], int * lineCount, const char * text);
+void shell_print_lines(char output[][INPUT_BUFFER_SIZE], int * lineCount, const char * text, size_t length);
+void shell_set_line_sink(ShellLineSink sink);
+
+// Command worker functions
+ShellContext * shell_create(Scrollback * archive);
+void shell_destroy(ShellContext * context);
+void shell_use(ShellContext * context);
+Scrollback * shell_scrollback(void);
+size_t shell_archived_lines(void);
+FileView * shell_file_view(void);
+WatchPanel * shell_watch_panel(void);
+const char * shell_title(const ShellContext * context);
+void shell_park(ShellContext * context, char output[][INPUT_BUFFER_SIZE], int lineCount);
+void shell_unpark(ShellContext * context, char output[][INPUT_BUFFER_SIZE], int * lineCount);
+bool shell_poll_parked(ShellContext * context);
+int shell_parked_count(const ShellContext * context);
+const char * shell_parked_line(const ShellContext * context, int line);
+Uint32 shell_parked_version(const ShellContext * context);
+void shell_cleanup(void);
+void shell_submit(const char * input, char output[][INPUT_BUFFER_SIZE], int * lineCount);
+void shell_poll_output(char output[][INPUT_BUFFER_SIZE], int * lineCount);
+void shell_append_block(char output[][INPUT_BUFFER_SIZE], int * lineCount, const char * text, size_t length);
+bool shell_busy(void);
+bool shell_flooding(void);
+bool shell_cancel(void);
+bool shell_cancelled(void);
+char * shell_run_captured(const char * command, char output[][INPUT_BUFFER_SIZE], int * lineCount, size_t * length);
+bool shell_watch_post(ShellWatchUpdate update, int index, const char * text, size_t length);
 bool shell_should_exit(void);
+bool shell_exit_requested(void);
 void shell_reset_exit_flag(void);
 
 #endif
\ No newline at end of file
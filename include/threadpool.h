@@ -0,0 +1,15 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stdbool.h>
+
+// Task callback executed on a worker thread
+typedef void( * ThreadPoolTask)(void * arg);
+
+// Function declarations
+bool threadpool_init(int workerCount);
+bool threadpool_submit(ThreadPoolTask task, void * arg);
+int threadpool_worker_count(void);
+void threadpool_shutdown(void);
+
+#endif
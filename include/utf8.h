@@ -0,0 +1,18 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stdbool.h>
+
+#include <SDL.h>
+
+// Function declarations
+int utf8_decode(const char * text, int remaining, Uint32 * codepoint);
+int utf8_width(Uint32 codepoint);
+bool utf8_is_ascii(const char * text, int length);
+int utf8_next(const char * text, int length, int offset);
+int utf8_prev(const char * text, int offset);
+int utf8_boundary(const char * text, int offset);
+int utf8_clip(const char * text, int length, int maxColumns);
+int utf8_columns(const char * text, int length);
+
+#endif
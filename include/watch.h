@@ -0,0 +1,28 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdbool.h>
+
+#include <SDL.h>
+
+#include "config.h"
+
+// Rows of a running watch; each session has its own
+typedef struct WatchPanel WatchPanel;
+
+// Function declarations
+void watch_run(const char * args, char output[][INPUT_BUFFER_SIZE], int * lineCount);
+
+// Watch panel functions (UI thread)
+WatchPanel * watch_panel_create(void);
+void watch_panel_destroy(WatchPanel * panel);
+void watch_panel_open(WatchPanel * panel, int taskId, const char * title);
+void watch_panel_resize(WatchPanel * panel, int lineCount);
+void watch_panel_set_line(WatchPanel * panel, int index, const char * text);
+void watch_panel_task_done(WatchPanel * panel, int taskId);
+void watch_panel_close(WatchPanel * panel);
+bool watch_panel_active(const WatchPanel * panel);
+int watch_panel_line_count(const WatchPanel * panel);
+const char * watch_panel_line(const WatchPanel * panel, int index, Uint32 * version);
+
+#endif
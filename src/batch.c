@@ -0,0 +1,153 @@
+#include <string.h>
+
+#include <stdio.h>
+
+#include <stdlib.h>
+
+#include <stdbool.h>
+
+#include "config.h"
+
+#include "batch.h"
+
+#include "metrics.h"
+
+#include "shell.h"
+
+#include "threadpool.h"
+
+// Output buffer for commands; their lines go straight to stdout through the line sink
+static char batchOutput[MAX_LINES][INPUT_BUFFER_SIZE];
+static char stdoutBuffer[1 << 16];
+
+// True when the command line asks for batch mode (-c, --batch, a script path or "-")
+bool batch_requested(int argc, char ** argv) {
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--batch") == 0 || strcmp(argv[i], "-") == 0)
+      return true;
+    if (argv[i][0] != '-')
+      return true;
+    // Skip the value of options that take one
+    if (strcmp(argv[i], "--record") == 0 || strcmp(argv[i], "--replay") == 0 ||
+      strcmp(argv[i], "--replay-fast") == 0)
+      i++;
+  }
+  return false;
+}
+
+static void batch_write_line(const char * line) {
+  const char * p = line;
+  int remaining = (int) strlen(line);
+
+  while (remaining > 0) {
+    const char * escape = BATCH_STRIP_ANSI ? (const char * ) memchr(p, '\033', remaining) : NULL;
+    int run = escape ? (int)(escape - p) : remaining;
+    fwrite(p, 1, run, stdout);
+    p += run;
+    remaining -= run;
+
+    if (escape) {
+      int skip = metrics_escape_length(p, remaining);
+      if (skip == 0) {
+        fputc( * p, stdout);
+        skip = 1;
+      }
+      p += skip;
+      remaining -= skip;
+    }
+  }
+  fputc('\n', stdout);
+}
+
+// Runs one command and writes the lines it produced; false once exit/quit was run.
+// Blank lines and lines starting with '#' (script comments) are skipped, whatever the source.
+static bool batch_execute(const char * command) {
+  const char * start = command;
+  while ( * start == ' ' || * start == '\t' || * start == '\r') start++;
+  if ( * start == '\0' || * start == '#') return true;
+
+  int lineCount = 0;
+  shell_execute(command, batchOutput, & lineCount);
+  return !shell_exit_requested();
+}
+
+static bool batch_execute_lines(const char * text) {
+  char command[INPUT_BUFFER_SIZE];
+
+  while ( * text) {
+    const char * end = strchr(text, '\n');
+    size_t length = end ? (size_t)(end - text) : strlen(text);
+    size_t copy = length < INPUT_BUFFER_SIZE ? length : INPUT_BUFFER_SIZE - 1;
+
+    memcpy(command, text, copy);
+    command[copy] = '\0';
+    if (copy > 0 && command[copy - 1] == '\r') command[copy - 1] = '\0';
+    if (!batch_execute(command)) return false;
+
+    text += length;
+    if ( * text == '\n') text++;
+  }
+  return true;
+}
+
+static bool batch_execute_stream(FILE * stream) {
+  char command[INPUT_BUFFER_SIZE];
+
+  while (fgets(command, sizeof(command), stream)) {
+    size_t length = strlen(command);
+
+    // Drop the rest of an over-long line
+    if (length == sizeof(command) - 1 && command[length - 1] != '\n') {
+      int c;
+      while ((c = fgetc(stream)) != EOF && c != '\n') {}
+    }
+
+    while (length > 0 && (command[length - 1] == '\n' || command[length - 1] == '\r')) {
+      command[--length] = '\0';
+    }
+
+    if (!batch_execute(command)) return false;
+  }
+  return true;
+}
+
+int batch_run(int argc, char ** argv) {
+  setvbuf(stdout, stdoutBuffer, _IOFBF, sizeof(stdoutBuffer));
+  shell_set_line_sink(batch_write_line);
+
+  // Searches split their work across the pool
+  threadpool_init(WORKER_THREADS);
+
+  int status = 0;
+  bool keepGoing = true;
+
+  for (int i = 1; i < argc && keepGoing; i++) {
+    if (strcmp(argv[i], "-c") == 0) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Usage: -c \"command\"\n");
+        status = 2;
+        break;
+      }
+      keepGoing = batch_execute_lines(argv[++i]);
+    } else if (strcmp(argv[i], "-") == 0 || strcmp(argv[i], "--batch") == 0) {
+      keepGoing = batch_execute_stream(stdin);
+    } else if (strcmp(argv[i], "--record") == 0 || strcmp(argv[i], "--replay") == 0 ||
+      strcmp(argv[i], "--replay-fast") == 0) {
+      i++;
+    } else if (argv[i][0] != '-') {
+      FILE * script = fopen(argv[i], "r");
+      if (!script) {
+        fprintf(stderr, "Could not open script: %s\n", argv[i]);
+        status = 2;
+        break;
+      }
+      keepGoing = batch_execute_stream(script);
+      fclose(script);
+    }
+  }
+
+  threadpool_shutdown();
+  shell_set_line_sink(NULL);
+  fflush(stdout);
+  return status;
+}
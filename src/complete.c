@@ -0,0 +1,476 @@
+#include <string.h>
+
+#include <stdlib.h>
+
+#include <stdio.h>
+
+#include <stdbool.h>
+
+#include <windows.h>
+
+#include <SDL.h>
+
+#include "config.h"
+
+#include "complete.h"
+
+#include "threadpool.h"
+
+// What follows a phrase once it has been typed in full
+typedef enum {
+  ARG_NONE,
+  ARG_PATH,      // The rest of the line is one path
+  ARG_LAST_PATH  // The last word is a path (earlier words are e.g. a pattern)
+}
+CompleteArgument;
+
+typedef struct {
+  const char * phrase;
+  CompleteArgument argument;
+}
+CompleteCommand;
+
+// Command table: every builtin with the fixed arguments it accepts
+static const CompleteCommand completeCommands[] = {
+  { "clear", ARG_NONE },
+  { "echo ", ARG_NONE },
+  { "wordwrap on", ARG_NONE },
+  { "wordwrap off", ARG_NONE },
+  { "wordwrap true", ARG_NONE },
+  { "wordwrap false", ARG_NONE },
+  { "bg set ", ARG_PATH },
+  { "bg opacity ", ARG_NONE },
+  { "bg clear", ARG_NONE },
+  { "background set ", ARG_PATH },
+  { "background opacity ", ARG_NONE },
+  { "background clear", ARG_NONE },
+  { "cat ", ARG_PATH },
+  { "view ", ARG_PATH },
+  { "less ", ARG_PATH },
+  { "pager ", ARG_PATH },
+  { "follow ", ARG_PATH },
+  { "tail -f ", ARG_PATH },
+  { "grep ", ARG_LAST_PATH },
+  { "watch ", ARG_NONE },
+  { "scrollback", ARG_NONE },
+  { "scrollback stats", ARG_NONE },
+  { "scrollback save ", ARG_PATH },
+  { "session save ", ARG_PATH },
+  { "session load ", ARG_PATH },
+  { "version", ARG_NONE },
+  { "help", ARG_NONE },
+  { "shortcuts", ARG_NONE },
+  { "exit", ARG_NONE },
+  { "quit", ARG_NONE }
+};
+
+// Prefix trie over the command table, stored as first-child / next-sibling links
+typedef struct {
+  char c;
+  Sint16 child;
+  Sint16 sibling;
+  bool terminal;
+  Uint8 argument;
+}
+TrieNode;
+
+static TrieNode gTrie[COMPLETE_TRIE_NODES];
+static int gTrieSize = 0;
+
+// Sorted listing of one directory; directory names end with a separator
+typedef struct {
+  char * names;
+  char ** entries;
+  int count;
+}
+DirListing;
+
+// Cached directory, rebuilt on a pool thread when its change notification fires
+typedef struct {
+  bool used;
+  char path[MAX_PATH];
+  DirListing * listing;  // Served to completions (UI thread only)
+  void * ready;          // Finished build waiting to be adopted
+  SDL_atomic_t building;
+  HANDLE change;
+  Uint32 lastUsed;
+}
+DirIndex;
+
+static DirIndex gIndexes[COMPLETE_DIR_CACHE];
+
+static int trie_child(int node, char c) {
+  for (int child = gTrie[node].child; child >= 0; child = gTrie[child].sibling) {
+    if (gTrie[child].c == c) return child;
+  }
+  return -1;
+}
+
+static void trie_insert(const char * phrase, CompleteArgument argument) {
+  int node = 0;
+  for (const char * p = phrase; * p; p++) {
+    int next = trie_child(node, * p);
+    if (next < 0) {
+      if (gTrieSize >= COMPLETE_TRIE_NODES) return;
+      next = gTrieSize++;
+      gTrie[next] = (TrieNode) {
+        * p, -1, -1, false, ARG_NONE
+      };
+
+      // Appended so candidates are listed in command table order
+      Sint16 * link = & gTrie[node].child;
+      while ( * link >= 0) link = & gTrie[ * link].sibling;
+      * link = (Sint16) next;
+    }
+    node = next;
+  }
+  gTrie[node].terminal = true;
+  gTrie[node].argument = (Uint8) argument;
+}
+
+static void trie_build(void) {
+  if (gTrieSize > 0) return;
+
+  gTrie[0] = (TrieNode) {
+    '\0', -1, -1, false, ARG_NONE
+  };
+  gTrieSize = 1;
+  for (size_t i = 0; i < sizeof(completeCommands) / sizeof(completeCommands[0]); i++) {
+    trie_insert(completeCommands[i].phrase, completeCommands[i].argument);
+  }
+}
+
+// Replaces inputBuffer[start, cursor) with text
+static bool complete_replace(char * inputBuffer, int * cursorPos, int start, const char * text, int length) {
+  int total = (int) strlen(inputBuffer);
+  if (total - ( * cursorPos - start) + length >= INPUT_BUFFER_SIZE) return false;
+
+  memmove(inputBuffer + start + length, inputBuffer + * cursorPos, (size_t)(total - * cursorPos + 1));
+  memcpy(inputBuffer + start, text, (size_t) length);
+  * cursorPos = start + length;
+  return true;
+}
+
+// Appends one candidate to the listing; false once the listing is full
+static bool complete_add_candidate(char * list, size_t size, const char * text, int length) {
+  size_t used = strlen(list);
+  size_t needed = (used > 0 ? 2 : 0) + (size_t) length;
+  if (used + needed + 1 > size) return false;
+
+  if (used > 0) {
+    memcpy(list + used, "  ", 2);
+    used += 2;
+  }
+  memcpy(list + used, text, (size_t) length);
+  list[used + length] = '\0';
+  return true;
+}
+
+// Lists the words that can follow node; word holds the part of the word typed so far
+static void trie_list(int node, char * word, int length, char * list, size_t size) {
+  bool listed = gTrie[node].terminal;
+  if (listed) complete_add_candidate(list, size, word, length);
+
+  for (int child = gTrie[node].child; child >= 0; child = gTrie[child].sibling) {
+    if (gTrie[child].c == ' ') {
+      if (!listed) complete_add_candidate(list, size, word, length);
+      listed = true;
+    } else if (length < INPUT_BUFFER_SIZE - 1) {
+      word[length] = gTrie[child].c;
+      trie_list(child, word, length + 1, list, size);
+    }
+  }
+}
+
+static void dirlisting_free(DirListing * listing) {
+  if (!listing) return;
+  free(listing -> names);
+  free(listing -> entries);
+  free(listing);
+}
+
+static int dirlisting_compare(const void * a, const void * b) {
+  return SDL_strcasecmp( * (const char * const * ) a, * (const char * const * ) b);
+}
+
+// Reads and sorts a directory; an unreadable directory gives an empty listing
+static DirListing * dirlisting_read(const char * path) {
+  DirListing * listing = (DirListing * ) calloc(1, sizeof(DirListing));
+  if (!listing) return NULL;
+
+  char pattern[MAX_PATH + 2];
+  snprintf(pattern, sizeof(pattern), "%s*", path);
+
+  WIN32_FIND_DATAA data;
+  HANDLE find = FindFirstFileA(pattern, & data);
+  if (find == INVALID_HANDLE_VALUE) return listing;
+
+  size_t used = 0;
+  size_t capacity = 0;
+  int count = 0;
+  do {
+    if (strcmp(data.cFileName, ".") == 0 || strcmp(data.cFileName, "..") == 0) continue;
+
+    size_t length = strlen(data.cFileName);
+    bool directory = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    if (used + length + 2 > capacity) {
+      size_t grown = capacity ? capacity * 2 : 64 * 1024;
+      while (grown < used + length + 2) grown *= 2;
+      char * names = (char * ) realloc(listing -> names, grown);
+      if (!names) break;
+      listing -> names = names;
+      capacity = grown;
+    }
+
+    memcpy(listing -> names + used, data.cFileName, length);
+    used += length;
+    if (directory) listing -> names[used++] = '\\';
+    listing -> names[used++] = '\0';
+    count++;
+  } while (FindNextFileA(find, & data));
+  FindClose(find);
+
+  // Offsets become pointers only once the name pool has stopped moving
+  listing -> entries = (char ** ) malloc((size_t)(count > 0 ? count : 1) * sizeof(char * ));
+  if (!listing -> entries) {
+    free(listing -> names);
+    listing -> names = NULL;
+    return listing;
+  }
+  char * name = listing -> names;
+  for (int i = 0; i < count; i++) {
+    listing -> entries[i] = name;
+    name += strlen(name) + 1;
+  }
+  listing -> count = count;
+  qsort(listing -> entries, (size_t) count, sizeof(char * ), dirlisting_compare);
+  return listing;
+}
+
+static void complete_build_index(void * arg) {
+  DirIndex * index = (DirIndex * ) arg;
+  SDL_AtomicSetPtr( & index -> ready, dirlisting_read(index -> path));
+  SDL_AtomicSet( & index -> building, 0);
+}
+
+static void complete_adopt(DirIndex * index) {
+  DirListing * fresh = (DirListing * ) SDL_AtomicSetPtr( & index -> ready, NULL);
+  if (fresh) {
+    dirlisting_free(index -> listing);
+    index -> listing = fresh;
+  }
+}
+
+static void complete_release(DirIndex * index) {
+  complete_adopt(index);
+  dirlisting_free(index -> listing);
+  index -> listing = NULL;
+  if (index -> change != INVALID_HANDLE_VALUE) FindCloseChangeNotification(index -> change);
+  index -> change = INVALID_HANDLE_VALUE;
+  index -> used = false;
+}
+
+// Listing for a directory, or NULL while it is being indexed
+static DirListing * complete_directory(const char * path) {
+  DirIndex * index = NULL;
+  DirIndex * oldest = NULL;
+  for (int i = 0; i < COMPLETE_DIR_CACHE; i++) {
+    DirIndex * candidate = & gIndexes[i];
+    if (candidate -> used && SDL_strcasecmp(candidate -> path, path) == 0) {
+      index = candidate;
+      break;
+    }
+    if (SDL_AtomicGet( & candidate -> building)) continue;
+    if (!oldest || !candidate -> used || (oldest -> used && candidate -> lastUsed < oldest -> lastUsed)) oldest = candidate;
+  }
+
+  if (!index) {
+    if (!oldest) return NULL; // Every slot is mid-build
+    if (oldest -> used) complete_release(oldest);
+    index = oldest;
+    index -> used = true;
+    index -> change = INVALID_HANDLE_VALUE;
+    strncpy(index -> path, path, sizeof(index -> path) - 1);
+    index -> path[sizeof(index -> path) - 1] = '\0';
+  }
+  index -> lastUsed = SDL_GetTicks();
+
+  // A build that finished publishes its listing before clearing the flag
+  if (SDL_AtomicGet( & index -> building)) return NULL;
+  complete_adopt(index);
+
+  // Without a change notification nothing would ever invalidate the listing, so an unwatched
+  // directory is reread on every request and the watch is retried with it
+  bool stale = index -> listing == NULL || index -> change == INVALID_HANDLE_VALUE;
+  if (index -> change != INVALID_HANDLE_VALUE && WaitForSingleObject(index -> change, 0) == WAIT_OBJECT_0) {
+    FindNextChangeNotification(index -> change);
+    stale = true;
+  }
+  if (!stale) return index -> listing;
+
+  // Watch before reading so a change made during the read still invalidates it
+  if (index -> change == INVALID_HANDLE_VALUE) {
+    index -> change = FindFirstChangeNotificationA(index -> path[0] ? index -> path : ".", FALSE,
+      FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME);
+  }
+
+  // Large directories are listed and sorted off the UI thread
+  SDL_AtomicSet( & index -> building, 1);
+  if (!threadpool_submit(complete_build_index, index)) complete_build_index(index);
+
+  if (SDL_AtomicGet( & index -> building)) return NULL;
+  complete_adopt(index);
+  return index -> listing;
+}
+
+// First entry not ordered before prefix
+static int dirlisting_lower_bound(const DirListing * listing, const char * prefix) {
+  int low = 0;
+  int high = listing -> count;
+  while (low < high) {
+    int middle = (low + high) / 2;
+    if (SDL_strcasecmp(listing -> entries[middle], prefix) < 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+// First entry after every entry that starts with prefix
+static int dirlisting_upper_bound(const DirListing * listing, const char * prefix, int low) {
+  size_t length = strlen(prefix);
+  int high = listing -> count;
+  while (low < high) {
+    int middle = (low + high) / 2;
+    if (SDL_strncasecmp(listing -> entries[middle], prefix, length) <= 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+static CompleteStatus complete_path(char * inputBuffer, int * cursorPos, int start, char * list, size_t size) {
+  const char * argument = inputBuffer + start;
+  int length = * cursorPos - start;
+
+  int separator = -1;
+  for (int i = 0; i < length; i++) {
+    if (argument[i] == '\\' || argument[i] == '/') separator = i;
+  }
+  if (separator + 1 >= MAX_PATH) return COMPLETE_NONE;
+
+  char directory[MAX_PATH];
+  memcpy(directory, argument, (size_t)(separator + 1));
+  directory[separator + 1] = '\0';
+
+  char prefix[INPUT_BUFFER_SIZE];
+  int prefixStart = start + separator + 1;
+  int prefixLength = * cursorPos - prefixStart;
+  memcpy(prefix, inputBuffer + prefixStart, (size_t) prefixLength);
+  prefix[prefixLength] = '\0';
+
+  DirListing * listing = complete_directory(directory);
+  if (!listing) return COMPLETE_PENDING;
+
+  // Matches form one contiguous run of the sorted listing
+  int first = dirlisting_lower_bound(listing, prefix);
+  int last = dirlisting_upper_bound(listing, prefix, first);
+  if (last == first) return COMPLETE_NONE;
+
+  // In sorted order the first and last match bound the common prefix of all of them
+  const char * low = listing -> entries[first];
+  const char * high = listing -> entries[last - 1];
+  int common = 0;
+  while (low[common] && SDL_tolower((unsigned char) low[common]) == SDL_tolower((unsigned char) high[common])) common++;
+
+  if (common > prefixLength || (common == prefixLength && strncmp(low, prefix, (size_t) prefixLength) != 0)) {
+    char replacement[MAX_PATH + 1];
+    if (common > MAX_PATH) return COMPLETE_NONE;
+    memcpy(replacement, low, (size_t) common);
+
+    // Keep the separator style the user typed
+    if (common > 0 && replacement[common - 1] == '\\' && separator >= 0) replacement[common - 1] = argument[separator];
+    return complete_replace(inputBuffer, cursorPos, prefixStart, replacement, common) ? COMPLETE_DONE : COMPLETE_NONE;
+  }
+  if (last - first == 1) return COMPLETE_NONE;
+
+  int shown = 0;
+  for (int i = first; i < last && shown < COMPLETE_MAX_LIST; i++, shown++) {
+    if (!complete_add_candidate(list, size, listing -> entries[i], (int) strlen(listing -> entries[i]))) break;
+  }
+  if (shown < last - first) {
+    char more[64];
+    snprintf(more, sizeof(more), "... %d more", last - first - shown);
+    complete_add_candidate(list, size, more, (int) strlen(more));
+  }
+  return COMPLETE_DONE;
+}
+
+// Completes the word before the cursor: builtin names and arguments, then file names
+CompleteStatus complete_line(char * inputBuffer, int * cursorPos, char * candidates, size_t candidatesSize) {
+  if (!inputBuffer || !cursorPos || !candidates || candidatesSize == 0) return COMPLETE_NONE;
+  candidates[0] = '\0';
+  trie_build();
+
+  int length = * cursorPos;
+  int start = 0;
+  while (start < length && inputBuffer[start] == ' ') start++;
+
+  // Follow the typed text through the trie, remembering the last phrase that takes a path
+  int node = 0;
+  int matched = start;
+  int pathNode = -1;
+  int pathStart = 0;
+  while (matched < length) {
+    int next = trie_child(node, inputBuffer[matched]);
+    if (next < 0) break;
+    node = next;
+    matched++;
+    if (gTrie[node].terminal && gTrie[node].argument != ARG_NONE) {
+      pathNode = node;
+      pathStart = matched;
+    }
+  }
+
+  if (matched == length && gTrie[node].child >= 0) {
+    // Extend while there is only one way forward, stopping at the end of a word
+    char extension[INPUT_BUFFER_SIZE];
+    int extensionLength = 0;
+    int current = node;
+    while (!gTrie[current].terminal && gTrie[current].child >= 0 && gTrie[gTrie[current].child].sibling < 0) {
+      current = gTrie[current].child;
+      extension[extensionLength++] = gTrie[current].c;
+      if (gTrie[current].c == ' ') break;
+    }
+    if (extensionLength > 0) {
+      return complete_replace(inputBuffer, cursorPos, length, extension, extensionLength) ? COMPLETE_DONE : COMPLETE_NONE;
+    }
+
+    int wordStart = length;
+    while (wordStart > start && inputBuffer[wordStart - 1] != ' ') wordStart--;
+    char word[INPUT_BUFFER_SIZE];
+    memcpy(word, inputBuffer + wordStart, (size_t)(length - wordStart));
+    trie_list(node, word, length - wordStart, candidates, candidatesSize);
+    return candidates[0] ? COMPLETE_DONE : COMPLETE_NONE;
+  }
+
+  if (pathNode < 0) return COMPLETE_NONE;
+
+  if (gTrie[pathNode].argument == ARG_LAST_PATH) {
+    for (int i = pathStart; i < length; i++) {
+      if (inputBuffer[i] == ' ') pathStart = i + 1;
+    }
+  }
+  return complete_path(inputBuffer, cursorPos, pathStart, candidates, candidatesSize);
+}
+
+// Must run after threadpool_shutdown() so no directory is still being listed
+void complete_cleanup(void) {
+  for (int i = 0; i < COMPLETE_DIR_CACHE; i++) {
+    if (gIndexes[i].used) complete_release( & gIndexes[i]);
+  }
+}
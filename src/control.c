@@ -0,0 +1,309 @@
+#include <winsock2.h>
+
+#include <afunix.h>
+
+#include <string.h>
+
+#include <stdlib.h>
+
+#include <stdio.h>
+
+#include "control.h"
+
+#include "shell.h"
+
+#define CONTROL_READ_BYTES 65536
+
+// Frames from one read of one client, handed to the UI thread in a single node
+typedef struct ControlMessage {
+  struct ControlMessage * next;
+  ControlFrameType type;
+  size_t length;
+  char text[];
+}
+ControlMessage;
+
+// Bytes received from a client that do not yet form a whole frame
+typedef struct {
+  SOCKET socket;
+  char * buffer;
+  size_t length;
+  size_t capacity;
+}
+ControlClient;
+
+static SDL_Thread * gThread = NULL;
+static SOCKET gListener = INVALID_SOCKET;
+static char gPath[MAX_PATH]; // Set once the socket file is ours
+static bool gWinsock = false;
+static SDL_atomic_t gStop;
+
+// Lock-free stack of messages, newest first; the UI thread takes all of it at once
+static void * gQueue = NULL;
+static SDL_atomic_t gQueuedBytes;
+
+// Text frames are gathered here until the read they came in is handled (listener only)
+static char * gBatch = NULL;
+static size_t gBatchLength = 0;
+static size_t gBatchCapacity = 0;
+
+static bool control_push(ControlFrameType type, const char * text, size_t length) {
+  ControlMessage * message = (ControlMessage * ) malloc(sizeof(ControlMessage) + length + 1);
+  if (!message) return false;
+  message -> type = type;
+  message -> length = length;
+  memcpy(message -> text, text, length);
+  message -> text[length] = '\0';
+
+  // The consumer never pops single nodes, so a plain compare-and-swap push has no ABA problem
+  SDL_AtomicAdd( & gQueuedBytes, (int) length);
+  void * head;
+  do {
+    head = SDL_AtomicGetPtr( & gQueue);
+    message -> next = (ControlMessage * ) head;
+  } while (!SDL_AtomicCASPtr( & gQueue, head, message));
+  return true;
+}
+
+static void control_flush_batch(void) {
+  if (gBatchLength > 0) control_push(CONTROL_FRAME_TEXT, gBatch, gBatchLength);
+  gBatchLength = 0;
+}
+
+static bool control_batch_text(const char * text, size_t length) {
+  if (length == 0) return true;
+
+  // Every frame ends on a line boundary
+  size_t needed = gBatchLength + length + 1;
+  if (needed > gBatchCapacity) {
+    size_t capacity = gBatchCapacity ? gBatchCapacity * 2 : CONTROL_READ_BYTES;
+    while (capacity < needed) capacity *= 2;
+    char * grown = (char * ) realloc(gBatch, capacity);
+    if (!grown) return false;
+    gBatch = grown;
+    gBatchCapacity = capacity;
+  }
+  memcpy(gBatch + gBatchLength, text, length);
+  gBatchLength += length;
+  if (text[length - 1] != '\n') gBatch[gBatchLength++] = '\n';
+  return true;
+}
+
+// Handles every complete frame in the client's buffer; false drops the connection
+static bool control_parse(ControlClient * client) {
+  size_t offset = 0;
+  bool valid = true;
+  while (client -> length - offset >= sizeof(ControlFrameHeader)) {
+    ControlFrameHeader header;
+    memcpy( & header, client -> buffer + offset, sizeof(header));
+    if (header.length > CONTROL_MAX_FRAME) {
+      valid = false;
+      break;
+    }
+    size_t frame = sizeof(header) + header.length;
+    if (client -> length - offset < frame) break;
+
+    const char * payload = client -> buffer + offset + sizeof(header);
+    if (header.type == CONTROL_FRAME_TEXT) {
+      if (!control_batch_text(payload, header.length)) valid = false;
+    } else if (header.type == CONTROL_FRAME_COMMAND) {
+      // Commands run after the text sent before them
+      size_t length = header.length;
+      while (length > 0 && (payload[length - 1] == '\n' || payload[length - 1] == '\r')) length--;
+      if (length > INPUT_BUFFER_SIZE - 1) length = INPUT_BUFFER_SIZE - 1;
+      control_flush_batch();
+      if (length > 0) control_push(CONTROL_FRAME_COMMAND, payload, length);
+    }
+    // Unknown frame types are skipped so older builds accept newer clients
+    offset += frame;
+    if (!valid) break;
+  }
+
+  memmove(client -> buffer, client -> buffer + offset, client -> length - offset);
+  client -> length -= offset;
+  return valid;
+}
+
+static bool control_read(ControlClient * client) {
+  // Room for a full read, or for the rest of a frame larger than that
+  size_t wanted = client -> length + CONTROL_READ_BYTES;
+  if (client -> length >= sizeof(ControlFrameHeader)) {
+    ControlFrameHeader header;
+    memcpy( & header, client -> buffer, sizeof(header));
+    size_t frame = sizeof(header) + (header.length > CONTROL_MAX_FRAME ? 0 : header.length);
+    if (frame > wanted) wanted = frame;
+  }
+  if (wanted > client -> capacity) {
+    char * grown = (char * ) realloc(client -> buffer, wanted);
+    if (!grown) return false;
+    client -> buffer = grown;
+    client -> capacity = wanted;
+  }
+
+  int received = recv(client -> socket, client -> buffer + client -> length, (int)(client -> capacity - client -> length), 0);
+  if (received <= 0) return false;
+  client -> length += (size_t) received;
+
+  bool valid = control_parse(client);
+  control_flush_batch();
+  return valid;
+}
+
+static void control_close_client(ControlClient * client) {
+  closesocket(client -> socket);
+  free(client -> buffer);
+  memset(client, 0, sizeof( * client));
+  client -> socket = INVALID_SOCKET;
+}
+
+static int control_listen(void * data) {
+  (void) data;
+
+  ControlClient clients[CONTROL_MAX_CLIENTS];
+  memset(clients, 0, sizeof(clients));
+  for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) clients[i].socket = INVALID_SOCKET;
+
+  while (!SDL_AtomicGet( & gStop)) {
+    fd_set readable;
+    FD_ZERO( & readable);
+    FD_SET(gListener, & readable);
+
+    // While the UI is behind, clients are left unread and their sends back off
+    bool reading = SDL_AtomicGet( & gQueuedBytes) < (int) CONTROL_QUEUE_BYTES;
+    for (int i = 0; reading && i < CONTROL_MAX_CLIENTS; i++) {
+      if (clients[i].socket != INVALID_SOCKET) FD_SET(clients[i].socket, & readable);
+    }
+
+    struct timeval timeout = { 0, CONTROL_POLL_MS * 1000 };
+    int ready = select(0, & readable, NULL, NULL, & timeout);
+    if (ready == SOCKET_ERROR) break;
+    if (ready == 0) continue;
+
+    if (FD_ISSET(gListener, & readable)) {
+      SOCKET accepted = accept(gListener, NULL, NULL);
+      int slot = -1;
+      for (int i = 0; accepted != INVALID_SOCKET && slot < 0 && i < CONTROL_MAX_CLIENTS; i++) {
+        if (clients[i].socket == INVALID_SOCKET) slot = i;
+      }
+      if (slot >= 0) {
+        clients[slot].socket = accepted;
+      } else if (accepted != INVALID_SOCKET) {
+        closesocket(accepted);
+      }
+    }
+
+    for (int i = 0; reading && i < CONTROL_MAX_CLIENTS; i++) {
+      if (clients[i].socket != INVALID_SOCKET && FD_ISSET(clients[i].socket, & readable) && !control_read( & clients[i]))
+        control_close_client( & clients[i]);
+    }
+  }
+
+  for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+    if (clients[i].socket != INVALID_SOCKET) control_close_client( & clients[i]);
+  }
+  free(gBatch);
+  gBatch = NULL;
+  gBatchLength = 0;
+  gBatchCapacity = 0;
+  return 0;
+}
+
+// A socket file left by an instance that exited uncleanly refuses connections
+static bool control_in_use(const struct sockaddr_un * address) {
+  SOCKET probe = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (probe == INVALID_SOCKET) return false;
+  bool connected = connect(probe, (const struct sockaddr * ) address, sizeof( * address)) == 0;
+  closesocket(probe);
+  return connected;
+}
+
+// Listens on CONTROL_SOCKET_NAME in the temp directory for text and commands from other processes
+bool control_start(void) {
+  if (!CONTROL_SOCKET_ENABLED || gThread) return gThread != NULL;
+
+  WSADATA wsaData;
+  if (WSAStartup(MAKEWORD(2, 2), & wsaData) != 0) return false;
+  gWinsock = true;
+
+  struct sockaddr_un address;
+  memset( & address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  char temp[MAX_PATH];
+  if (!GetTempPathA(sizeof(temp), temp) ||
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s%s", temp, CONTROL_SOCKET_NAME) >= (int) sizeof(address.sun_path))
+    goto fail;
+
+  gListener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (gListener == INVALID_SOCKET) goto fail;
+  if (bind(gListener, (const struct sockaddr * ) & address, sizeof(address)) == SOCKET_ERROR) {
+    if (control_in_use( & address)) {
+      printf("Warning: Control socket %s is in use by another instance.\n", address.sun_path);
+      goto fail;
+    }
+    DeleteFileA(address.sun_path);
+    if (bind(gListener, (const struct sockaddr * ) & address, sizeof(address)) == SOCKET_ERROR) goto fail;
+  }
+  snprintf(gPath, sizeof(gPath), "%s", address.sun_path);
+  if (listen(gListener, SOMAXCONN) == SOCKET_ERROR) goto fail;
+
+  SDL_AtomicSet( & gStop, 0);
+  gThread = SDL_CreateThread(control_listen, "octo-control", NULL);
+  if (!gThread) goto fail;
+
+  printf("Control socket listening on: %s\n", gPath);
+  return true;
+
+fail:
+  control_stop();
+  return false;
+}
+
+// Applies everything clients sent since the last frame, oldest first (UI thread)
+void control_poll(char output[][INPUT_BUFFER_SIZE], int * lineCount) {
+  ControlMessage * stack = (ControlMessage * ) SDL_AtomicSetPtr( & gQueue, NULL);
+  ControlMessage * message = NULL;
+  while (stack) {
+    ControlMessage * next = stack -> next;
+    stack -> next = message;
+    message = stack;
+    stack = next;
+  }
+
+  while (message) {
+    ControlMessage * next = message -> next;
+    if (message -> type == CONTROL_FRAME_TEXT) {
+      shell_append_block(output, lineCount, message -> text, message -> length);
+    } else {
+      char echo[INPUT_BUFFER_SIZE];
+      snprintf(echo, sizeof(echo), "> %s", message -> text);
+      shell_append_line(output, lineCount, echo);
+      shell_submit(message -> text, output, lineCount);
+    }
+    SDL_AtomicAdd( & gQueuedBytes, -(int) message -> length);
+    free(message);
+    message = next;
+  }
+}
+
+void control_stop(void) {
+  SDL_AtomicSet( & gStop, 1);
+  if (gThread) SDL_WaitThread(gThread, NULL);
+  gThread = NULL;
+
+  if (gListener != INVALID_SOCKET) closesocket(gListener);
+  gListener = INVALID_SOCKET;
+  if (gPath[0]) DeleteFileA(gPath);
+  gPath[0] = '\0';
+
+  // Drop whatever the UI never picked up
+  ControlMessage * message = (ControlMessage * ) SDL_AtomicSetPtr( & gQueue, NULL);
+  while (message) {
+    ControlMessage * next = message -> next;
+    free(message);
+    message = next;
+  }
+  SDL_AtomicSet( & gQueuedBytes, 0);
+
+  if (gWinsock) WSACleanup();
+  gWinsock = false;
+}
@@ -0,0 +1,152 @@
+#include <string.h>
+
+#include <stdlib.h>
+
+#include <stdio.h>
+
+#include <ctype.h>
+
+#include "config.h"
+
+#include "fileview.h"
+
+#include "mapfile.h"
+
+#include "shell.h"
+
+// Bytes indexed between cancellation checks
+#define FILEVIEW_INDEX_STEP (4u << 20)
+
+// Prints one file line, splitting it when it does not fit an output line
+static void fileview_print_line(char output[][INPUT_BUFFER_SIZE], int * lineCount, const char * text, size_t length) {
+  do {
+    int chunk = length < INPUT_BUFFER_SIZE - 1 ? (int) length : INPUT_BUFFER_SIZE - 1;
+    shell_print(output, lineCount, "%.*s", chunk, text);
+    text += chunk;
+    length -= chunk;
+  } while (length > 0);
+}
+
+// Prints the end of a file; earlier lines would scroll out of the buffer anyway
+void fileview_cat(const char * path, char output[][INPUT_BUFFER_SIZE], int * lineCount) {
+  MappedFile file;
+  if (!mapfile_open( & file, path)) {
+    shell_print(output, lineCount, "\033[31mcat: cannot open %s\033[0m", path);
+    return;
+  }
+  if (file.size == 0) {
+    mapfile_close( & file);
+    return;
+  }
+
+  size_t start = mapfile_tail_start( & file, MAX_LINES - 1);
+  if (start > 0) {
+    shell_print(output, lineCount, "\033[33m-- %zu earlier bytes not shown; use 'view %s <line>' to page --\033[0m",
+      start, path);
+  }
+
+  const char * cursor = file.data + start;
+  const char * limit = file.data + file.size;
+  while (cursor < limit && !shell_cancelled()) {
+    const char * newline = (const char * ) memchr(cursor, '\n', (size_t)(limit - cursor));
+    const char * lineEnd = newline ? newline : limit;
+    size_t length = (size_t)(lineEnd - cursor);
+    if (length > 0 && cursor[length - 1] == '\r') length--;
+
+    fileview_print_line(output, lineCount, cursor, length);
+    cursor = lineEnd + 1;
+  }
+
+  mapfile_close( & file);
+}
+
+static bool fileview_open(FileView * view, const char * path) {
+  // Reuse the mapping while the file is unchanged; a grown file is remapped
+  if (view -> open && strcmp(path, view -> path) == 0) {
+    MappedFile probe;
+    if (mapfile_open( & probe, path)) {
+      bool same = probe.size == view -> size;
+      mapfile_close( & probe);
+      if (same) return true;
+    }
+  }
+
+  fileview_cleanup(view);
+  if (!mapfile_open( & view -> file, path)) return false;
+
+  strncpy(view -> path, path, sizeof(view -> path) - 1);
+  view -> path[sizeof(view -> path) - 1] = '\0';
+  view -> size = view -> file.size;
+  view -> nextLine = 0;
+  view -> open = true;
+  return true;
+}
+
+// view <file> [line] shows one page; a bare `view` continues with the next page of the session's file
+void fileview_view(const char * args, char output[][INPUT_BUFFER_SIZE], int * lineCount) {
+  FileView * view = shell_file_view();
+  char path[INPUT_BUFFER_SIZE];
+  size_t first = view -> nextLine;
+
+  while ( * args == ' ') args++;
+  strncpy(path, args, sizeof(path) - 1);
+  path[sizeof(path) - 1] = '\0';
+
+  // A trailing number is the 1-based line to start from
+  size_t length = strlen(path);
+  while (length > 0 && path[length - 1] == ' ') path[--length] = '\0';
+  char * lastSpace = strrchr(path, ' ');
+  if (lastSpace && isdigit((unsigned char) lastSpace[1])) {
+    char * endPtr;
+    unsigned long long line = strtoull(lastSpace + 1, & endPtr, 10);
+    if ( * endPtr == '\0') {
+      first = line > 0 ? (size_t) line - 1 : 0;
+      * lastSpace = '\0';
+    }
+  } else if (path[0] != '\0') {
+    first = 0;
+  }
+
+  if (path[0] == '\0') {
+    if (!view -> open) {
+      shell_print(output, lineCount, "Usage: view <file> [line]");
+      return;
+    }
+    strcpy(path, view -> path);
+  }
+
+  if (!fileview_open(view, path)) {
+    shell_print(output, lineCount, "\033[31mview: cannot open %s\033[0m", path);
+    return;
+  }
+
+  // Index only as far as this page needs
+  size_t last = first + VIEW_PAGE_LINES;
+  while (view -> file.lineCount <= last && mapfile_index_step( & view -> file, FILEVIEW_INDEX_STEP)) {
+    if (shell_cancelled()) return;
+  }
+
+  if (first >= view -> file.lineCount) {
+    shell_print(output, lineCount, "\033[33m-- %s has %zu lines --\033[0m", path, view -> file.lineCount);
+    view -> nextLine = view -> file.lineCount;
+    return;
+  }
+
+  size_t shown = 0;
+  const char * text;
+  size_t textLength;
+  for (size_t line = first; shown < VIEW_PAGE_LINES && mapfile_line( & view -> file, line, & text, & textLength); line++) {
+    fileview_print_line(output, lineCount, text, textLength);
+    shown++;
+  }
+
+  view -> nextLine = first + shown;
+  shell_print(output, lineCount, "\033[33m-- %s lines %zu-%zu of %zu%s --\033[0m", path, first + 1, first + shown,
+    view -> file.lineCount, mapfile_index_complete( & view -> file) ? "" : "+");
+}
+
+void fileview_cleanup(FileView * view) {
+  if (view -> open) mapfile_close( & view -> file);
+  view -> open = false;
+  view -> nextLine = 0;
+}
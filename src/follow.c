@@ -0,0 +1,190 @@
+#include <string.h>
+
+#include <stdlib.h>
+
+#include <stdio.h>
+
+#include <stdbool.h>
+
+#include <windows.h>
+
+#include <SDL.h>
+
+#include "config.h"
+
+#include "follow.h"
+
+#include "mapfile.h"
+
+#include "shell.h"
+
+// Bytes read per ReadFile call; one read becomes one batch of lines
+#define FOLLOW_READ_BYTES (1u << 20)
+
+typedef struct {
+  char * block;        // Complete lines waiting to be sent, '\n'-terminated
+  size_t blockLength;
+  char partial[INPUT_BUFFER_SIZE]; // Unterminated tail of the last read
+  size_t partialLength;
+}
+FollowState;
+
+static void follow_take_line(FollowState * state, const char * text, size_t length) {
+  if (length > 0 && text[length - 1] == '\r') length--;
+
+  memcpy(state -> block + state -> blockLength, text, length);
+  for (size_t i = 0; i < length; i++) {
+    if (state -> block[state -> blockLength + i] == '\0') state -> block[state -> blockLength + i] = ' ';
+  }
+  state -> blockLength += length;
+  state -> block[state -> blockLength++] = '\n';
+}
+
+// Splits freshly read bytes into lines that fit an output line
+static void follow_split(FollowState * state, const char * data, size_t size) {
+  const char * p = data;
+  const char * end = data + size;
+
+  while (p < end) {
+    const char * newline = (const char * ) memchr(p, '\n', (size_t)(end - p));
+    const char * lineEnd = newline ? newline : end;
+    size_t length = (size_t)(lineEnd - p);
+
+    // Join with the tail left over from the previous read
+    while (state -> partialLength + length > INPUT_BUFFER_SIZE - 1) {
+      size_t room = INPUT_BUFFER_SIZE - 1 - state -> partialLength;
+      memcpy(state -> partial + state -> partialLength, p, room);
+      follow_take_line(state, state -> partial, INPUT_BUFFER_SIZE - 1);
+      state -> partialLength = 0;
+      p += room;
+      length -= room;
+    }
+
+    memcpy(state -> partial + state -> partialLength, p, length);
+    state -> partialLength += length;
+    p = lineEnd;
+
+    if (newline) {
+      follow_take_line(state, state -> partial, state -> partialLength);
+      state -> partialLength = 0;
+      p++;
+    }
+  }
+}
+
+static void follow_print_tail(const char * path, char output[][INPUT_BUFFER_SIZE], int * lineCount, size_t * offset) {
+  MappedFile file;
+  * offset = 0;
+  if (!mapfile_open( & file, path)) return;
+
+  * offset = file.size;
+  if (file.size > 0) {
+    size_t start = mapfile_tail_start( & file, FOLLOW_INITIAL_LINES);
+    size_t end = file.size;
+
+    // Hold back an unterminated last line; it is read again once complete
+    while (end > start && file.data[end - 1] != '\n') end--;
+    * offset = end;
+
+    for (size_t line = start; line < end;) {
+      const char * newline = (const char * ) memchr(file.data + line, '\n', end - line);
+      size_t length = (size_t)(newline - (file.data + line));
+      if (length > 0 && file.data[line + length - 1] == '\r') length--;
+      if (length > INPUT_BUFFER_SIZE - 1) length = INPUT_BUFFER_SIZE - 1;
+      shell_print(output, lineCount, "%.*s", (int) length, file.data + line);
+      line = (size_t)(newline - file.data) + 1;
+    }
+  }
+  mapfile_close( & file);
+}
+
+// Watches the file's directory so idle waits cost nothing
+static HANDLE follow_watch(const char * path) {
+  char directory[MAX_PATH];
+  strncpy(directory, path, sizeof(directory) - 1);
+  directory[sizeof(directory) - 1] = '\0';
+
+  char * slash = strrchr(directory, '\\');
+  char * forward = strrchr(directory, '/');
+  if (forward > slash) slash = forward;
+  if (slash) {
+    slash[1] = '\0';
+  } else {
+    strcpy(directory, ".");
+  }
+
+  HANDLE change = FindFirstChangeNotificationA(directory, FALSE,
+    FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+  return change == INVALID_HANDLE_VALUE ? NULL : change;
+}
+
+// Prints the end of a file, then streams whatever is appended until Ctrl+C
+void follow_run(const char * path, char output[][INPUT_BUFFER_SIZE], int * lineCount) {
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+    NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    shell_print(output, lineCount, "\033[31mfollow: cannot open %s\033[0m", path);
+    return;
+  }
+
+  FollowState state;
+  memset( & state, 0, sizeof(state));
+  char * buffer = (char * ) malloc(FOLLOW_READ_BYTES);
+
+  // Every read byte can add at most one terminator, plus split long lines
+  size_t blockCapacity = FOLLOW_READ_BYTES * 2 + INPUT_BUFFER_SIZE;
+  state.block = (char * ) malloc(blockCapacity);
+  if (!buffer || !state.block) {
+    shell_print(output, lineCount, "\033[31mfollow: out of memory\033[0m");
+    goto cleanup;
+  }
+
+  size_t offset;
+  follow_print_tail(path, output, lineCount, & offset);
+  shell_print(output, lineCount, "\033[33m-- following %s (Ctrl+C to stop) --\033[0m", path);
+
+  HANDLE change = follow_watch(path);
+  while (!shell_cancelled()) {
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, & size)) break;
+
+    if ((size_t) size.QuadPart < offset) {
+      shell_print(output, lineCount, "\033[33m-- %s truncated --\033[0m", path);
+      offset = 0;
+      state.partialLength = 0;
+    }
+
+    // Drain everything written since the last pass before waiting again
+    bool readAny = false;
+    while ((size_t) size.QuadPart > offset && !shell_cancelled()) {
+      LARGE_INTEGER position;
+      position.QuadPart = (long long) offset;
+      SetFilePointerEx(file, position, NULL, FILE_BEGIN);
+
+      DWORD read = 0;
+      size_t want = (size_t) size.QuadPart - offset;
+      if (want > FOLLOW_READ_BYTES) want = FOLLOW_READ_BYTES;
+      if (!ReadFile(file, buffer, (DWORD) want, & read, NULL) || read == 0) break;
+
+      offset += read;
+      readAny = true;
+      state.blockLength = 0;
+      follow_split( & state, buffer, read);
+      shell_print_lines(output, lineCount, state.block, state.blockLength);
+    }
+    if (readAny) continue;
+
+    if (change) {
+      if (WaitForSingleObject(change, FOLLOW_POLL_MS) == WAIT_OBJECT_0) FindNextChangeNotification(change);
+    } else {
+      SDL_Delay(FOLLOW_POLL_MS);
+    }
+  }
+
+  if (change) FindCloseChangeNotification(change);
+
+cleanup:
+  free(buffer);
+  free(state.block);
+  CloseHandle(file);
+}
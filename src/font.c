@@ -0,0 +1,103 @@
+#include <stdio.h>
+
+#include <SDL.h>
+
+#include <SDL_ttf.h>
+
+#include "config.h"
+
+#include "font.h"
+
+#include "metrics.h"
+
+#if FONT_ZOOM_CACHED_SIZES < 2
+#error "FONT_ZOOM_CACHED_SIZES must leave room for a zoomed size next to FONT_SIZE"
+#endif
+
+// One opened size of the main font; SDL_ttf keeps the glyphs it rendered at that size with it
+typedef struct {
+  TTF_Font * font;
+  int size;
+  Uint32 lastUsed;
+}
+FontSlot;
+
+// Slot 0 holds FONT_SIZE and is never closed before exit, since the title may fall back to it
+static FontSlot gSlots[FONT_ZOOM_CACHED_SIZES];
+static const char * gPath = NULL;
+static int gCurrent = 0;
+static Uint32 gClock = 0;
+
+// Opens the main font at FONT_SIZE; the path is kept for opening other sizes and must outlive the font
+TTF_Font * font_open(const char * path) {
+  if (gSlots[0].font || !path) return gSlots[0].font;
+
+  TTF_Font * font = TTF_OpenFont(path, FONT_SIZE);
+  if (!font) return NULL;
+
+  gPath = path;
+  gSlots[0].font = font;
+  gSlots[0].size = FONT_SIZE;
+  gSlots[0].lastUsed = ++gClock;
+  gCurrent = 0;
+  return font;
+}
+
+TTF_Font * font_current(void) {
+  return gSlots[gCurrent].font;
+}
+
+int font_size(void) {
+  return gSlots[gCurrent].font ? gSlots[gCurrent].size : FONT_SIZE;
+}
+
+// Switches to another size, reusing it if it is still open; true when the size changed
+bool font_set_size(int size) {
+  if (!gSlots[0].font) return false;
+  if (size < FONT_ZOOM_MIN) size = FONT_ZOOM_MIN;
+  if (size > FONT_ZOOM_MAX) size = FONT_ZOOM_MAX;
+  if (size == gSlots[gCurrent].size) return false;
+
+  int slot = -1;
+  for (int i = 0; i < FONT_ZOOM_CACHED_SIZES && slot < 0; i++) {
+    if (gSlots[i].font && gSlots[i].size == size) slot = i;
+  }
+
+  if (slot < 0) {
+    TTF_Font * font = TTF_OpenFont(gPath, size);
+    if (!font) {
+      printf("Warning: Could not open font %s at size %d: %s\n", gPath, size, TTF_GetError());
+      return false;
+    }
+
+    // Take an empty slot, or close the size used longest ago
+    slot = 1;
+    for (int i = 1; i < FONT_ZOOM_CACHED_SIZES && gSlots[slot].font; i++) {
+      if (!gSlots[i].font || gSlots[i].lastUsed < gSlots[slot].lastUsed) slot = i;
+    }
+    if (gSlots[slot].font) {
+      metrics_forget_font(gSlots[slot].font);
+      TTF_CloseFont(gSlots[slot].font);
+    }
+    gSlots[slot].font = font;
+    gSlots[slot].size = size;
+  }
+
+  gSlots[slot].lastUsed = ++gClock;
+  gCurrent = slot;
+  return true;
+}
+
+// Moves the size by steps of FONT_ZOOM_STEP; 0 goes back to FONT_SIZE
+bool font_zoom(int steps) {
+  return font_set_size(steps ? font_size() + steps * FONT_ZOOM_STEP : FONT_SIZE);
+}
+
+void font_cleanup(void) {
+  for (int i = 0; i < FONT_ZOOM_CACHED_SIZES; i++) {
+    if (gSlots[i].font) TTF_CloseFont(gSlots[i].font);
+    gSlots[i].font = NULL;
+  }
+  gCurrent = 0;
+  gPath = NULL;
+}
@@ -0,0 +1,536 @@
+#include <string.h>
+
+#include <stdlib.h>
+
+#include <stdio.h>
+
+#include <ctype.h>
+
+#include <stdint.h>
+
+#include <stdbool.h>
+
+#include <SDL.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "config.h"
+
+#include "grep.h"
+
+#include "mapfile.h"
+
+#include "metrics.h"
+
+#include "scrollback.h"
+
+#include "shell.h"
+
+#include "threadpool.h"
+
+// Files are split into chunks of roughly this size, cut at line boundaries
+#define GREP_CHUNK_BYTES (1u << 20)
+#define GREP_MAX_FILES 64
+#define GREP_MATCH_START "\033[31m"
+#define GREP_MATCH_END "\033[0m"
+
+typedef struct {
+  char text[INPUT_BUFFER_SIZE];
+  size_t length;
+  bool ignoreCase;
+  unsigned char first[2]; // First byte in both cases
+  unsigned char last[2];  // Last byte in both cases
+}
+GrepPattern;
+
+typedef struct {
+  size_t line;   // Line number relative to the chunk start
+  size_t offset; // Highlighted text in the chunk's text buffer
+}
+GrepMatch;
+
+typedef struct {
+  int file;
+  const char * start;
+  const char * end;
+  size_t newlines; // Lines ending inside the chunk, for numbering later chunks
+  GrepMatch * matches;
+  size_t matchCount;
+  size_t matchCapacity;
+  char * text;
+  size_t textLength;
+  size_t textCapacity;
+  SDL_atomic_t done;
+}
+GrepChunk;
+
+// Chunk indices [head, tail) owned by one participant; thieves take from the tail
+typedef struct {
+  SDL_SpinLock lock;
+  int head;
+  int tail;
+}
+GrepDeque;
+
+typedef struct {
+  GrepPattern pattern;
+  GrepChunk * chunks;
+  int chunkCount;
+  GrepDeque * deques;
+  int participants;
+  SDL_atomic_t nextParticipant;
+  SDL_atomic_t active;
+  SDL_atomic_t stop;
+  SDL_mutex * lock;
+  SDL_cond * progress;
+}
+GrepJob;
+
+static inline unsigned char grep_fold(unsigned char c, bool ignoreCase) {
+  return ignoreCase ? (unsigned char) tolower(c) : c;
+}
+
+static bool grep_pattern_init(GrepPattern * pattern, const char * text, bool ignoreCase) {
+  pattern -> length = strlen(text);
+  if (pattern -> length == 0 || pattern -> length >= sizeof(pattern -> text)) return false;
+
+  memcpy(pattern -> text, text, pattern -> length + 1);
+  pattern -> ignoreCase = ignoreCase;
+
+  unsigned char first = (unsigned char) text[0];
+  unsigned char last = (unsigned char) text[pattern -> length - 1];
+  pattern -> first[0] = ignoreCase ? (unsigned char) tolower(first) : first;
+  pattern -> first[1] = ignoreCase ? (unsigned char) toupper(first) : first;
+  pattern -> last[0] = ignoreCase ? (unsigned char) tolower(last) : last;
+  pattern -> last[1] = ignoreCase ? (unsigned char) toupper(last) : last;
+  return true;
+}
+
+static bool grep_verify(const GrepPattern * pattern, const char * at) {
+  if (!pattern -> ignoreCase) return memcmp(at, pattern -> text, pattern -> length) == 0;
+
+  for (size_t i = 0; i < pattern -> length; i++) {
+    if (grep_fold((unsigned char) at[i], true) != grep_fold((unsigned char) pattern -> text[i], true))
+      return false;
+  }
+  return true;
+}
+
+// Next occurrence in [from, limit), or NULL
+static const char * grep_find(const GrepPattern * pattern, const char * from, const char * limit) {
+  size_t length = pattern -> length;
+  if ((size_t)(limit - from) < length) return NULL;
+  const char * lastStart = limit - length;
+  const char * p = from;
+
+#if defined(__SSE2__)
+  // Prefilter 16 candidate positions at once on the first and last pattern bytes
+  const __m128i first0 = _mm_set1_epi8((char) pattern -> first[0]);
+  const __m128i first1 = _mm_set1_epi8((char) pattern -> first[1]);
+  const __m128i last0 = _mm_set1_epi8((char) pattern -> last[0]);
+  const __m128i last1 = _mm_set1_epi8((char) pattern -> last[1]);
+
+  while (p + 16 <= lastStart + 1) {
+    __m128i head = _mm_loadu_si128((const __m128i * ) p);
+    __m128i tail = _mm_loadu_si128((const __m128i * )(p + length - 1));
+    __m128i hit = _mm_and_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(head, first0), _mm_cmpeq_epi8(head, first1)),
+      _mm_or_si128(_mm_cmpeq_epi8(tail, last0), _mm_cmpeq_epi8(tail, last1)));
+
+    unsigned mask = (unsigned) _mm_movemask_epi8(hit);
+    while (mask) {
+      int bit = __builtin_ctz(mask);
+      if (grep_verify(pattern, p + bit)) return p + bit;
+      mask &= mask - 1;
+    }
+    p += 16;
+  }
+#endif
+
+  for (; p <= lastStart; p++) {
+    unsigned char c = (unsigned char) * p;
+    if ((c == pattern -> first[0] || c == pattern -> first[1]) && grep_verify(pattern, p)) return p;
+  }
+  return NULL;
+}
+
+// Copies a line with every occurrence wrapped in highlight codes
+static size_t grep_highlight(const GrepPattern * pattern, const char * line, const char * lineEnd, char * dest, size_t destSize) {
+  size_t used = 0;
+  const char * p = line;
+
+  while (p < lineEnd && used + 1 < destSize) {
+    const char * match = grep_find(pattern, p, lineEnd);
+    const char * plainEnd = match ? match : lineEnd;
+
+    size_t plain = (size_t)(plainEnd - p);
+    if (plain > destSize - 1 - used) plain = destSize - 1 - used;
+    memcpy(dest + used, p, plain);
+    used += plain;
+    if (!match) break;
+
+    int written = snprintf(dest + used, destSize - used, GREP_MATCH_START "%.*s" GREP_MATCH_END,
+      (int) pattern -> length, match);
+    if (written < 0 || (size_t) written >= destSize - used) break;
+    used += (size_t) written;
+    p = match + pattern -> length;
+  }
+
+  dest[used] = '\0';
+  return used;
+}
+
+static bool grep_chunk_add(GrepChunk * chunk, size_t line, const char * text, size_t length) {
+  if (chunk -> matchCount == chunk -> matchCapacity) {
+    size_t capacity = chunk -> matchCapacity ? chunk -> matchCapacity * 2 : 64;
+    GrepMatch * grown = (GrepMatch * ) realloc(chunk -> matches, capacity * sizeof(GrepMatch));
+    if (!grown) return false;
+    chunk -> matches = grown;
+    chunk -> matchCapacity = capacity;
+  }
+  if (chunk -> textLength + length + 1 > chunk -> textCapacity) {
+    size_t capacity = chunk -> textCapacity ? chunk -> textCapacity * 2 : 16384;
+    while (capacity < chunk -> textLength + length + 1) capacity *= 2;
+    char * grown = (char * ) realloc(chunk -> text, capacity);
+    if (!grown) return false;
+    chunk -> text = grown;
+    chunk -> textCapacity = capacity;
+  }
+
+  GrepMatch * match = & chunk -> matches[chunk -> matchCount++];
+  match -> line = line;
+  match -> offset = chunk -> textLength;
+  memcpy(chunk -> text + chunk -> textLength, text, length + 1);
+  chunk -> textLength += length + 1;
+  return true;
+}
+
+static size_t grep_count_newlines(const char * from, const char * limit) {
+  size_t count = 0;
+  while (from < limit && (from = (const char * ) memchr(from, '\n', (size_t)(limit - from))) != NULL) {
+    count++;
+    from++;
+  }
+  return count;
+}
+
+static void grep_search_chunk(GrepJob * job, GrepChunk * chunk) {
+  const GrepPattern * pattern = & job -> pattern;
+  const char * p = chunk -> start;
+  const char * counted = chunk -> start;
+  size_t line = 0;
+  char highlighted[INPUT_BUFFER_SIZE];
+
+  while (p < chunk -> end && !SDL_AtomicGet( & job -> stop)) {
+    const char * match = grep_find(pattern, p, chunk -> end);
+    if (!match) break;
+
+    const char * lineStart = match;
+    while (lineStart > chunk -> start && lineStart[-1] != '\n') lineStart--;
+    const char * lineEnd = (const char * ) memchr(match, '\n', (size_t)(chunk -> end - match));
+    if (!lineEnd) lineEnd = chunk -> end;
+
+    line += grep_count_newlines(counted, lineStart);
+    counted = lineStart;
+
+    const char * visibleEnd = lineEnd;
+    if (visibleEnd > lineStart && visibleEnd[-1] == '\r') visibleEnd--;
+    size_t length = grep_highlight(pattern, lineStart, visibleEnd, highlighted, sizeof(highlighted));
+    if (!grep_chunk_add(chunk, line, highlighted, length)) break;
+
+    p = lineEnd + 1;
+  }
+
+  chunk -> newlines = line + grep_count_newlines(counted, chunk -> end);
+}
+
+// Owner pops from the front of its range so early chunks finish first
+static int grep_take(GrepJob * job, int self) {
+  GrepDeque * own = & job -> deques[self];
+  int index = -1;
+  SDL_AtomicLock( & own -> lock);
+  if (own -> head < own -> tail) index = own -> head++;
+  SDL_AtomicUnlock( & own -> lock);
+  if (index >= 0) return index;
+
+  // Steal the last chunk of the first non-empty victim
+  for (int k = 1; k < job -> participants; k++) {
+    GrepDeque * victim = & job -> deques[(self + k) % job -> participants];
+    SDL_AtomicLock( & victim -> lock);
+    if (victim -> head < victim -> tail) index = --victim -> tail;
+    SDL_AtomicUnlock( & victim -> lock);
+    if (index >= 0) return index;
+  }
+  return -1;
+}
+
+static void grep_run_chunk(GrepJob * job, int index) {
+  grep_search_chunk(job, & job -> chunks[index]);
+  SDL_AtomicSet( & job -> chunks[index].done, 1);
+
+  SDL_LockMutex(job -> lock);
+  SDL_CondSignal(job -> progress);
+  SDL_UnlockMutex(job -> lock);
+}
+
+static void grep_worker(void * arg) {
+  GrepJob * job = (GrepJob * ) arg;
+  int self = SDL_AtomicAdd( & job -> nextParticipant, 1);
+
+  int index;
+  while (!SDL_AtomicGet( & job -> stop) && (index = grep_take(job, self)) >= 0) {
+    grep_run_chunk(job, index);
+  }
+
+  SDL_LockMutex(job -> lock);
+  SDL_AtomicAdd( & job -> active, -1);
+  SDL_CondSignal(job -> progress);
+  SDL_UnlockMutex(job -> lock);
+}
+
+// Splits [data, data + size) into chunks that end on line boundaries
+static bool grep_add_chunks(GrepJob * job, int * capacity, int file, const char * data, size_t size) {
+  const char * p = data;
+  const char * limit = data + size;
+
+  while (p < limit) {
+    const char * end = (size_t)(limit - p) > GREP_CHUNK_BYTES ? p + GREP_CHUNK_BYTES : limit;
+    if (end < limit) {
+      const char * newline = (const char * ) memchr(end, '\n', (size_t)(limit - end));
+      end = newline ? newline + 1 : limit;
+    }
+
+    if (job -> chunkCount == * capacity) {
+      int grownCapacity = * capacity ? * capacity * 2 : 64;
+      GrepChunk * grown = (GrepChunk * ) realloc(job -> chunks, grownCapacity * sizeof(GrepChunk));
+      if (!grown) return false;
+      job -> chunks = grown;
+      * capacity = grownCapacity;
+    }
+
+    GrepChunk * chunk = & job -> chunks[job -> chunkCount++];
+    memset(chunk, 0, sizeof( * chunk));
+    chunk -> file = file;
+    chunk -> start = p;
+    chunk -> end = end;
+    p = end;
+  }
+  return true;
+}
+
+// Prints one output line with colour codes removed if it matches
+static bool grep_output_line(const GrepPattern * pattern, const char * text, int length,
+  char output[][INPUT_BUFFER_SIZE], int * lineCount) {
+  char plain[INPUT_BUFFER_SIZE];
+  char highlighted[INPUT_BUFFER_SIZE];
+
+  if (length > INPUT_BUFFER_SIZE - 1) length = INPUT_BUFFER_SIZE - 1;
+  int used = 0;
+  for (int k = 0; k < length;) {
+    int escape = metrics_escape_length(text + k, length - k);
+    if (escape > 0) {
+      k += escape;
+      continue;
+    }
+    plain[used++] = text[k++];
+  }
+
+  if (!grep_find(pattern, plain, plain + used)) return false;
+  grep_highlight(pattern, plain, plain + used, highlighted, sizeof(highlighted));
+  shell_print(output, lineCount, "%s", highlighted);
+  return true;
+}
+
+// Searches the archived scrollback, then the output, with colour codes removed
+static size_t grep_scrollback(const GrepPattern * pattern, char output[][INPUT_BUFFER_SIZE], int * lineCount, size_t budget) {
+  int lines = * lineCount;
+  size_t found = 0;
+
+  // Matches printed from here are archived too, so only lines already there are searched.
+  // Compressed blocks are expanded one at a time into a private copy.
+  Scrollback * archive = shell_scrollback();
+  size_t archived = shell_archived_lines();
+  int blocks = scrollback_block_count(archive);
+  for (int b = 0; b < blocks && archived > 0 && found < budget && !shell_cancelled(); b++) {
+    size_t length = 0;
+    char * text = scrollback_read_block(archive, b, & length);
+    if (!text) break;
+
+    for (char * line = text, * newline; archived > 0 && found < budget &&
+      (newline = (char * ) memchr(line, '\n', (size_t)(text + length - line))) != NULL; line = newline + 1) {
+      archived--;
+      if (grep_output_line(pattern, line, (int)(newline - line), output, lineCount)) found++;
+    }
+    free(text);
+  }
+
+  for (int i = 0; i < lines && found < budget && !shell_cancelled(); i++) {
+    if (grep_output_line(pattern, output[i], (int) strnlen(output[i], INPUT_BUFFER_SIZE - 1), output, lineCount)) found++;
+  }
+  return found;
+}
+
+// Splits arguments on spaces, honouring double quotes
+static int grep_tokenize(char * args, char * tokens[], int maxTokens) {
+  int count = 0;
+  char * p = args;
+
+  while ( * p && count < maxTokens) {
+    while ( * p == ' ') p++;
+    if (! * p) break;
+
+    if ( * p == '"') {
+      tokens[count++] = ++p;
+      while ( * p && * p != '"') p++;
+    } else {
+      tokens[count++] = p;
+      while ( * p && * p != ' ') p++;
+    }
+    if ( * p) * p++ = '\0';
+  }
+  return count;
+}
+
+// grep [-i] <pattern> [file...]; without files the scrollback is searched
+void grep_run(const char * args, char output[][INPUT_BUFFER_SIZE], int * lineCount) {
+  char buffer[INPUT_BUFFER_SIZE];
+  strncpy(buffer, args, sizeof(buffer) - 1);
+  buffer[sizeof(buffer) - 1] = '\0';
+
+  char * tokens[GREP_MAX_FILES + 3];
+  int tokenCount = grep_tokenize(buffer, tokens, GREP_MAX_FILES + 3);
+
+  bool ignoreCase = false;
+  int next = 0;
+  while (next < tokenCount && strcmp(tokens[next], "-i") == 0) {
+    ignoreCase = true;
+    next++;
+  }
+
+  GrepJob job;
+  memset( & job, 0, sizeof(job));
+  if (next >= tokenCount || !grep_pattern_init( & job.pattern, tokens[next], ignoreCase)) {
+    shell_print(output, lineCount, "Usage: grep [-i] <text> [file...]");
+    return;
+  }
+  next++;
+
+  Uint64 started = SDL_GetPerformanceCounter();
+  size_t found = 0;
+
+  if (next == tokenCount) {
+    found = grep_scrollback( & job.pattern, output, lineCount, GREP_MAX_MATCHES);
+    if (found == 0) shell_print(output, lineCount, "\033[33m-- no matches --\033[0m");
+    return;
+  }
+
+  // Map every file and cut it into chunks
+  const char * names[GREP_MAX_FILES];
+  MappedFile files[GREP_MAX_FILES];
+  int fileCount = 0;
+  int chunkCapacity = 0;
+  size_t totalBytes = 0;
+
+  for (; next < tokenCount && fileCount < GREP_MAX_FILES; next++) {
+    if (!mapfile_open( & files[fileCount], tokens[next])) {
+      shell_print(output, lineCount, "\033[31mgrep: cannot open %s\033[0m", tokens[next]);
+      continue;
+    }
+    names[fileCount] = tokens[next];
+    totalBytes += files[fileCount].size;
+    if (files[fileCount].size > 0 && !grep_add_chunks( & job, & chunkCapacity, fileCount, files[fileCount].data, files[fileCount].size)) {
+      shell_print(output, lineCount, "\033[31mgrep: out of memory\033[0m");
+      fileCount++;
+      goto cleanup;
+    }
+    fileCount++;
+  }
+
+  // One range of chunks per participant; this thread is participant 0
+  job.participants = threadpool_worker_count() + 1;
+  if (job.participants > job.chunkCount) job.participants = job.chunkCount > 0 ? job.chunkCount : 1;
+  job.deques = (GrepDeque * ) calloc(job.participants, sizeof(GrepDeque));
+  job.lock = SDL_CreateMutex();
+  job.progress = SDL_CreateCond();
+  if (!job.deques || !job.lock || !job.progress) {
+    shell_print(output, lineCount, "\033[31mgrep: out of memory\033[0m");
+    goto cleanup;
+  }
+
+  for (int i = 0; i < job.participants; i++) {
+    job.deques[i].head = (int)((long long) job.chunkCount * i / job.participants);
+    job.deques[i].tail = (int)((long long) job.chunkCount * (i + 1) / job.participants);
+  }
+
+  SDL_AtomicSet( & job.nextParticipant, 1);
+  for (int i = 1; i < job.participants; i++) {
+    SDL_AtomicAdd( & job.active, 1);
+    if (!threadpool_submit(grep_worker, & job)) SDL_AtomicAdd( & job.active, -1);
+  }
+
+  // Emit finished chunks in order while helping with the search
+  int emitted = 0;
+  int currentFile = -1;
+  size_t lineBase = 0;
+  while (emitted < job.chunkCount) {
+    if (shell_cancelled() || found >= GREP_MAX_MATCHES) {
+      SDL_AtomicSet( & job.stop, 1);
+      break;
+    }
+
+    GrepChunk * chunk = & job.chunks[emitted];
+    if (SDL_AtomicGet( & chunk -> done)) {
+      if (chunk -> file != currentFile) {
+        currentFile = chunk -> file;
+        lineBase = 0;
+      }
+      for (size_t m = 0; m < chunk -> matchCount && found < GREP_MAX_MATCHES; m++, found++) {
+        shell_print(output, lineCount, "%s:%zu: %s", names[chunk -> file],
+          lineBase + chunk -> matches[m].line + 1, chunk -> text + chunk -> matches[m].offset);
+      }
+      lineBase += chunk -> newlines;
+      emitted++;
+      continue;
+    }
+
+    int index = grep_take( & job, 0);
+    if (index >= 0) {
+      grep_run_chunk( & job, index);
+      continue;
+    }
+
+    SDL_LockMutex(job.lock);
+    if (!SDL_AtomicGet( & chunk -> done)) SDL_CondWaitTimeout(job.progress, job.lock, 20);
+    SDL_UnlockMutex(job.lock);
+  }
+
+  // Helpers still reference the job until they have all left
+  SDL_LockMutex(job.lock);
+  while (SDL_AtomicGet( & job.active) > 0) SDL_CondWaitTimeout(job.progress, job.lock, 20);
+  SDL_UnlockMutex(job.lock);
+
+  if (shell_cancelled()) {
+    // Output of a cancelled command is discarded anyway
+  } else if (found >= GREP_MAX_MATCHES) {
+    shell_print(output, lineCount, "\033[33m-- stopped after %d matches --\033[0m", GREP_MAX_MATCHES);
+  } else {
+    double elapsedMs = (SDL_GetPerformanceCounter() - started) * 1000.0 / SDL_GetPerformanceFrequency();
+    shell_print(output, lineCount, "\033[33m-- %zu matches in %.1f MB (%.1f ms, %d threads) --\033[0m",
+      found, totalBytes / (1024.0 * 1024.0), elapsedMs, job.participants);
+  }
+
+cleanup:
+  for (int i = 0; i < job.chunkCount; i++) {
+    free(job.chunks[i].matches);
+    free(job.chunks[i].text);
+  }
+  free(job.chunks);
+  free(job.deques);
+  if (job.progress) SDL_DestroyCond(job.progress);
+  if (job.lock) SDL_DestroyMutex(job.lock);
+  for (int i = 0; i < fileCount; i++) {
+    mapfile_close( & files[i]);
+  }
+}
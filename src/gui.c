@@ -16,8 +16,27 @@
 
 #include "gui.h"
 
+#include "layout.h"
+
+#include "metrics.h"
+
+#include "pager.h"
+
+#include "watch.h"
+
+#include "histsearch.h"
+
+#include "shell.h"
+
+#include "session.h"
+
+#include "pane.h"
+
+#include "utf8.h"
+
 static SDL_Renderer * gRenderer = NULL;
 static TTF_Font * gFont = NULL;
+static int gFontSize = FONT_SIZE; // Point size of gFont, changed by zooming
 static TTF_Font * gTitleFont = NULL;
 static SDL_Window * gWindow = NULL;
 
@@ -29,28 +48,57 @@ static SDL_Cursor * arrowCursor = NULL;
 static SDL_Cursor * ibeamCursor = NULL;
 static bool isIbeamCursorActive = false;
 
+// Rows shown by the last frame, used to map mouse positions back to source lines
+static const Layout * gVisibleLayout = NULL;
+static int gFirstVisibleRow = 0;
+static int gOutputTop = 0;
+static SDL_Rect gFocusViewport; // Focused pane in the last frame
+static int gInputTop = 0;
+
+// Each pane draws into a texture of its own that is only redrawn when what it shows changes,
+// so a busy pane does not cost the quiet ones a redraw
+typedef struct {
+  SDL_Texture * texture;
+  int width;
+  int height;
+  Uint32 damage; // Hash of everything the last drawing depended on
+}
+PaneTarget;
+
+static PaneTarget gPaneTargets[PANE_NODES];
+
 static SDL_Texture * gBackgroundTexture = NULL;
 static float gBackgroundOpacity = 1.0f;
 
 // Word wrap global variable
 extern int wordWrapEnabled;
 
-int gui_set_background_image(const char * imagePath) {
-  if (!gRenderer || !imagePath) return 0;
-
-  // Clean up existing background texture
-  if (gBackgroundTexture) {
-    SDL_DestroyTexture(gBackgroundTexture);
-    gBackgroundTexture = NULL;
-  }
+// Decodes an image file; safe to call off the render thread
+SDL_Surface * gui_load_background_surface(const char * imagePath) {
+  if (!imagePath) return NULL;
 
-  // Load new background image using SDL_image for better format support
+  // Load image using SDL_image for better format support
   SDL_Surface * surface = IMG_Load(imagePath);
   if (!surface) {
     printf("Warning: Could not load background image: %s\n", IMG_GetError());
+  }
+  return surface;
+}
+
+// Replaces the background texture; takes ownership of the surface
+int gui_set_background_surface(SDL_Surface * surface) {
+  if (!surface) return 0;
+  if (!gRenderer) {
+    SDL_FreeSurface(surface);
     return 0;
   }
 
+  // Clean up existing background texture
+  if (gBackgroundTexture) {
+    SDL_DestroyTexture(gBackgroundTexture);
+    gBackgroundTexture = NULL;
+  }
+
   gBackgroundTexture = SDL_CreateTextureFromSurface(gRenderer, surface);
   SDL_FreeSurface(surface);
 
@@ -62,12 +110,25 @@ int gui_set_background_image(const char * imagePath) {
   return 1; // Success
 }
 
+int gui_set_background_image(const char * imagePath) {
+  if (!gRenderer || !imagePath) return 0;
+
+  SDL_Surface * surface = gui_load_background_surface(imagePath);
+  if (!surface) return 0;
+
+  return gui_set_background_surface(surface);
+}
+
 void gui_set_background_opacity(float opacity) {
   if (opacity < 0.0f) opacity = 0.0f;
   if (opacity > 1.0f) opacity = 1.0f;
   gBackgroundOpacity = opacity;
 }
 
+float gui_get_background_opacity(void) {
+  return gBackgroundOpacity;
+}
+
 void gui_cleanup_background(void) {
   if (gBackgroundTexture) {
     SDL_DestroyTexture(gBackgroundTexture);
@@ -80,18 +141,34 @@ void gui_init(SDL_Renderer * renderer, TTF_Font * font) {
 
   gRenderer = renderer;
   gFont = font;
+  gFontSize = FONT_SIZE;
   gTitleFont = NULL;
   lastCursorToggle = SDL_GetTicks();
   cursorVisible = true;
 
   gWindow = SDL_RenderGetWindow(renderer);
 
+  // Glyph advances are measured once per font, not per event
+  metrics_set_font(font);
+
   // Initialize cursors
   arrowCursor = SDL_CreateSystemCursor(SDL_SYSTEM_CURSOR_ARROW);
   ibeamCursor = SDL_CreateSystemCursor(SDL_SYSTEM_CURSOR_IBEAM);
   isIbeamCursorActive = false;
 }
 
+// Switches the main font, e.g. to a zoomed size; rows and pane textures follow from the next frame
+void gui_set_font(TTF_Font * font, int size) {
+  if (!font) return;
+  gFont = font;
+  gFontSize = size;
+  metrics_set_font(font);
+}
+
+static int gui_line_height(void) {
+  return gFontSize + 4;
+}
+
 void gui_set_title_font(TTF_Font * titleFont) {
   gTitleFont = titleFont;
 }
@@ -105,35 +182,55 @@ void gui_get_window_size(int * width, int * height) {
   }
 }
 
-void render_text_colored(const char * text, int x, int y, SDL_Color fg, SDL_Color bg) {
-  if (!text || strlen(text) == 0 || !gFont || !gRenderer)
-    return;
-
-  // Check for command color codes
-  SDL_Color textColor = fg;
-  const char * displayText = text;
+// Foreground colours for SGR codes 30-37 (bright variants 90-97 are derived)
+static const SDL_Color ansiPalette[8] = {
+  {96, 96, 96, 255},
+  {ERROR_COLOR_R, ERROR_COLOR_G, ERROR_COLOR_B, 255},
+  {0, 255, 0, 255},
+  {255, 215, 0, 255},
+  {90, 140, 255, 255},
+  {220, 110, 255, 255},
+  {0, 220, 220, 255},
+  {230, 230, 230, 255}
+};
+
+// Applies the parameters of an SGR sequence ("\033[...m") to the current colour
+static void ansi_apply_sgr(const char * sequence, int length, SDL_Color * color, SDL_Color fg) {
+  if (length < 3 || sequence[length - 1] != 'm') return;
+
+  int code = 0;
+  for (int i = 2; i < length; i++) {
+    if (isdigit((unsigned char) sequence[i])) {
+      code = code * 10 + (sequence[i] - '0');
+      continue;
+    }
 
-  if (strstr(text, "\033[32m") != NULL) { // Green for commands
-    textColor = (SDL_Color) {
-      0,
-      255,
-      0,
-      255
-    };
-    // Skip color codes in display
-    displayText = strstr(text, "\033[32m") + 5;
-    char * endCode = strstr(displayText, "\033[0m");
-    if (endCode) * endCode = '\0';
+    if (code == 0 || code == 39) {
+      * color = fg;
+    } else if (code >= 30 && code <= 37) {
+      * color = ansiPalette[code - 30];
+    } else if (code >= 90 && code <= 97) {
+      SDL_Color bright = ansiPalette[code - 90];
+      bright.r = (Uint8)((bright.r + 255) / 2);
+      bright.g = (Uint8)((bright.g + 255) / 2);
+      bright.b = (Uint8)((bright.b + 255) / 2);
+      * color = bright;
+    }
+    code = 0;
   }
+}
 
-  SDL_Surface * surface = TTF_RenderText_Shaded(gFont, displayText, textColor, bg);
+// Renders one run of plain text and returns its width
+static int render_text_run(const char * text, int x, int y, SDL_Color fg, SDL_Color bg) {
+  SDL_Surface * surface = TTF_RenderUTF8_Shaded(gFont, text, fg, bg);
   if (!surface)
-    return;
+    return 0;
 
+  int width = surface -> w;
   SDL_Texture * texture = SDL_CreateTextureFromSurface(gRenderer, surface);
   if (!texture) {
     SDL_FreeSurface(surface);
-    return;
+    return width;
   }
 
   SDL_Rect dst = {
@@ -146,6 +243,59 @@ void render_text_colored(const char * text, int x, int y, SDL_Color fg, SDL_Colo
 
   SDL_FreeSurface(surface);
   SDL_DestroyTexture(texture);
+  return width;
+}
+
+void render_text_colored(const char * text, int x, int y, SDL_Color fg, SDL_Color bg) {
+  if (!text || strlen(text) == 0 || !gFont || !gRenderer)
+    return;
+
+  // Colour escape sequences switch the colour of the runs that follow them
+  SDL_Color textColor = fg;
+  char run[INPUT_BUFFER_SIZE];
+  const char * p = text;
+  int remaining = (int) strlen(text);
+
+  while (remaining > 0) {
+    int escape = metrics_escape_length(p, remaining);
+    if (escape > 0) {
+      ansi_apply_sgr(p, escape, & textColor, fg);
+      p += escape;
+      remaining -= escape;
+      continue;
+    }
+
+    const char * next = (const char * ) memchr(p + 1, '\033', remaining - 1);
+    int length = next ? (int)(next - p) : remaining;
+    int copied = length < (int) sizeof(run) - 1 ? length : (int) sizeof(run) - 1;
+    memcpy(run, p, copied);
+    run[copied] = '\0';
+
+    x += render_text_run(run, x, y, textColor, bg);
+    p += length;
+    remaining -= length;
+  }
+}
+
+// Copies the last colour sequence before offset so a wrapped row keeps its colour
+static int ansi_active_prefix(const char * line, int offset, char * dest, int destSize) {
+  int start = -1;
+  int length = 0;
+
+  for (int i = 0; i < offset;) {
+    int escape = metrics_escape_length(line + i, offset - i);
+    if (escape > 0) {
+      start = i;
+      length = escape;
+      i += escape;
+    } else {
+      i++;
+    }
+  }
+
+  if (start < 0 || length >= destSize || strncmp(line + start, "\033[0m", 4) == 0) return 0;
+  memcpy(dest, line + start, length);
+  return length;
 }
 
 void render_text_with_command_colors(const char * text, int x, int y, SDL_Color bg) {
@@ -168,7 +318,11 @@ void render_text_with_command_colors(const char * text, int x, int y, SDL_Color
       strncmp(command, "echo ", 5) == 0 || strncmp(command, "wordwrap", 8) == 0 ||
       strncmp(command, "background", 10) == 0 || strncmp(command, "version", 7) == 0 ||
       strncmp(command, "shortcuts", 9) == 0 || strncmp(command, "exit", 4) == 0 ||
-      strncmp(command, "quit", 4) == 0) {
+      strncmp(command, "quit", 4) == 0 || strncmp(command, "cat ", 4) == 0 ||
+      strncmp(command, "view", 4) == 0 || strncmp(command, "grep ", 5) == 0 || strncmp(command, "less ", 5) == 0 ||
+      strncmp(command, "follow ", 7) == 0 || strncmp(command, "tail -f ", 8) == 0 ||
+      strncmp(command, "watch ", 6) == 0 || strncmp(command, "scrollback", 10) == 0 ||
+      strncmp(command, "session", 7) == 0) {
       textColor = (SDL_Color) {
         COMMAND_COLOR_R,
         COMMAND_COLOR_G,
@@ -220,7 +374,7 @@ void render_centered_title(const char * title, int y) {
     255
   };
 
-  SDL_Surface * surface = TTF_RenderText_Shaded(fontToUse, title, titleColor, bgColor);
+  SDL_Surface * surface = TTF_RenderUTF8_Shaded(fontToUse, title, titleColor, bgColor);
   if (!surface)
     return;
 
@@ -250,6 +404,21 @@ void render_centered_title(const char * title, int y) {
   SDL_DestroyTexture(texture);
 }
 
+// Returns the selection with its start before its end
+void gui_selection_bounds(const TextSelection * selection, int * startLine, int * startChar, int * endLine, int * endChar) {
+  * startLine = selection -> startLine;
+  * startChar = selection -> startChar;
+  * endLine = selection -> endLine;
+  * endChar = selection -> endChar;
+
+  if ( * startLine > * endLine || ( * startLine == * endLine && * startChar > * endChar)) {
+    * startLine = selection -> endLine;
+    * startChar = selection -> endChar;
+    * endLine = selection -> startLine;
+    * endChar = selection -> startChar;
+  }
+}
+
 void render_selection_highlight(int x, int y, int width, int height) {
   if (!gRenderer || width <= 0 || height <= 0)
     return;
@@ -271,7 +440,7 @@ void render_cursor(int x, int y) {
     return;
 
   int cursorWidth = 2;
-  int cursorHeight = FONT_SIZE;
+  int cursorHeight = gFontSize;
 
   SDL_Rect cursorRect = {
     x,
@@ -284,19 +453,18 @@ void render_cursor(int x, int y) {
 }
 
 int gui_get_char_width() {
-  if (!gFont) return 8;
-  int w;
-  TTF_SizeText(gFont, "W", & w, NULL);
-  return w;
+  return metrics_char_width();
 }
 
+// Columns that fit in the focused pane, or the window before the first frame
 int get_text_width_in_chars(void) {
   int charWidth = gui_get_char_width();
 
   int windowWidth, windowHeight;
   gui_get_window_size( & windowWidth, & windowHeight);
+  if (gFocusViewport.w > 0) windowWidth = gFocusViewport.w;
 
-  int availableWidth = windowWidth - 20;
+  int availableWidth = windowWidth - PANE_PADDING * 2;
   return availableWidth / charWidth;
 }
 
@@ -318,24 +486,37 @@ void wrap_text(const char * text, char wrapped[][INPUT_BUFFER_SIZE], int * wrapp
     int lastSpace = -1;
     int lineLength = 0;
 
-    // Find the end of the current line
-    while (i < textLen && lineLength < maxWidth) {
-      if (text[i] == ' ')
-        lastSpace = i;
-
+    // Find the end of the current line, counting columns rather than bytes
+    bool full = false;
+    while (i < textLen) {
       if (text[i] == '\n') {
         break;
       }
 
-      lineLength++;
-      i++;
+      int step = utf8_next(text, textLen, i) - i;
+      int width = (unsigned char) text[i] < 0x80 ? 1 : utf8_columns(text + i, step);
+      if (lineLength + width > maxWidth) {
+        full = true;
+        break;
+      }
+
+      if (text[i] == ' ')
+        lastSpace = i;
+      lineLength += width;
+      i += step;
+    }
+
+    // A character wider than the whole row still gets a row of its own
+    if (i == lineStart && full) {
+      i = utf8_next(text, textLen, i);
+      full = false;
     }
 
     // Determine where to break the line
     int lineEnd;
     if (i >= textLen || text[i] == '\n') {
       lineEnd = i;
-    } else if (lineLength >= maxWidth) {
+    } else if (full) {
       if (lastSpace != -1 && lastSpace > lineStart) {
         lineEnd = lastSpace;
         i = lastSpace + 1;
@@ -368,15 +549,11 @@ void wrap_text(const char * text, char wrapped[][INPUT_BUFFER_SIZE], int * wrapp
 }
 
 bool gui_is_point_in_text_area(int mouseX, int mouseY, int lineCount) {
-  int textAreaLeft = 10;
-
-  int windowWidth, windowHeight;
-  gui_get_window_size( & windowWidth, & windowHeight);
-
-  int textAreaRight = windowWidth - 10;
-  int textAreaTop = 10;
-  int lineHeight = FONT_SIZE + 4;
-  int textAreaBottom = 10 + (lineCount + 1) * lineHeight;
+  int textAreaLeft = gFocusViewport.x + PANE_PADDING;
+  int textAreaRight = gFocusViewport.x + gFocusViewport.w - PANE_PADDING;
+  int textAreaTop = gFocusViewport.y;
+  int lineHeight = gui_line_height();
+  int textAreaBottom = gFocusViewport.y + (lineCount + 1) * lineHeight;
 
   return (mouseX >= textAreaLeft && mouseX <= textAreaRight &&
     mouseY >= textAreaTop && mouseY <= textAreaBottom);
@@ -394,224 +571,454 @@ void gui_update_cursor(int mouseX, int mouseY, int lineCount) {
   }
 }
 
-void gui_render(const char * prompt,
-  const char * inputBuffer, char output[][INPUT_BUFFER_SIZE], int lineCount, int cursorPos, TextSelection * selection) {
-  if (!gRenderer || !gFont) return;
+// Watch panel rows rasterized once per change; slot WATCH_MAX_LINES is the title
+static SDL_Texture * gWatchRows[WATCH_MAX_LINES + 1];
+static Uint32 gWatchVersions[WATCH_MAX_LINES + 1];
+static int gWatchWidth = 0;
+static int gWatchHeight = 0;
 
-  SDL_SetRenderDrawColor(gRenderer, 0, 0, 0, 255);
-  SDL_RenderClear(gRenderer);
+static void watch_rows_cleanup(void) {
+  for (int i = 0; i <= WATCH_MAX_LINES; i++) {
+    if (gWatchRows[i]) SDL_DestroyTexture(gWatchRows[i]);
+    gWatchRows[i] = NULL;
+  }
+}
 
-  // Render background image if available
-  if (gBackgroundTexture) {
-    int windowWidth, windowHeight;
-    gui_get_window_size( & windowWidth, & windowHeight);
+// Redraws a cached row only when its text changed since it was last rasterized
+static void render_watch_row(int slot, const char * text, Uint32 version, int x, int y, SDL_Color fg, SDL_Color bg) {
+  if (!SDL_RenderTargetSupported(gRenderer)) {
+    render_text_colored(text, x, y, fg, bg);
+    return;
+  }
 
-    SDL_Rect backgroundRect = {
-      0,
-      0,
-      windowWidth,
-      windowHeight
-    };
+  if (!gWatchRows[slot]) {
+    gWatchRows[slot] = SDL_CreateTexture(gRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET,
+      gWatchWidth, gWatchHeight);
+    if (!gWatchRows[slot]) {
+      render_text_colored(text, x, y, fg, bg);
+      return;
+    }
+    SDL_SetTextureBlendMode(gWatchRows[slot], SDL_BLENDMODE_BLEND);
+    gWatchVersions[slot] = version - 1;
+  }
 
-    // Set opacity
-    Uint8 alpha = (Uint8)(gBackgroundOpacity * 255);
-    SDL_SetTextureAlphaMod(gBackgroundTexture, alpha);
+  if (gWatchVersions[slot] != version) {
+    SDL_Texture * previousTarget = SDL_GetRenderTarget(gRenderer);
+    SDL_SetRenderTarget(gRenderer, gWatchRows[slot]);
+    SDL_SetRenderDrawColor(gRenderer, 0, 0, 0, 0);
+    SDL_RenderClear(gRenderer);
+    render_text_colored(text, 0, 0, fg, bg);
+    SDL_SetRenderTarget(gRenderer, previousTarget);
+    gWatchVersions[slot] = version;
+  }
 
-    SDL_RenderCopy(gRenderer, gBackgroundTexture, NULL, & backgroundRect);
+  SDL_Rect dest = {
+    x,
+    y,
+    gWatchWidth,
+    gWatchHeight
+  };
+  SDL_RenderCopy(gRenderer, gWatchRows[slot], NULL, & dest);
+}
+
+// Rows of the watch panel shown above maxVisibleLines of output, or -1 when there is none
+static int watch_panel_rows(const WatchPanel * panel, int maxVisibleLines) {
+  if (!watch_panel_active(panel) || maxVisibleLines <= 2) return -1;
+  int rows = watch_panel_line_count(panel);
+  return rows > maxVisibleLines / 2 - 1 ? maxVisibleLines / 2 - 1 : rows;
+}
+
+// Draws the title, rows and separator of the watch panel at the top of a pane, width wide
+static void render_watch_panel(const WatchPanel * panel, int rows, int x, int y, int width, int lineHeight) {
+  SDL_Color fg = {
+    NORMAL_COLOR_R,
+    NORMAL_COLOR_G,
+    NORMAL_COLOR_B,
+    255
+  };
+  SDL_Color bg = {
+    0,
+    0,
+    0,
+    255
+  };
+
+  // Row textures are sized to the pane; a resize throws them away
+  if (width < 1) width = 1;
+  if (width != gWatchWidth || lineHeight != gWatchHeight) {
+    watch_rows_cleanup();
+    gWatchWidth = width;
+    gWatchHeight = lineHeight;
   }
 
-  Uint32 now = SDL_GetTicks();
-  if (now - lastCursorToggle >= 500) {
-    cursorVisible = !cursorVisible;
-    lastCursorToggle = now;
+  Uint32 version;
+  const char * title = watch_panel_line(panel, -1, & version);
+  render_watch_row(WATCH_MAX_LINES, title, version, x, y, (SDL_Color) {
+    255,
+    215,
+    0,
+    255
+  }, bg);
+  y += lineHeight;
+
+  for (int i = 0; i < rows; i++) {
+    const char * text = watch_panel_line(panel, i, & version);
+    render_watch_row(i, text, version, x, y, fg, bg);
+    y += lineHeight;
   }
 
-  int windowWidth, windowHeight;
-  gui_get_window_size( & windowWidth, & windowHeight);
+  // Separator between the panel and the scrolling output
+  SDL_SetRenderDrawColor(gRenderer, 255, 215, 0, 255);
+  SDL_RenderDrawLine(gRenderer, x, y + lineHeight / 2, x + width, y + lineHeight / 2);
+}
 
-  int y = 10;
-  int charWidth = gui_get_char_width();
-  int maxWidth = get_text_width_in_chars();
+// Draws the pager's visible rows and status line in place of the output
+static void render_pager(int y, int lineHeight, int maxVisibleLines, int windowHeight, int maxWidth) {
+  SDL_Color fg = {
+    NORMAL_COLOR_R,
+    NORMAL_COLOR_G,
+    NORMAL_COLOR_B,
+    255
+  };
+  SDL_Color bg = {
+    0,
+    0,
+    0,
+    255
+  };
 
-  // Render title
-  render_centered_title(TITLE_TEXT, y);
+  PagerRow rows[PAGER_MAX_ROWS];
+  if (maxVisibleLines > PAGER_MAX_ROWS) maxVisibleLines = PAGER_MAX_ROWS;
+  pager_update(maxVisibleLines);
+  int rowCount = pager_rows(rows, maxVisibleLines);
+
+  // Mouse selection does not apply to paged text
+  gVisibleLayout = NULL;
+
+  const char * query = pager_query();
+  int queryLength = query ? (int) strlen(query) : 0;
+
+  for (int r = 0; r < rowCount; r++) {
+    char segment[INPUT_BUFFER_SIZE];
+    int length = utf8_clip(rows[r].text, rows[r].length, maxWidth);
+    memcpy(segment, rows[r].text, length);
+    segment[length] = '\0';
+
+    render_text_colored(segment, 10, y, fg, bg);
+
+    // Highlight every match of the last search on this row
+    if (query) {
+      Uint32 version = metrics_text_version(segment);
+      for (const char * match = strstr(segment, query); match; match = strstr(match + queryLength, query)) {
+        int start = (int)(match - segment);
+        int highlightX = 10 + metrics_offset_to_x(segment, version, start);
+        int highlightWidth = metrics_offset_to_x(segment, version, start + queryLength) - (highlightX - 10);
+        render_selection_highlight(highlightX, y, highlightWidth, gFontSize);
+      }
+    }
 
-  int titleHeight = TITLE_FONT_SIZE + 10;
-  y += titleHeight;
+    y += lineHeight;
+  }
 
-  int lineHeight = FONT_SIZE + 4;
-  int availableHeight = windowHeight - y - (lineHeight * 2);
-  int maxVisibleLines = availableHeight / lineHeight;
+  int statusY = windowHeight - (lineHeight * 2);
+  if (statusY < y) statusY = y;
+  render_text_colored(pager_status(), 10, statusY, (SDL_Color) {
+    255,
+    215,
+    0,
+    255
+  }, bg);
+}
 
-  int startDisplayLine = 0;
-  int actualDisplayLineCount = 0;
-
-  // Count total display lines
-  int totalDisplayLines = 0;
-  for (int i = 0; i < lineCount && i < MAX_LINES; i++) {
-    if (wordWrapEnabled) {
-      char wrappedLines[MAX_LINES][INPUT_BUFFER_SIZE];
-      int wrappedCount = 0;
-      wrap_text(output[i], wrappedLines, & wrappedCount, maxWidth);
-      totalDisplayLines += wrappedCount;
-    } else {
-      totalDisplayLines++;
+// Draws the ranked history candidates, with the matched characters coloured, and the search line
+static void render_histsearch(int y, int lineHeight, int maxVisibleLines, int windowWidth, int windowHeight, int maxWidth) {
+  SDL_Color fg = {
+    NORMAL_COLOR_R,
+    NORMAL_COLOR_G,
+    NORMAL_COLOR_B,
+    255
+  };
+  SDL_Color bg = {
+    0,
+    0,
+    0,
+    255
+  };
+
+  histsearch_update();
+
+  HistSearchRow rows[HISTSEARCH_MAX_ROWS];
+  int rowCount = histsearch_rows(rows, maxVisibleLines < HISTSEARCH_MAX_ROWS ? maxVisibleLines : HISTSEARCH_MAX_ROWS);
+  gVisibleLayout = NULL;
+
+  for (int r = 0; r < rowCount; r++) {
+    if (rows[r].selected) render_selection_highlight(5, y, windowWidth - 10, gFontSize);
+
+    // Matched characters are wrapped in colour sequences and drawn by the normal text path
+    char line[INPUT_BUFFER_SIZE];
+    int used = snprintf(line, sizeof(line), "%s", rows[r].selected ? "> " : "  ");
+    int match = 0;
+    int visible = utf8_clip(rows[r].text, rows[r].length, maxWidth - 2);
+    for (int i = 0; i < visible && used < (int) sizeof(line) - 16; i++) {
+      bool matched = match < rows[r].matchCount && rows[r].matches[match] == i;
+      if (matched) {
+        used += snprintf(line + used, sizeof(line) - used, "\033[33m%c\033[0m", rows[r].text[i]);
+        match++;
+      } else {
+        line[used++] = rows[r].text[i];
+      }
     }
+    line[used] = '\0';
+
+    render_text_colored(line, 10, y, fg, bg);
+    y += lineHeight;
   }
 
-  if (totalDisplayLines > maxVisibleLines) {
-    startDisplayLine = totalDisplayLines - maxVisibleLines;
+  int statusY = windowHeight - (lineHeight * 2);
+  if (statusY < y) statusY = y;
+  render_text_colored(histsearch_status(), 10, statusY, (SDL_Color) {
+    255,
+    215,
+    0,
+    255
+  }, bg);
+}
+
+// Labels of the open tabs under the title, shown once there is more than one; returns the y below them
+static int render_tab_strip(int y, int lineHeight) {
+  int count = session_count();
+  if (count < 2) return y;
+
+  SDL_Color fg = {
+    NORMAL_COLOR_R,
+    NORMAL_COLOR_G,
+    NORMAL_COLOR_B,
+    255
+  };
+  SDL_Color current = {
+    255,
+    215,
+    0,
+    255
+  };
+  SDL_Color bg = {
+    0,
+    0,
+    0,
+    255
+  };
+
+  int x = 10;
+  for (int i = 0; i < count; i++) {
+    // Labelled by the last command run in the tab; '*' marks output not seen yet
+    const char * title = session_title(i);
+    if (!title[0]) title = "shell";
+    int length = utf8_clip(title, (int) strlen(title), SESSION_TAB_COLUMNS);
+    char label[SHELL_TITLE_LENGTH + 16];
+    snprintf(label, sizeof(label), " %d:%.*s%s ", i + 1, length, title, session_unseen(i) ? "*" : "");
+
+    render_text_colored(label, x, y, i == session_active_index() ? current : fg, bg);
+    int width = 0;
+    TTF_SizeUTF8(gFont, label, & width, NULL);
+    x += width + 10;
+  }
+  return y + lineHeight;
+}
+
+static Uint32 damage_add(Uint32 hash, const void * data, size_t length) {
+  const unsigned char * bytes = (const unsigned char * ) data;
+  for (size_t i = 0; i < length; i++) hash = (hash ^ bytes[i]) * 16777619u;
+  return hash;
+}
+
+// Starts drawing a pane. Returns false while its texture still shows damage; otherwise the
+// pane is drawn at origin, into its texture or, without render targets, straight to the window
+static bool pane_begin(const PaneView * view, Uint32 damage, SDL_Point * origin) {
+  PaneTarget * target = & gPaneTargets[view -> id];
+  int width = view -> viewport.w > 1 ? view -> viewport.w : 1;
+  int height = view -> viewport.h > 1 ? view -> viewport.h : 1;
+
+  if (target -> texture && (target -> width != width || target -> height != height)) {
+    SDL_DestroyTexture(target -> texture);
+    target -> texture = NULL;
+  }
+  if (!target -> texture && SDL_RenderTargetSupported(gRenderer)) {
+    target -> texture = SDL_CreateTexture(gRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, width, height);
+    if (target -> texture) {
+      SDL_SetTextureBlendMode(target -> texture, SDL_BLENDMODE_BLEND);
+      target -> width = width;
+      target -> height = height;
+      target -> damage = damage + 1;
+    }
+  }
+
+  if (!target -> texture) {
+    origin -> x = view -> viewport.x;
+    origin -> y = view -> viewport.y;
+    SDL_RenderSetClipRect(gRenderer, & view -> viewport);
+    return true;
+  }
+
+  origin -> x = 0;
+  origin -> y = 0;
+  if (target -> damage == damage) return false;
+  target -> damage = damage;
+  SDL_SetRenderTarget(gRenderer, target -> texture);
+  SDL_SetRenderDrawColor(gRenderer, 0, 0, 0, 0);
+  SDL_RenderClear(gRenderer);
+  return true;
+}
+
+static void pane_end(const PaneView * view) {
+  PaneTarget * target = & gPaneTargets[view -> id];
+  if (!target -> texture) {
+    SDL_RenderSetClipRect(gRenderer, NULL);
+    return;
+  }
+  if (SDL_GetRenderTarget(gRenderer) == target -> texture) SDL_SetRenderTarget(gRenderer, NULL);
+  SDL_RenderCopy(gRenderer, target -> texture, NULL, & view -> viewport);
+}
+
+// The pane with the active tab: its output, laid out to the pane width, and the input line
+static void render_focused_pane(const PaneView * view, const char * prompt, const char * inputBuffer,
+  char output[][INPUT_BUFFER_SIZE], int lineCount, int cursorPos, TextSelection * selection, int lineHeight) {
+  SDL_Rect viewport = view -> viewport;
+  int maxVisibleLines = (viewport.h - lineHeight * 2) / lineHeight;
+  if (maxVisibleLines < 0) maxVisibleLines = 0;
+  gFocusViewport = viewport;
+
+  // A running watch keeps its panel at the top of the pane and the output scrolls below it
+  const WatchPanel * watch = shell_watch_panel();
+  int watchRows = watch_panel_rows(watch, maxVisibleLines);
+  int watchHeight = watchRows >= 0 ? (watchRows + 2) * lineHeight : 0;
+  if (watchRows >= 0) maxVisibleLines -= watchRows + 2;
+
+  // Display rows come from the cached layout; reflow happens off the UI thread
+  int wrapWidth = wordWrapEnabled ? get_text_width_in_chars() : 0;
+  const Layout * layout = shell_flooding() ?
+    layout_update_visible(output, lineCount, wrapWidth, maxVisibleLines) :
+    layout_update(output, lineCount, wrapWidth, maxVisibleLines);
+  Uint32 generation = layout_generation();
+
+  int startRow = 0;
+  if (layout && layout -> rowCount > maxVisibleLines) {
+    startRow = layout -> rowCount - maxVisibleLines;
+  }
+
+  gVisibleLayout = layout;
+  gFirstVisibleRow = startRow;
+  gOutputTop = viewport.y + watchHeight;
+
+  int inputY = viewport.h - lineHeight * 2;
+  int rowsHeight = watchHeight + (layout ? (layout -> rowCount - startRow) * lineHeight : 0);
+  if (inputY < rowsHeight) inputY = rowsHeight;
+  gInputTop = viewport.y + inputY;
+
+  // Everything the drawing below reads goes into the hash
+  Uint32 damage = damage_add(2166136261u, & viewport, sizeof(viewport));
+  damage = damage_add(damage, & gFontSize, sizeof(gFontSize));
+  for (int r = startRow; layout && r < layout -> rowCount; r++) {
+    const LayoutRow * row = & layout -> rows[r];
+    damage = damage_add(damage, row, sizeof( * row));
+    if (r == startRow || layout -> rows[r - 1].line != row -> line)
+      damage = damage_add(damage, output[row -> line], strlen(output[row -> line]));
+  }
+  if (prompt) damage = damage_add(damage, prompt, strlen(prompt));
+  if (inputBuffer) damage = damage_add(damage, inputBuffer, strlen(inputBuffer));
+  int state[3] = {
+    cursorPos,
+    cursorVisible,
+    lineCount
+  };
+  damage = damage_add(damage, state, sizeof(state));
+  if (selection && selection -> active) damage = damage_add(damage, selection, sizeof( * selection));
+  for (int i = -1; i < watchRows; i++) {
+    Uint32 version;
+    watch_panel_line(watch, i, & version);
+    damage = damage_add(damage, & version, sizeof(version));
+  }
+
+  SDL_Point origin;
+  if (!pane_begin(view, damage, & origin)) {
+    pane_end(view);
+    return;
+  }
+
+  SDL_Color bg = {
+    0,
+    0,
+    0,
+    255
+  };
+  int left = origin.x + PANE_PADDING;
+  int y = origin.y;
+
+  if (watchRows >= 0) {
+    render_watch_panel(watch, watchRows, left, y, viewport.w - PANE_PADDING * 2, lineHeight);
+    y += watchHeight;
   }
 
   // Render output lines
-  int currentDisplayLine = 0;
+  for (int r = startRow; layout && r < layout -> rowCount; r++) {
+    const LayoutRow * row = & layout -> rows[r];
+    int i = row -> line;
 
-  for (int i = 0; i < lineCount && i < MAX_LINES; i++) {
-    SDL_Color fg = {
-      255,
-      255,
-      255,
-      255
-    };
-    SDL_Color bg = {
-      0,
-      0,
-      0,
-      255
-    };
+    char segment[INPUT_BUFFER_SIZE + 16];
+    int prefix = row -> start > 0 ? ansi_active_prefix(output[i], row -> start, segment, 16) : 0;
+    memcpy(segment + prefix, output[i] + row -> start, row -> length);
+    segment[prefix + row -> length] = '\0';
 
-    if (wordWrapEnabled) {
-      char wrappedLines[MAX_LINES][INPUT_BUFFER_SIZE];
-      int wrappedCount = 0;
-      wrap_text(output[i], wrappedLines, & wrappedCount, maxWidth);
-
-      for (int j = 0; j < wrappedCount; j++) {
-        if (currentDisplayLine >= startDisplayLine && actualDisplayLineCount < maxVisibleLines) {
-          render_text_with_command_colors(wrappedLines[j], 10, y, bg);
-
-          // Handle selection highlighting for wrapped lines
-          if (selection && selection -> active) {
-            int startLine = selection -> startLine;
-            int endLine = selection -> endLine;
-            int startChar = selection -> startChar;
-            int endChar = selection -> endChar;
-
-            if (startLine > endLine || (startLine == endLine && startChar > endChar)) {
-              int tmpLine = startLine, tmpChar = startChar;
-              startLine = endLine;
-              startChar = endChar;
-              endLine = tmpLine;
-              endChar = tmpChar;
-            }
-
-            if (i >= startLine && i <= endLine) {
-              int selStart = (i == startLine) ? startChar : 0;
-              int selEnd = (i == endLine) ? endChar : (int) strlen(output[i]);
-
-              int segmentStart = j * maxWidth;
-              int segmentEnd = segmentStart + strlen(wrappedLines[j]);
-
-              if (selStart < segmentEnd && selEnd > segmentStart) {
-                int highlightStart = (selStart > segmentStart) ? selStart - segmentStart : 0;
-                int highlightEnd = (selEnd < segmentEnd) ? selEnd - segmentStart : strlen(wrappedLines[j]);
-
-                if (highlightStart < highlightEnd) {
-                  int highlightX = 10 + highlightStart * charWidth;
-                  int highlightWidth = (highlightEnd - highlightStart) * charWidth;
-                  render_selection_highlight(highlightX, y, highlightWidth, FONT_SIZE);
-                }
-              }
-            }
-          }
-
-          y += lineHeight;
-          actualDisplayLineCount++;
-        }
-        currentDisplayLine++;
-      }
-    } else {
-      if (currentDisplayLine >= startDisplayLine && actualDisplayLineCount < maxVisibleLines) {
-        render_text_with_command_colors(output[i], 10, y, bg);
-
-        if (selection && selection -> active) {
-          int startLine = selection -> startLine;
-          int endLine = selection -> endLine;
-          int startChar = selection -> startChar;
-          int endChar = selection -> endChar;
-
-          if (startLine > endLine || (startLine == endLine && startChar > endChar)) {
-            int tmpLine = startLine, tmpChar = startChar;
-            startLine = endLine;
-            startChar = endChar;
-            endLine = tmpLine;
-            endChar = tmpChar;
-          }
-
-          if (i >= startLine && i <= endLine) {
-            int selStart = (i == startLine) ? startChar : 0;
-            int selEnd = (i == endLine) ? endChar : (int) strlen(output[i]);
-
-            int lineLen = (int) strlen(output[i]);
-            if (selStart > lineLen) selStart = lineLen;
-            if (selEnd > lineLen) selEnd = lineLen;
-
-            if (selStart < selEnd) {
-              int highlightX = 10 + selStart * charWidth;
-              int highlightWidth = (selEnd - selStart) * charWidth;
-              render_selection_highlight(highlightX, y, highlightWidth, FONT_SIZE);
-            }
-          }
+    render_text_with_command_colors(segment, left, y, bg);
+
+    // Selection is a source range; intersect it with this row's byte span
+    if (selection && selection -> active) {
+      int startLine, startChar, endLine, endChar;
+      gui_selection_bounds(selection, & startLine, & startChar, & endLine, & endChar);
+
+      if (i >= startLine && i <= endLine) {
+        int rowEnd = row -> start + row -> length;
+        int selStart = (i == startLine) ? startChar : row -> start;
+        int selEnd = (i == endLine) ? endChar : rowEnd;
+        if (selStart < row -> start) selStart = row -> start;
+        if (selEnd > rowEnd) selEnd = rowEnd;
+
+        if (selStart < selEnd) {
+          int rowX = metrics_offset_to_x(output[i], generation, row -> start);
+          int highlightX = left + metrics_offset_to_x(output[i], generation, selStart) - rowX;
+          int highlightWidth = metrics_offset_to_x(output[i], generation, selEnd) - rowX - (highlightX - left);
+          render_selection_highlight(highlightX, y, highlightWidth, gFontSize);
         }
-        y += lineHeight;
-        actualDisplayLineCount++;
       }
-      currentDisplayLine++;
     }
+
+    y += lineHeight;
   }
 
   // Render input line
-  int inputY = windowHeight - (lineHeight * 2);
-  if (inputY < y) inputY = y;
+  int inputX = origin.x + PANE_INPUT_INDENT;
+  inputY += origin.y;
 
   if (prompt)
-    render_text_colored(prompt, 10, inputY, (SDL_Color) {
+    render_text_colored(prompt, left, inputY, (SDL_Color) {
       255,
       255,
       255,
       255
-    }, (SDL_Color) {
-      0,
-      0,
-      0,
-      255
-    });
+    }, bg);
+
+  Uint32 inputVersion = metrics_text_version(inputBuffer);
 
   if (inputBuffer) {
-    render_text_colored(inputBuffer, 80, inputY, (SDL_Color) {
+    render_text_colored(inputBuffer, inputX, inputY, (SDL_Color) {
       255,
       255,
       255,
       255
-    }, (SDL_Color) {
-      0,
-      0,
-      0,
-      255
-    });
+    }, bg);
 
     if (selection && selection -> active) {
-      int startLine = selection -> startLine;
-      int endLine = selection -> endLine;
-      int startChar = selection -> startChar;
-      int endChar = selection -> endChar;
-
-      if (startLine > endLine || (startLine == endLine && startChar > endChar)) {
-        int tmpLine = startLine, tmpChar = startChar;
-        startLine = endLine;
-        startChar = endChar;
-        endLine = tmpLine;
-        endChar = tmpChar;
-      }
+      int startLine, startChar, endLine, endChar;
+      gui_selection_bounds(selection, & startLine, & startChar, & endLine, & endChar);
 
       if (lineCount >= startLine && lineCount <= endLine) {
         int selStart = (lineCount == startLine) ? startChar : 0;
@@ -621,9 +1028,9 @@ void gui_render(const char * prompt,
         if (selEnd > lineLen) selEnd = lineLen;
 
         if (selStart < selEnd) {
-          int highlightX = 80 + selStart * charWidth;
-          int highlightWidth = (selEnd - selStart) * charWidth;
-          render_selection_highlight(highlightX, inputY, highlightWidth, FONT_SIZE);
+          int highlightX = inputX + metrics_offset_to_x(inputBuffer, inputVersion, selStart);
+          int highlightWidth = metrics_offset_to_x(inputBuffer, inputVersion, selEnd) - (highlightX - inputX);
+          render_selection_highlight(highlightX, inputY, highlightWidth, gFontSize);
         }
       }
     }
@@ -631,25 +1038,173 @@ void gui_render(const char * prompt,
 
   // Render cursor
   if (cursorPos >= 0) {
-    int cursorX = 80 + cursorPos * charWidth;
+    int cursorX = inputX + metrics_offset_to_x(inputBuffer, inputVersion, cursorPos);
     render_cursor(cursorX, inputY);
   }
 
-  SDL_RenderPresent(gRenderer);
+  pane_end(view);
 }
 
-void gui_handle_mouse_event(SDL_Event * e, char output[][INPUT_BUFFER_SIZE],
-  const char * inputBuffer, int lineCount, TextSelection * selection) {
-  if (!selection || !e) return;
+// A pane with a background tab: the newest of its lines, unwrapped, and a label where the input line would be
+static void render_background_pane(const PaneView * view, int lineHeight) {
+  SDL_Rect viewport = view -> viewport;
+  int rows = (viewport.h - lineHeight * 2) / lineHeight;
+  int lines = session_line_count(view -> session);
+  int first = lines > rows ? lines - rows : 0;
+  session_mark_seen(view -> session);
+
+  char label[SHELL_TITLE_LENGTH + 16];
+  snprintf(label, sizeof(label), "%d: %s", view -> session + 1, session_title(view -> session));
+  int state[2] = {
+    session_id(view -> session),
+    (int) session_version(view -> session)
+  };
+  Uint32 damage = damage_add(2166136261u, & viewport, sizeof(viewport));
+  damage = damage_add(damage, & gFontSize, sizeof(gFontSize));
+  damage = damage_add(damage, state, sizeof(state));
+  damage = damage_add(damage, label, strlen(label));
 
-  int charWidth = gui_get_char_width();
-  int lineHeight = FONT_SIZE + 4;
+  SDL_Point origin;
+  if (pane_begin(view, damage, & origin)) {
+    SDL_Color bg = {
+      0,
+      0,
+      0,
+      255
+    };
+    int y = origin.y;
+    for (int i = first; i < lines; i++) {
+      render_text_with_command_colors(session_line(view -> session, i), origin.x + PANE_PADDING, y, bg);
+      y += lineHeight;
+    }
+    render_text_colored(label, origin.x + PANE_PADDING, origin.y + viewport.h - lineHeight * 2, (SDL_Color) {
+      128,
+      128,
+      128,
+      255
+    }, bg);
+  }
+  pane_end(view);
+}
+
+// Frames every pane once the window is split, the focused one highlighted
+static void render_pane_outlines(const PaneView * views, int count) {
+  if (count < 2) return;
+
+  for (int i = 0; i < count; i++) {
+    SDL_Rect frame = {
+      views[i].viewport.x - 2,
+      views[i].viewport.y - 2,
+      views[i].viewport.w + 4,
+      views[i].viewport.h + 4
+    };
+    if (views[i].focused) {
+      SDL_SetRenderDrawColor(gRenderer, 255, 215, 0, 255);
+    } else {
+      SDL_SetRenderDrawColor(gRenderer, 80, 80, 80, 255);
+    }
+    SDL_RenderDrawRect(gRenderer, & frame);
+  }
+}
+
+// Drops every cached target texture, e.g. after the renderer lost their contents
+void gui_reset_targets(void) {
+  for (int i = 0; i < PANE_NODES; i++) {
+    if (gPaneTargets[i].texture) SDL_DestroyTexture(gPaneTargets[i].texture);
+    gPaneTargets[i].texture = NULL;
+  }
+  watch_rows_cleanup();
+}
+
+void gui_render(const char * prompt,
+  const char * inputBuffer, char output[][INPUT_BUFFER_SIZE], int lineCount, int cursorPos, TextSelection * selection) {
+  if (!gRenderer || !gFont) return;
+
+  SDL_SetRenderDrawColor(gRenderer, 0, 0, 0, 255);
+  SDL_RenderClear(gRenderer);
+
+  // Render background image if available
+  if (gBackgroundTexture) {
+    int windowWidth, windowHeight;
+    gui_get_window_size( & windowWidth, & windowHeight);
+
+    SDL_Rect backgroundRect = {
+      0,
+      0,
+      windowWidth,
+      windowHeight
+    };
+
+    // Set opacity
+    Uint8 alpha = (Uint8)(gBackgroundOpacity * 255);
+    SDL_SetTextureAlphaMod(gBackgroundTexture, alpha);
+
+    SDL_RenderCopy(gRenderer, gBackgroundTexture, NULL, & backgroundRect);
+  }
+
+  Uint32 now = SDL_GetTicks();
+  if (now - lastCursorToggle >= 500) {
+    cursorVisible = !cursorVisible;
+    lastCursorToggle = now;
+  }
 
   int windowWidth, windowHeight;
   gui_get_window_size( & windowWidth, & windowHeight);
 
-  int titleOffset = TITLE_FONT_SIZE + 10;
-  int inputLineY = windowHeight - (lineHeight * 2);
+  int y = 10;
+  // The pager and history search span the window; panes lay out to their own width
+  int maxWidth = (windowWidth - PANE_PADDING * 2) / gui_get_char_width();
+
+  // Render title
+  render_centered_title(TITLE_TEXT, y);
+
+  int titleHeight = TITLE_FONT_SIZE + 10;
+  y += titleHeight;
+
+  int lineHeight = gui_line_height();
+  y = render_tab_strip(y, lineHeight);
+  int availableHeight = windowHeight - y - (lineHeight * 2);
+  int maxVisibleLines = availableHeight / lineHeight;
+
+  if (pager_active()) {
+    render_pager(y, lineHeight, maxVisibleLines, windowHeight, maxWidth);
+    SDL_RenderPresent(gRenderer);
+    return;
+  }
+
+  if (histsearch_active()) {
+    render_histsearch(y, lineHeight, maxVisibleLines, windowWidth, windowHeight, maxWidth);
+    SDL_RenderPresent(gRenderer);
+    return;
+  }
+
+  // Panes share what is left of the window; each one is cached in its own texture
+  SDL_Rect area = {
+    0,
+    y,
+    windowWidth,
+    windowHeight - y
+  };
+  PaneView views[PANE_MAX];
+  int paneCount = pane_views(area, views);
+  for (int i = 0; i < paneCount; i++) {
+    if (views[i].focused) {
+      render_focused_pane( & views[i], prompt, inputBuffer, output, lineCount, cursorPos, selection, lineHeight);
+    } else {
+      render_background_pane( & views[i], lineHeight);
+    }
+  }
+  render_pane_outlines(views, paneCount);
+
+  SDL_RenderPresent(gRenderer);
+}
+
+void gui_handle_mouse_event(SDL_Event * e, char output[][INPUT_BUFFER_SIZE],
+  const char * inputBuffer, int lineCount, TextSelection * selection) {
+  if (!selection || !e) return;
+
+  int lineHeight = gui_line_height();
+  int inputLineY = gInputTop;
 
   if (e -> type == SDL_MOUSEMOTION) {
     gui_update_cursor(e -> motion.x, e -> motion.y, lineCount);
@@ -666,27 +1221,28 @@ void gui_handle_mouse_event(SDL_Event * e, char output[][INPUT_BUFFER_SIZE],
     return;
   }
 
-  int adjustedMouseY = mouseY - titleOffset;
+  // A click in another pane only moves the focus there
+  if (e -> type == SDL_MOUSEBUTTONDOWN && pane_focus_at(mouseX, mouseY)) return;
 
-  int clickedLine, clickedChar;
+  int clickedLine = -1, clickedChar = 0;
   if (mouseY >= inputLineY && mouseY < inputLineY + lineHeight) {
     clickedLine = lineCount;
-    clickedChar = (mouseX - 80) / charWidth;
-  } else {
-    clickedLine = (adjustedMouseY - 10) / lineHeight;
-    clickedChar = (mouseX - 10) / charWidth;
-  }
-
-  int lineLen = 0;
-  if (clickedLine == lineCount) {
-    lineLen = inputBuffer ? (int) strlen(inputBuffer) : 0;
-  } else if (clickedLine >= 0 && clickedLine < lineCount) {
-    lineLen = (int) strlen(output[clickedLine]);
+    clickedChar = inputBuffer ? metrics_x_to_offset(inputBuffer, metrics_text_version(inputBuffer), mouseX - gFocusViewport.x - PANE_INPUT_INDENT) : 0;
+  } else if (gVisibleLayout && mouseY >= gOutputTop) {
+    // Map the display row under the mouse back to its source line and byte span
+    int r = gFirstVisibleRow + (mouseY - gOutputTop) / lineHeight;
+    if (r < gVisibleLayout -> rowCount) {
+      const LayoutRow * row = & gVisibleLayout -> rows[r];
+      Uint32 generation = layout_generation();
+      int rowX = metrics_offset_to_x(output[row -> line], generation, row -> start);
+
+      clickedLine = row -> line;
+      clickedChar = metrics_x_to_offset(output[row -> line], generation, rowX + mouseX - gFocusViewport.x - PANE_PADDING);
+      if (clickedChar < row -> start) clickedChar = row -> start;
+      if (clickedChar > row -> start + row -> length) clickedChar = row -> start + row -> length;
+    }
   }
 
-  if (clickedChar < 0) clickedChar = 0;
-  if (clickedChar > lineLen) clickedChar = lineLen;
-
   if (e -> type == SDL_MOUSEBUTTONDOWN && e -> button.button == SDL_BUTTON_LEFT) {
     if (clickedLine >= 0 && clickedLine <= lineCount) {
       selection -> active = 1;
@@ -707,53 +1263,98 @@ void gui_handle_mouse_event(SDL_Event * e, char output[][INPUT_BUFFER_SIZE],
   }
 }
 
-void gui_get_selected_text(char output[][INPUT_BUFFER_SIZE],
-  const char * inputBuffer, int lineCount, TextSelection * selection, char * buffer, int bufferSize) {
-  if (!selection || !selection -> active || !buffer || bufferSize <= 0) {
-    if (buffer) buffer[0] = '\0';
-    return;
-  }
+// Text of line i and the byte span [from, to) of it covered by the selection
+static const char * gui_selection_span(char output[][INPUT_BUFFER_SIZE], const char * inputBuffer, int lineCount,
+  int i, int startLine, int startChar, int endLine, int endChar, int * from, int * to) {
+  const char * lineText = (i == lineCount) ? (inputBuffer ? inputBuffer : "") : output[i];
+  int lineLen = (int) strnlen(lineText, INPUT_BUFFER_SIZE - 1);
 
-  buffer[0] = '\0';
-  int pos = 0;
+  * from = (i == startLine) ? startChar : 0;
+  * to = (i == endLine) ? endChar : lineLen;
+  if ( * from > lineLen) * from = lineLen;
+  if ( * to > lineLen) * to = lineLen;
+  if ( * from < 0) * from = 0;
+  if ( * to < * from) * to = * from;
 
-  int startLine = selection -> startLine;
-  int startChar = selection -> startChar;
-  int endLine = selection -> endLine;
-  int endChar = selection -> endChar;
+  return lineText;
+}
 
-  if (startLine > endLine || (startLine == endLine && startChar > endChar)) {
-    int tempLine = startLine;
-    int tempChar = startChar;
-    startLine = endLine;
-    startChar = endChar;
-    endLine = tempLine;
-    endChar = tempChar;
-  }
+// Exact number of bytes (without the terminator) the selection copies to unstripped
+size_t gui_get_selected_text_length(char output[][INPUT_BUFFER_SIZE],
+  const char * inputBuffer, int lineCount, TextSelection * selection) {
+  if (!selection || !selection -> active) return 0;
+
+  int startLine, startChar, endLine, endChar;
+  gui_selection_bounds(selection, & startLine, & startChar, & endLine, & endChar);
+  if (startLine < 0) startLine = 0;
 
+  size_t length = 0;
   for (int i = startLine; i <= endLine && i <= lineCount; i++) {
-    const char * lineText = (i == lineCount) ? (inputBuffer ? inputBuffer : "") : output[i];
-    int copyStartChar = (i == startLine) ? startChar : 0;
-    int copyEndChar = (i == endLine) ? endChar : (int) strlen(lineText);
-
-    int lineLen = (int) strlen(lineText);
-    if (copyStartChar > lineLen) copyStartChar = lineLen;
-    if (copyEndChar > lineLen) copyEndChar = lineLen;
-
-    if (copyStartChar < copyEndChar) {
-      int copyLen = copyEndChar - copyStartChar;
-      if (pos + copyLen < bufferSize - 1) {
-        strncpy(buffer + pos, lineText + copyStartChar, copyLen);
-        pos += copyLen;
+    int from, to;
+    gui_selection_span(output, inputBuffer, lineCount, i, startLine, startChar, endLine, endChar, & from, & to);
+    length += (size_t)(to - from);
+    if (i < endLine) length++;
+  }
+  return length;
+}
+
+// Writes the selection into dest in one pass, optionally dropping ANSI escape sequences
+size_t gui_write_selected_text(char output[][INPUT_BUFFER_SIZE],
+  const char * inputBuffer, int lineCount, TextSelection * selection, char * dest, size_t destSize, bool stripAnsi) {
+  if (!dest || destSize == 0) return 0;
+  dest[0] = '\0';
+  if (!selection || !selection -> active) return 0;
+
+  int startLine, startChar, endLine, endChar;
+  gui_selection_bounds(selection, & startLine, & startChar, & endLine, & endChar);
+  if (startLine < 0) startLine = 0;
+
+  size_t pos = 0;
+  size_t limit = destSize - 1;
+
+  for (int i = startLine; i <= endLine && i <= lineCount && pos < limit; i++) {
+    int from, to;
+    const char * lineText = gui_selection_span(output, inputBuffer, lineCount, i,
+      startLine, startChar, endLine, endChar, & from, & to);
+
+    const char * p = lineText + from;
+    const char * stop = lineText + to;
+    while (p < stop && pos < limit) {
+      const char * run = stop;
+      if (stripAnsi) {
+        run = (const char * ) memchr(p, '\033', stop - p);
+        if (!run) run = stop;
+      }
+
+      size_t runLen = (size_t)(run - p);
+      if (runLen > limit - pos) runLen = limit - pos;
+      memcpy(dest + pos, p, runLen);
+      pos += runLen;
+      p += runLen;
+
+      if (p == run && run < stop) {
+        int escape = metrics_escape_length(run, (int)(stop - run));
+        if (escape == 0) {
+          dest[pos++] = * run;
+          escape = 1;
+        }
+        p = run + escape;
       }
     }
 
-    if (i < endLine && pos < bufferSize - 2) {
-      buffer[pos++] = '\n';
+    if (i < endLine && pos < limit) {
+      dest[pos++] = '\n';
     }
   }
 
-  buffer[pos] = '\0';
+  dest[pos] = '\0';
+  return pos;
+}
+
+void gui_get_selected_text(char output[][INPUT_BUFFER_SIZE],
+  const char * inputBuffer, int lineCount, TextSelection * selection, char * buffer, int bufferSize) {
+  if (!buffer || bufferSize <= 0) return;
+  gui_write_selected_text(output, inputBuffer, lineCount, selection, buffer, (size_t) bufferSize, false);
 }
 
 void gui_cleanup() {
@@ -766,4 +1367,6 @@ void gui_cleanup() {
     ibeamCursor = NULL;
   }
   gui_cleanup_background();
+  gui_reset_targets();
+  metrics_cleanup();
 }
\ No newline at end of file
@@ -0,0 +1,286 @@
+#include <string.h>
+
+#include <stdlib.h>
+
+#include <stdio.h>
+
+#include <stdint.h>
+
+#include <stdbool.h>
+
+#include <windows.h>
+
+#include "config.h"
+
+#include "history.h"
+
+// One history line; text points into the file mapping or a session copy
+typedef struct {
+  const char * text;
+  int length;
+  uint64_t hash;
+  bool hidden; // A newer identical entry exists
+} HistoryEntry;
+
+typedef struct {
+  HistoryEntry * items;
+  int count;
+  int capacity;
+} HistoryList;
+
+static HANDLE gHistoryFile = INVALID_HANDLE_VALUE;
+static HANDLE gHistoryMapping = NULL;
+static const char * gMapped = NULL; // History as it was on disk at startup
+static size_t gScanPos = 0;         // Mapped bytes before this are not indexed yet
+static size_t gMappedSize = 0;
+
+static HistoryList gSession; // Commands entered this run, oldest first
+static HistoryList gIndexed; // Mapped entries indexed so far, newest first
+
+// Open-addressing set of entry ids (session i -> i + 1, indexed i -> -(i + 1))
+static int * gSeen = NULL;
+static int gSeenCapacity = 0;
+static int gSeenCount = 0;
+
+static uint64_t history_hash(const char * text, int length) {
+  uint64_t hash = 14695981039346656037ull;
+  for (int i = 0; i < length; i++) {
+    hash = (hash ^ (unsigned char) text[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+static HistoryEntry * history_entry_by_id(int id) {
+  return id > 0 ? & gSession.items[id - 1] : & gIndexed.items[-id - 1];
+}
+
+static bool history_list_push(HistoryList * list, const char * text, int length, uint64_t hash) {
+  if (list -> count == list -> capacity) {
+    int capacity = list -> capacity ? list -> capacity * 2 : 256;
+    HistoryEntry * grown = (HistoryEntry * ) realloc(list -> items, capacity * sizeof(HistoryEntry));
+    if (!grown) return false;
+    list -> items = grown;
+    list -> capacity = capacity;
+  }
+  HistoryEntry * entry = & list -> items[list -> count++];
+  entry -> text = text;
+  entry -> length = length;
+  entry -> hash = hash;
+  entry -> hidden = false;
+  return true;
+}
+
+static int * history_seen_slot(const char * text, int length, uint64_t hash) {
+  int mask = gSeenCapacity - 1;
+  for (int i = (int)(hash & mask);; i = (i + 1) & mask) {
+    if (gSeen[i] == 0) return & gSeen[i];
+    const HistoryEntry * other = history_entry_by_id(gSeen[i]);
+    if (other -> hash == hash && other -> length == length && memcmp(other -> text, text, length) == 0)
+      return & gSeen[i];
+  }
+}
+
+static bool history_seen_grow(void) {
+  if ((gSeenCount + 1) * 2 <= gSeenCapacity) return true;
+
+  int * old = gSeen;
+  int oldCapacity = gSeenCapacity;
+  gSeenCapacity = oldCapacity ? oldCapacity * 2 : 1024;
+  gSeen = (int * ) calloc(gSeenCapacity, sizeof(int));
+  if (!gSeen) {
+    gSeen = old;
+    gSeenCapacity = oldCapacity;
+    return false;
+  }
+
+  for (int i = 0; i < oldCapacity; i++) {
+    if (old[i] == 0) continue;
+    const HistoryEntry * entry = history_entry_by_id(old[i]);
+    * history_seen_slot(entry -> text, entry -> length, entry -> hash) = old[i];
+  }
+  free(old);
+  return true;
+}
+
+// Indexes the next older line of the mapped file; false once the start is reached
+static bool history_index_next(void) {
+  while (gScanPos > 0) {
+    size_t end = gScanPos;
+    while (end > 0 && (gMapped[end - 1] == '\n' || gMapped[end - 1] == '\r')) end--;
+
+    size_t start = end;
+    while (start > 0 && gMapped[start - 1] != '\n') start--;
+    gScanPos = start;
+
+    int length = (int)(end - start);
+    if (length == 0) continue;
+    if (length >= INPUT_BUFFER_SIZE) length = INPUT_BUFFER_SIZE - 1;
+
+    // Older duplicates of something already seen are dropped from the index
+    const char * text = gMapped + start;
+    uint64_t hash = history_hash(text, length);
+    if (!history_seen_grow()) return false;
+    int * slot = history_seen_slot(text, length, hash);
+    if ( * slot != 0) continue;
+
+    if (!history_list_push( & gIndexed, text, length, hash)) return false;
+    * slot = -gIndexed.count;
+    gSeenCount++;
+    return true;
+  }
+  return false;
+}
+
+bool history_init(const char * path) {
+  if (!path) return false;
+
+  gHistoryFile = CreateFileA(path, GENERIC_READ | FILE_APPEND_DATA,
+    FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (gHistoryFile == INVALID_HANDLE_VALUE) {
+    printf("Warning: Could not open history file: %s\n", path);
+    return false;
+  }
+
+  // Map the existing history as-is; lines are only indexed when recalled
+  LARGE_INTEGER size;
+  if (GetFileSizeEx(gHistoryFile, & size) && size.QuadPart > 0) {
+    gHistoryMapping = CreateFileMappingA(gHistoryFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (gHistoryMapping) {
+      gMapped = (const char * ) MapViewOfFile(gHistoryMapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (gMapped) {
+      gMappedSize = (size_t) size.QuadPart;
+      gScanPos = gMappedSize;
+    } else {
+      printf("Warning: Could not map history file: %s\n", path);
+    }
+  }
+
+  return true;
+}
+
+// True when text is the last line of the file as mapped at startup
+static bool history_is_newest_mapped(const char * text, int length) {
+  size_t end = gMappedSize;
+  while (end > 0 && (gMapped[end - 1] == '\n' || gMapped[end - 1] == '\r')) end--;
+  size_t start = end;
+  while (start > 0 && gMapped[start - 1] != '\n') start--;
+  return end > start && end - start == (size_t) length && memcmp(gMapped + start, text, length) == 0;
+}
+
+void history_add(const char * command) {
+  if (!command) return;
+
+  int length = (int) strlen(command);
+  if (length == 0 || length >= INPUT_BUFFER_SIZE) return;
+
+  char * text = (char * ) malloc(length + 1);
+  if (!text) return;
+  memcpy(text, command, length + 1);
+
+  uint64_t hash = history_hash(text, length);
+  if (!history_seen_grow() || !history_list_push( & gSession, text, length, hash)) {
+    free(text);
+    return;
+  }
+
+  // The newest occurrence wins; an older identical entry is hidden from recall
+  int * slot = history_seen_slot(text, length, hash);
+  bool repeated = false;
+  if ( * slot != 0) {
+    HistoryEntry * older = history_entry_by_id( * slot);
+    repeated = (older == & gSession.items[gSession.count - 2]);
+    older -> hidden = true;
+  } else {
+    gSeenCount++;
+  }
+  * slot = gSession.count;
+
+  // The first command of a run follows the newest line already on disk
+  if (gSession.count == 1 && gMapped && history_is_newest_mapped(text, length)) repeated = true;
+
+  // Append-only on disk; an immediate repeat is not written again
+  if (gHistoryFile != INVALID_HANDLE_VALUE && !repeated) {
+    DWORD written;
+    WriteFile(gHistoryFile, text, (DWORD) length, & written, NULL);
+    WriteFile(gHistoryFile, "\n", 1, & written, NULL);
+  }
+}
+
+// Entry at a recall position (0 = newest), indexing the file lazily
+static HistoryEntry * history_at(int position) {
+  if (position < 0) return NULL;
+  if (position < gSession.count) return & gSession.items[gSession.count - 1 - position];
+
+  int indexed = position - gSession.count;
+  while (indexed >= gIndexed.count) {
+    if (!history_index_next()) return NULL;
+  }
+  return & gIndexed.items[indexed];
+}
+
+// Indexes up to maxLines more of the mapped file; true while older lines remain
+bool history_index_step(int maxLines) {
+  for (int i = 0; i < maxLines; i++) {
+    if (!history_index_next()) return false;
+  }
+  return gScanPos > 0;
+}
+
+// Recall positions available without further indexing
+int history_size(void) {
+  return gSession.count + gIndexed.count;
+}
+
+// True when a newer identical entry makes this position a duplicate
+bool history_hidden(int position) {
+  HistoryEntry * entry = history_at(position);
+  return !entry || entry -> hidden;
+}
+
+int history_older(int position) {
+  for (int p = position + 1;; p++) {
+    HistoryEntry * entry = history_at(p);
+    if (!entry) return -1;
+    if (!entry -> hidden) return p;
+  }
+}
+
+int history_newer(int position) {
+  for (int p = position - 1; p >= 0; p--) {
+    HistoryEntry * entry = history_at(p);
+    if (entry && !entry -> hidden) return p;
+  }
+  return -1;
+}
+
+// Returns a pointer into the history (not NUL-terminated) and its length
+const char * history_entry(int position, int * length) {
+  HistoryEntry * entry = history_at(position);
+  if (!entry) return NULL;
+  if (length) * length = entry -> length;
+  return entry -> text;
+}
+
+void history_cleanup(void) {
+  for (int i = 0; i < gSession.count; i++) {
+    free((char * ) gSession.items[i].text);
+  }
+  free(gSession.items);
+  free(gIndexed.items);
+  free(gSeen);
+  memset( & gSession, 0, sizeof(gSession));
+  memset( & gIndexed, 0, sizeof(gIndexed));
+  gSeen = NULL;
+  gSeenCapacity = 0;
+  gSeenCount = 0;
+
+  if (gMapped) UnmapViewOfFile(gMapped);
+  if (gHistoryMapping) CloseHandle(gHistoryMapping);
+  if (gHistoryFile != INVALID_HANDLE_VALUE) CloseHandle(gHistoryFile);
+  gMapped = NULL;
+  gMappedSize = 0;
+  gHistoryMapping = NULL;
+  gHistoryFile = INVALID_HANDLE_VALUE;
+  gScanPos = 0;
+}
@@ -0,0 +1,345 @@
+#include <string.h>
+
+#include <stdlib.h>
+
+#include <stdio.h>
+
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "config.h"
+
+#include "histsearch.h"
+
+#include "history.h"
+
+#include "input.h"
+
+typedef struct {
+  int position;
+  int score;
+}
+HistSearchHit;
+
+typedef struct {
+  int * items;
+  int count;
+  int capacity;
+}
+PositionList;
+
+static bool gActive = false;
+static char gQuery[HISTSEARCH_QUERY_SIZE]; // Lower case
+static int gQueryLength = 0;
+static uint64_t gQueryClasses = 0;
+
+// Matches of the last completed scan; a longer query only needs to re-check these
+static PositionList gMatches;
+static char gMatchedQuery[HISTSEARCH_QUERY_SIZE];
+static int gMatchedLength = -1;
+
+// Running scan: walks either the whole history or gMatches, collecting into gNext
+static PositionList gNext;
+static bool gFromMatches = false;
+static int gScanCursor = 0;
+static bool gScanDone = true;
+static bool gIndexDone = false;
+
+// Best candidates of the running scan, best first; ties stay newest first
+static HistSearchHit gTop[HISTSEARCH_MAX_ROWS];
+static int gTopCount = 0;
+static int gSelected = 0;
+
+// Character classes present in each entry, by recall position (0 = not computed yet)
+static uint64_t * gClasses = NULL;
+static int gClassCapacity = 0;
+
+static char gStatus[INPUT_BUFFER_SIZE];
+
+#define CLASSES_KNOWN (1ull << 63)
+
+// Letters fold to one bit each, digits get their own, everything else shares 27 bits
+static uint64_t histsearch_class(unsigned char c) {
+  if (c >= 'A' && c <= 'Z') c = (unsigned char)(c - 'A' + 'a');
+  if (c >= 'a' && c <= 'z') return 1ull << (c - 'a');
+  if (c >= '0' && c <= '9') return 1ull << (26 + c - '0');
+  return 1ull << (36 + c % 27);
+}
+
+static uint64_t histsearch_classes(const char * text, int length) {
+  uint64_t classes = CLASSES_KNOWN;
+  for (int i = 0; i < length; i++) classes |= histsearch_class((unsigned char) text[i]);
+  return classes;
+}
+
+static char histsearch_upper(char c) {
+  return (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c;
+}
+
+static char histsearch_lower(char c) {
+  return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+// Next offset at or after from holding c in either case, sixteen bytes per compare
+static int histsearch_find(const char * text, int from, int length, char c) {
+  char upper = histsearch_upper(c);
+  int i = from;
+#if defined(__SSE2__)
+  const __m128i lower16 = _mm_set1_epi8(c);
+  const __m128i upper16 = _mm_set1_epi8(upper);
+  for (; i + 16 <= length; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i * )(text + i));
+    unsigned mask = (unsigned) _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, lower16), _mm_cmpeq_epi8(block, upper16)));
+    if (mask) return i + __builtin_ctz(mask);
+  }
+#endif
+  for (; i < length; i++) {
+    if (text[i] == c || text[i] == upper) return i;
+  }
+  return -1;
+}
+
+static bool histsearch_boundary(char c) {
+  return c == ' ' || c == '/' || c == '\\' || c == '-' || c == '_' || c == '.' || c == ':';
+}
+
+// Fuzzy score of the query as a subsequence of text, or -1 when it is not one
+static int histsearch_score(const char * text, int length, int * positions) {
+  if (gQueryLength == 0) return 0;
+
+  // The forward pass finds where the first complete match ends...
+  int end = -1;
+  for (int q = 0, at = 0; q < gQueryLength; q++) {
+    end = histsearch_find(text, at, length, gQuery[q]);
+    if (end < 0) return -1;
+    at = end + 1;
+  }
+
+  // ...and a backward pass from there finds the tightest window ending at the same place
+  int start = end;
+  for (int q = gQueryLength - 1; q >= 0; q--) {
+    while (histsearch_lower(text[start]) != gQuery[q]) start--;
+    if (q > 0) start--;
+  }
+
+  int score = 0;
+  int previous = -1;
+  for (int q = 0, at = start; q < gQueryLength; q++) {
+    int i = histsearch_find(text, at, end + 1, gQuery[q]);
+    if (previous >= 0 && i == previous + 1) {
+      score += HISTSEARCH_BONUS_CONSECUTIVE;
+    } else if (previous >= 0) {
+      int gap = i - previous - 1;
+      score -= gap < HISTSEARCH_MAX_GAP_PENALTY ? gap : HISTSEARCH_MAX_GAP_PENALTY;
+    }
+    if (i == 0 || histsearch_boundary(text[i - 1])) score += HISTSEARCH_BONUS_BOUNDARY;
+    if (positions) positions[q] = i;
+    previous = i;
+    at = i + 1;
+  }
+  return score;
+}
+
+static bool position_list_push(PositionList * list, int position) {
+  if (list -> count == list -> capacity) {
+    int capacity = list -> capacity ? list -> capacity * 2 : 4096;
+    int * grown = (int * ) realloc(list -> items, (size_t) capacity * sizeof(int));
+    if (!grown) return false;
+    list -> items = grown;
+    list -> capacity = capacity;
+  }
+  list -> items[list -> count++] = position;
+  return true;
+}
+
+static void histsearch_offer(int position, int score) {
+  if (gTopCount == HISTSEARCH_MAX_ROWS && score <= gTop[HISTSEARCH_MAX_ROWS - 1].score) return;
+
+  int i = gTopCount < HISTSEARCH_MAX_ROWS ? gTopCount++ : HISTSEARCH_MAX_ROWS - 1;
+  while (i > 0 && gTop[i - 1].score < score) {
+    gTop[i] = gTop[i - 1];
+    i--;
+  }
+  gTop[i].position = position;
+  gTop[i].score = score;
+}
+
+static uint64_t histsearch_entry_classes(int position, const char * text, int length) {
+  if (position >= gClassCapacity) {
+    int capacity = gClassCapacity ? gClassCapacity : 4096;
+    while (capacity <= position) capacity *= 2;
+    uint64_t * grown = (uint64_t * ) realloc(gClasses, (size_t) capacity * sizeof(uint64_t));
+    if (!grown) return histsearch_classes(text, length);
+    memset(grown + gClassCapacity, 0, (size_t)(capacity - gClassCapacity) * sizeof(uint64_t));
+    gClasses = grown;
+    gClassCapacity = capacity;
+  }
+  if (!gClasses[position]) gClasses[position] = histsearch_classes(text, length);
+  return gClasses[position];
+}
+
+// Starts filtering for the current query, from the previous matches when it only grew
+static void histsearch_restart(void) {
+  gQueryClasses = CLASSES_KNOWN;
+  for (int i = 0; i < gQueryLength; i++) gQueryClasses |= histsearch_class((unsigned char) gQuery[i]);
+
+  gFromMatches = gMatchedLength >= 0 && gMatchedLength <= gQueryLength &&
+    memcmp(gMatchedQuery, gQuery, (size_t) gMatchedLength) == 0;
+  gNext.count = 0;
+  gScanCursor = 0;
+  gScanDone = false;
+  gTopCount = 0;
+  gSelected = 0;
+}
+
+static void histsearch_finish(void) {
+  PositionList swap = gMatches;
+  gMatches = gNext;
+  gNext = swap;
+  memcpy(gMatchedQuery, gQuery, (size_t) gQueryLength);
+  gMatchedLength = gQueryLength;
+  gScanDone = true;
+}
+
+void histsearch_open(void) {
+  gActive = true;
+  gQueryLength = 0;
+  gQuery[0] = '\0';
+  gMatchedLength = -1;
+  gIndexDone = false;
+  histsearch_restart();
+}
+
+bool histsearch_active(void) {
+  return gActive;
+}
+
+void histsearch_close(void) {
+  gActive = false;
+  free(gMatches.items);
+  free(gNext.items);
+  free(gClasses);
+  memset( & gMatches, 0, sizeof(gMatches));
+  memset( & gNext, 0, sizeof(gNext));
+  gClasses = NULL;
+  gClassCapacity = 0;
+  gTopCount = 0;
+}
+
+// Per-frame work: index more of the history file and advance the running scan
+void histsearch_update(void) {
+  if (!gActive || gScanDone) return;
+
+  if (!gFromMatches && !gIndexDone) gIndexDone = !history_index_step(HISTSEARCH_INDEX_PER_FRAME);
+
+  for (int budget = HISTSEARCH_SCAN_PER_FRAME; budget > 0; budget--) {
+    int position;
+    if (gFromMatches) {
+      if (gScanCursor >= gMatches.count) {
+        histsearch_finish();
+        return;
+      }
+      position = gMatches.items[gScanCursor++];
+    } else {
+      if (gScanCursor >= history_size()) {
+        if (gIndexDone) histsearch_finish();
+        return;
+      }
+      position = gScanCursor++;
+      if (history_hidden(position)) continue;
+    }
+
+    int length = 0;
+    const char * text = history_entry(position, & length);
+    if (!text) continue;
+
+    // Entries missing any character of the query are rejected without scanning them
+    if ((gQueryClasses & ~histsearch_entry_classes(position, text, length)) != 0) continue;
+
+    int score = histsearch_score(text, length, NULL);
+    if (score < 0) continue;
+    position_list_push( & gNext, position);
+    histsearch_offer(position, score);
+  }
+}
+
+void histsearch_handle_event(const SDL_Event * e, char * inputBuffer, int * cursorPos) {
+  if (!gActive || !e) return;
+
+  if (e -> type == SDL_TEXTINPUT) {
+    for (const char * p = e -> text.text; * p; p++) {
+      if ((unsigned char) * p < 32 || (unsigned char) * p > 126 || gQueryLength >= HISTSEARCH_QUERY_SIZE - 1) continue;
+      gQuery[gQueryLength++] = histsearch_lower( * p);
+    }
+    gQuery[gQueryLength] = '\0';
+    histsearch_restart();
+    return;
+  }
+
+  if (e -> type == SDL_MOUSEWHEEL) {
+    gSelected -= e -> wheel.y;
+  } else if (e -> type == SDL_KEYDOWN) {
+    SDL_Keycode key = e -> key.keysym.sym;
+    bool ctrl = (e -> key.keysym.mod & KMOD_CTRL) != 0;
+
+    if (key == SDLK_ESCAPE || (ctrl && (key == SDLK_g || key == SDLK_c))) {
+      histsearch_close();
+      return;
+    }
+    if (key == SDLK_RETURN || key == SDLK_KP_ENTER || key == SDLK_TAB || key == SDLK_RIGHT) {
+      // The chosen entry replaces the input line so it can be edited before running
+      if (gSelected < gTopCount && inputBuffer && cursorPos) {
+        int length = 0;
+        const char * text = history_entry(gTop[gSelected].position, & length);
+        if (text) {
+          save_input_state(inputBuffer, * cursorPos);
+          memcpy(inputBuffer, text, (size_t) length);
+          inputBuffer[length] = '\0';
+          * cursorPos = length;
+        }
+      }
+      histsearch_close();
+      return;
+    }
+
+    if (key == SDLK_BACKSPACE && gQueryLength > 0) {
+      gQuery[--gQueryLength] = '\0';
+      histsearch_restart();
+    } else if (key == SDLK_DOWN || (ctrl && key == SDLK_r)) {
+      gSelected++;
+    } else if (key == SDLK_UP || (ctrl && key == SDLK_s)) {
+      gSelected--;
+    }
+  }
+
+  if (gSelected >= gTopCount) gSelected = gTopCount - 1;
+  if (gSelected < 0) gSelected = 0;
+}
+
+int histsearch_rows(HistSearchRow * rows, int maxRows) {
+  if (!gActive || !rows) return 0;
+
+  int count = 0;
+  for (int i = 0; i < gTopCount && count < maxRows; i++) {
+    HistSearchRow * row = & rows[count];
+    row -> text = history_entry(gTop[i].position, & row -> length);
+    if (!row -> text) continue;
+
+    row -> selected = (i == gSelected);
+    row -> matchCount = histsearch_score(row -> text, row -> length, row -> matches) >= 0 ? gQueryLength : 0;
+    count++;
+  }
+  return count;
+}
+
+const char * histsearch_status(void) {
+  if (!gActive) return "";
+
+  int matches = gScanDone ? gMatches.count : gNext.count;
+  snprintf(gStatus, sizeof(gStatus), "(reverse-i-search)'%s': %d match%s%s", gQuery, matches,
+    matches == 1 ? "" : "es", gScanDone ? "" : " searching...");
+  return gStatus;
+}
@@ -1,9 +1,13 @@
 #include <string.h>
 
+#include <stdlib.h>
+
 #include <SDL.h>
 
 #include <stdio.h>
 
+#include <stdbool.h>
+
 #include <windows.h>
 
 #include "shell.h"
@@ -14,6 +18,14 @@
 
 #include "gui.h"
 
+#include "history.h"
+
+#include "complete.h"
+
+#include "histsearch.h"
+
+#include "utf8.h"
+
 static char clipboard[CLIPBOARD_SIZE] = "";
 
 // Undo/Redo
@@ -29,6 +41,57 @@ static InputState redoStack[MAX_UNDO_STATES];
 static int undoCount = 0;
 static int redoCount = 0;
 
+// Command history recall (-1 = editing a new line)
+static int historyPosition = -1;
+static char historyDraft[INPUT_BUFFER_SIZE];
+
+// Tab pressed while its directory was still being indexed; retried every frame
+static bool completionPending = false;
+static char completionLine[INPUT_BUFFER_SIZE];
+static int completionCursor = 0;
+
+static void input_complete(char * inputBuffer, int * cursorPos, char output[][INPUT_BUFFER_SIZE], int * lineCount) {
+  char before[INPUT_BUFFER_SIZE];
+  strcpy(before, inputBuffer);
+  int beforeCursor = * cursorPos;
+
+  char candidates[INPUT_BUFFER_SIZE];
+  CompleteStatus status = complete_line(inputBuffer, cursorPos, candidates, sizeof(candidates));
+
+  completionPending = status == COMPLETE_PENDING;
+  if (completionPending) {
+    strcpy(completionLine, inputBuffer);
+    completionCursor = * cursorPos;
+    return;
+  }
+
+  if (strcmp(before, inputBuffer) != 0) {
+    // Undo goes back to the text before completion
+    save_input_state(before, beforeCursor);
+  }
+  if (candidates[0]) shell_append_line(output, lineCount, candidates);
+}
+
+// Per-frame input work that does not come from an event
+void input_update(char * inputBuffer, int * cursorPos, char output[][INPUT_BUFFER_SIZE], int * lineCount) {
+  if (!completionPending || !inputBuffer || !cursorPos) return;
+
+  // Typing since the Tab press abandons it
+  if ( * cursorPos != completionCursor || strcmp(inputBuffer, completionLine) != 0) {
+    completionPending = false;
+    return;
+  }
+  input_complete(inputBuffer, cursorPos, output, lineCount);
+}
+
+// Forgets the editing history of the input line, e.g. when another session's line is shown
+void input_reset(void) {
+  undoCount = 0;
+  redoCount = 0;
+  historyPosition = -1;
+  completionPending = false;
+}
+
 void save_input_state(const char * inputBuffer, int cursorPos) {
   if (!inputBuffer) return;
 
@@ -107,45 +170,51 @@ void input_redo(char * inputBuffer, int * cursorPos) {
   if ( * cursorPos < 0) * cursorPos = 0;
 }
 
-void input_handle_event(SDL_Event * e, char * inputBuffer, char output[][INPUT_BUFFER_SIZE], int * lineCount, int * cursorPos, TextSelection * selection) {
-  if (!inputBuffer || !output || !lineCount || !cursorPos || !e)
-    return;
+// Inserts typed text at the cursor as a single edit with one undo step
+void input_insert_text(char * inputBuffer, int * cursorPos, const char * text) {
+  if (!inputBuffer || !cursorPos || !text) return;
 
-  if (e -> type == SDL_TEXTINPUT) {
-    // Validate input text
-    if (!e -> text.text || strlen(e -> text.text) == 0)
-      return;
-
-    // Skip control characters and non-printable characters
-    bool hasValidChars = false;
-    for (int i = 0; e -> text.text[i]; i++) {
-      if ((unsigned char) e -> text.text[i] >= 32 && (unsigned char) e -> text.text[i] < 127) {
-        hasValidChars = true;
-        break;
-      }
-    }
+  // Drop control characters; SDL delivers everything else as UTF-8
+  char insert[INPUT_BUFFER_SIZE];
+  size_t inputLen = 0;
+  for (const char * p = text; * p && inputLen < sizeof(insert) - 1; p++) {
+    if ((unsigned char) * p >= 32 && (unsigned char) * p != 127) insert[inputLen++] = * p;
+  }
+  if (inputLen == 0) return;
 
-    if (!hasValidChars) return;
+  size_t currentLen = strlen(inputBuffer);
 
-    save_input_state(inputBuffer, * cursorPos);
+  // Validate cursor position
+  if ( * cursorPos < 0) * cursorPos = 0;
+  if ( * cursorPos > (int) currentLen) * cursorPos = (int) currentLen;
 
-    size_t currentLen = strlen(inputBuffer);
-    size_t inputLen = strlen(e -> text.text);
+  // Check if there's enough space
+  if (currentLen + inputLen >= INPUT_BUFFER_SIZE - 1)
+    return;
 
-    // Validate cursor position
-    if ( * cursorPos < 0) * cursorPos = 0;
-    if ( * cursorPos > (int) currentLen) * cursorPos = (int) currentLen;
+  save_input_state(inputBuffer, * cursorPos);
 
-    // Check if there's enough space
-    if (currentLen + inputLen >= INPUT_BUFFER_SIZE - 1)
-      return;
+  // Insert text at cursor position
+  memmove(inputBuffer + * cursorPos + inputLen,
+    inputBuffer + * cursorPos,
+    currentLen - * cursorPos + 1);
+  memcpy(inputBuffer + * cursorPos, insert, inputLen);
+  * cursorPos += (int) inputLen;
+}
+
+// True for key presses the input line ignores, so typed text around them can be merged
+bool input_key_is_text(const SDL_Event * e) {
+  if (!e || e -> type != SDL_KEYDOWN) return false;
+  SDL_Keycode key = e -> key.keysym.sym;
+  return !(e -> key.keysym.mod & (KMOD_CTRL | KMOD_ALT | KMOD_GUI)) && key >= SDLK_SPACE && key < SDLK_DELETE;
+}
+
+void input_handle_event(SDL_Event * e, char * inputBuffer, char output[][INPUT_BUFFER_SIZE], int * lineCount, int * cursorPos, TextSelection * selection) {
+  if (!inputBuffer || !output || !lineCount || !cursorPos || !e)
+    return;
 
-    // Insert text at cursor position
-    memmove(inputBuffer + * cursorPos + inputLen,
-      inputBuffer + * cursorPos,
-      currentLen - * cursorPos + 1);
-    memcpy(inputBuffer + * cursorPos, e -> text.text, inputLen);
-    * cursorPos += (int) inputLen;
+  if (e -> type == SDL_TEXTINPUT) {
+    input_insert_text(inputBuffer, cursorPos, e -> text.text);
   } else if (e -> type == SDL_KEYDOWN) {
     SDL_Keycode key = e -> key.keysym.sym;
     Uint16 mod = e -> key.keysym.mod;
@@ -158,7 +227,11 @@ void input_handle_event(SDL_Event * e, char * inputBuffer, char output[][INPUT_B
         return;
 
       case SDLK_c:
-        // Ctrl+C: Copy selection
+        // Ctrl+C: Copy selection, or cancel the running command when nothing is selected
+        if ((!selection || !selection -> active) && shell_cancel()) {
+          shell_append_line(output, lineCount, "^C");
+          return;
+        }
         input_copy_to_clipboard(output, inputBuffer, * lineCount, selection);
         return;
 
@@ -177,6 +250,11 @@ void input_handle_event(SDL_Event * e, char * inputBuffer, char output[][INPUT_B
         // Ctrl+Y: Redo
         input_redo(inputBuffer, cursorPos);
         return;
+
+      case SDLK_r:
+        // Ctrl+R: Fuzzy search through the command history
+        histsearch_open();
+        return;
       }
     } else {
       switch (key) {
@@ -188,10 +266,12 @@ void input_handle_event(SDL_Event * e, char * inputBuffer, char output[][INPUT_B
           // Validate cursor position
           if ( * cursorPos > (int) len) * cursorPos = (int) len;
 
-          memmove(inputBuffer + * cursorPos - 1,
+          // Remove the whole character, with any combining marks on it
+          int previous = utf8_prev(inputBuffer, * cursorPos);
+          memmove(inputBuffer + previous,
             inputBuffer + * cursorPos,
             len - * cursorPos + 1);
-          ( * cursorPos) --;
+          * cursorPos = previous;
         }
         break;
 
@@ -199,21 +279,55 @@ void input_handle_event(SDL_Event * e, char * inputBuffer, char output[][INPUT_B
         size_t len = strlen(inputBuffer);
         if ( * cursorPos < (int) len) {
           save_input_state(inputBuffer, * cursorPos);
+          int next = utf8_next(inputBuffer, (int) len, * cursorPos);
           memmove(inputBuffer + * cursorPos,
-            inputBuffer + * cursorPos + 1,
-            len - * cursorPos);
+            inputBuffer + next,
+            len - next + 1);
         }
       }
       break;
 
       case SDLK_LEFT:
         if ( * cursorPos > 0)
-          ( * cursorPos) --;
+          * cursorPos = utf8_prev(inputBuffer, * cursorPos);
         break;
 
       case SDLK_RIGHT:
         if ( * cursorPos < (int) strlen(inputBuffer))
-          ( * cursorPos) ++;
+          * cursorPos = utf8_next(inputBuffer, (int) strlen(inputBuffer), * cursorPos);
+        break;
+
+      case SDLK_UP:
+      case SDLK_DOWN: {
+        if (key == SDLK_DOWN && historyPosition < 0)
+          break;
+
+        int next = (key == SDLK_UP) ? history_older(historyPosition) : history_newer(historyPosition);
+        if (key == SDLK_UP && next < 0)
+          break; // Already at the oldest entry
+
+        // Keep whatever was being typed so Down can return to it
+        if (historyPosition < 0) {
+          strncpy(historyDraft, inputBuffer, INPUT_BUFFER_SIZE - 1);
+          historyDraft[INPUT_BUFFER_SIZE - 1] = '\0';
+        }
+        save_input_state(inputBuffer, * cursorPos);
+
+        int length = 0;
+        const char * entry = (next >= 0) ? history_entry(next, & length) : NULL;
+        if (entry) {
+          memcpy(inputBuffer, entry, length);
+          inputBuffer[length] = '\0';
+        } else {
+          strcpy(inputBuffer, historyDraft);
+        }
+        historyPosition = next;
+        * cursorPos = (int) strlen(inputBuffer);
+      }
+      break;
+
+      case SDLK_TAB:
+        input_complete(inputBuffer, cursorPos, output, lineCount);
         break;
 
       case SDLK_HOME:
@@ -228,11 +342,16 @@ void input_handle_event(SDL_Event * e, char * inputBuffer, char output[][INPUT_B
 
       case SDLK_RETURN:
       case SDLK_KP_ENTER:
-        if ( * lineCount < MAX_LINES) {
-          snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "> %s", inputBuffer);
-          ( * lineCount) ++;
+        {
+          char echo[INPUT_BUFFER_SIZE];
+          snprintf(echo, sizeof(echo), "> %s", inputBuffer);
+          shell_append_line(output, lineCount, echo);
 
-          shell_execute(inputBuffer, output, lineCount);
+          history_add(inputBuffer);
+          historyPosition = -1;
+
+          // Runs on the command worker; results stream in via shell_poll_output
+          shell_submit(inputBuffer, output, lineCount);
 
           inputBuffer[0] = '\0';
           * cursorPos = 0;
@@ -258,32 +377,44 @@ void input_copy_to_clipboard(char output[][INPUT_BUFFER_SIZE],
     return;
   }
 
-  char selectedText[CLIPBOARD_SIZE];
-  gui_get_selected_text(output, inputBuffer, lineCount, selection, selectedText, CLIPBOARD_SIZE);
+  // Size the copy exactly from the selection range; stripping escapes can only shrink it
+  size_t textLen = gui_get_selected_text_length(output, inputBuffer, lineCount, selection);
+  if (textLen == 0) return;
+
+  char * text = (char * ) malloc(textLen + 1);
+  if (!text) return;
+  if (gui_write_selected_text(output, inputBuffer, lineCount, selection, text, textLen + 1, COPY_STRIP_ANSI) == 0) {
+    free(text);
+    return;
+  }
 
-  if (strlen(selectedText) > 0) {
-    // Copy to internal clipboard
-    strncpy(clipboard, selectedText, CLIPBOARD_SIZE - 1);
-    clipboard[CLIPBOARD_SIZE - 1] = '\0';
+  // The text is UTF-8; the Windows clipboard takes UTF-16 so non-ASCII text survives
+  bool handedOver = false;
+  int wideLength = MultiByteToWideChar(CP_UTF8, 0, text, -1, NULL, 0);
+  HGLOBAL hClipboardData = wideLength > 0 ? GlobalAlloc(GMEM_MOVEABLE, (SIZE_T) wideLength * sizeof(WCHAR)) : NULL;
+  WCHAR * wideData = hClipboardData ? (WCHAR * ) GlobalLock(hClipboardData) : NULL;
+  if (wideData) {
+    MultiByteToWideChar(CP_UTF8, 0, text, -1, wideData, wideLength);
+    GlobalUnlock(hClipboardData);
 
-    // Copy to Windows clipboard
     if (OpenClipboard(NULL)) {
       EmptyClipboard();
-      size_t textLen = strlen(selectedText);
-      HGLOBAL hClipboardData = GlobalAlloc(GMEM_MOVEABLE, textLen + 1);
-      if (hClipboardData) {
-        char * pchData = (char * ) GlobalLock(hClipboardData);
-        if (pchData) {
-          strcpy(pchData, selectedText);
-          GlobalUnlock(hClipboardData);
-          SetClipboardData(CF_TEXT, hClipboardData);
-        } else {
-          GlobalFree(hClipboardData);
-        }
-      }
+      handedOver = SetClipboardData(CF_UNICODETEXT, hClipboardData) != NULL;
       CloseClipboard();
     }
   }
+  if (hClipboardData && !handedOver) GlobalFree(hClipboardData);
+
+  if (handedOver) {
+    // The system clipboard owns the memory now; drop any stale internal copy
+    clipboard[0] = '\0';
+  } else {
+    // Fall back to the internal clipboard, which only ever feeds the input line
+    int length = utf8_boundary(text, textLen < CLIPBOARD_SIZE - 1 ? (int) textLen : CLIPBOARD_SIZE - 1);
+    memcpy(clipboard, text, (size_t) length);
+    clipboard[length] = '\0';
+  }
+  free(text);
 }
 
 void input_paste_from_clipboard(char * inputBuffer, int * cursorPos) {
@@ -291,14 +422,20 @@ void input_paste_from_clipboard(char * inputBuffer, int * cursorPos) {
 
   char pasteText[CLIPBOARD_SIZE] = "";
 
-  // Try to get text from Windows clipboard first
+  // Try to get text from Windows clipboard first, converted from UTF-16 to UTF-8
   if (OpenClipboard(NULL)) {
-    HANDLE hClipboardData = GetClipboardData(CF_TEXT);
+    HANDLE hClipboardData = GetClipboardData(CF_UNICODETEXT);
     if (hClipboardData) {
-      char * pchData = (char * ) GlobalLock(hClipboardData);
-      if (pchData) {
-        strncpy(pasteText, pchData, CLIPBOARD_SIZE - 1);
-        pasteText[CLIPBOARD_SIZE - 1] = '\0';
+      const WCHAR * wideData = (const WCHAR * ) GlobalLock(hClipboardData);
+      if (wideData) {
+        int length = WideCharToMultiByte(CP_UTF8, 0, wideData, -1, NULL, 0, NULL, NULL);
+        char * text = length > 0 ? (char * ) malloc((size_t) length) : NULL;
+        if (text && WideCharToMultiByte(CP_UTF8, 0, wideData, -1, text, length, NULL, NULL) > 0) {
+          int copied = utf8_boundary(text, length - 1 < CLIPBOARD_SIZE - 1 ? length - 1 : CLIPBOARD_SIZE - 1);
+          memcpy(pasteText, text, (size_t) copied);
+          pasteText[copied] = '\0';
+        }
+        free(text);
         GlobalUnlock(hClipboardData);
       }
     }
@@ -324,9 +461,9 @@ void input_paste_from_clipboard(char * inputBuffer, int * cursorPos) {
         pasteText[i] = ' ';
     }
 
-    // Limit paste length to available space
+    // Limit paste length to available space, without splitting a character
     if (pasteLen > INPUT_BUFFER_SIZE - currentLen - 1)
-      pasteLen = INPUT_BUFFER_SIZE - currentLen - 1;
+      pasteLen = (size_t) utf8_boundary(pasteText, (int)(INPUT_BUFFER_SIZE - currentLen - 1));
 
     if (pasteLen > 0 && currentLen + pasteLen < INPUT_BUFFER_SIZE - 1) {
       // Make room for pasted text
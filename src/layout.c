@@ -0,0 +1,385 @@
+#include <string.h>
+
+#include <stdlib.h>
+
+#include <stdbool.h>
+
+#include <SDL.h>
+
+#include "config.h"
+
+#include "layout.h"
+
+#include "threadpool.h"
+
+#include "utf8.h"
+
+typedef struct ReflowJob ReflowJob;
+
+// A contiguous range of source lines laid out by one worker task
+typedef struct {
+  ReflowJob * job;
+  int firstLine;
+  int lastLine;
+  Layout * rows;
+} ReflowChunk;
+
+struct ReflowJob {
+  char * text;   // Copy of the output lines, each ending in '\0'; workers never read the live output
+  char ** lines; // Start of each line in text
+  int lineCount;
+  int width;
+  Uint32 generation;
+  int epoch;
+  int chunkCount;
+  ReflowChunk * chunks;
+  SDL_atomic_t remaining;
+  Layout * result;
+};
+
+static Layout * gCurrent = NULL; // Layout used by the renderer (UI thread only)
+static Layout * gPreview = NULL; // Bottom rows shown while a reflow is running
+static void * gPublished = NULL; // Finished ReflowJob handed from workers to the UI thread
+
+static SDL_atomic_t gGeneration; // Bumped whenever existing output lines change
+static SDL_atomic_t gEpoch;      // Bumped on every reflow request, stales older jobs
+
+static bool gReflowPending = false;
+static int gPendingWidth = 0;
+static Uint32 gPendingGeneration = 0;
+static int gPendingEpoch = 0;
+
+static void layout_free(Layout * layout) {
+  if (!layout) return;
+  free(layout -> lineFirstRow);
+  free(layout -> rows);
+  free(layout);
+}
+
+static void layout_reset(Layout * layout, int firstLine, int width, Uint32 generation) {
+  layout -> width = width;
+  layout -> generation = generation;
+  layout -> firstLine = firstLine;
+  layout -> lineCount = firstLine;
+  layout -> rowCount = 0;
+}
+
+static Layout * layout_alloc(int firstLine, int width, Uint32 generation) {
+  Layout * layout = (Layout * ) calloc(1, sizeof(Layout));
+  if (layout) layout_reset(layout, firstLine, width, generation);
+  return layout;
+}
+
+static bool layout_reserve(Layout * layout, int lines, int rows) {
+  if (lines > layout -> lineCapacity) {
+    int capacity = layout -> lineCapacity ? layout -> lineCapacity * 2 : 64;
+    while (capacity < lines) capacity *= 2;
+    int * grown = (int * ) realloc(layout -> lineFirstRow, capacity * sizeof(int));
+    if (!grown) return false;
+    layout -> lineFirstRow = grown;
+    layout -> lineCapacity = capacity;
+  }
+  if (rows > layout -> rowCapacity) {
+    int capacity = layout -> rowCapacity ? layout -> rowCapacity * 2 : 64;
+    while (capacity < rows) capacity *= 2;
+    LayoutRow * grown = (LayoutRow * ) realloc(layout -> rows, capacity * sizeof(LayoutRow));
+    if (!grown) return false;
+    layout -> rows = grown;
+    layout -> rowCapacity = capacity;
+  }
+  return true;
+}
+
+static bool layout_push_row(Layout * layout, int line, int start, int length) {
+  if (!layout_reserve(layout, 0, layout -> rowCount + 1)) return false;
+  LayoutRow * row = & layout -> rows[layout -> rowCount++];
+  row -> line = line;
+  row -> start = start;
+  row -> length = length;
+  return true;
+}
+
+// Appends the display rows of one source line, breaking like wrap_text()
+static bool layout_append_line(Layout * layout, const char * text, int line) {
+  if (!layout_reserve(layout, line - layout -> firstLine + 1, 0)) return false;
+  layout -> lineFirstRow[line - layout -> firstLine] = layout -> rowCount;
+  layout -> lineCount = line + 1;
+
+  // Lines are fixed-size buffers, so the scan never runs past the slot
+  int textLen = (int) strnlen(text, INPUT_BUFFER_SIZE - 1);
+  int maxWidth = layout -> width;
+
+  if (textLen == 0 || maxWidth <= 0)
+    return layout_push_row(layout, line, 0, textLen);
+
+  // Widths are in columns; lines without multibyte characters count bytes
+  bool ascii = utf8_is_ascii(text, textLen);
+
+  int i = 0;
+  while (i < textLen) {
+    int lineStart = i;
+    int lastSpace = -1;
+    int lineLength = 0;
+    bool full = false;
+
+    while (i < textLen && text[i] != '\n') {
+      int step = 1;
+      int width = 1;
+      if (!ascii && (unsigned char) text[i] >= 0x80) {
+        step = utf8_next(text, textLen, i) - i;
+        width = utf8_columns(text + i, step);
+      }
+      if (lineLength + width > maxWidth) {
+        full = true;
+        break;
+      }
+
+      if (text[i] == ' ')
+        lastSpace = i;
+      lineLength += width;
+      i += step;
+    }
+
+    // A character wider than the whole row still gets a row of its own
+    if (i == lineStart && full) {
+      i = utf8_next(text, textLen, i);
+      full = false;
+    }
+
+    int lineEnd = i;
+    if (i < textLen && text[i] != '\n' && full &&
+      lastSpace != -1 && lastSpace > lineStart) {
+      lineEnd = lastSpace;
+      i = lastSpace + 1;
+    }
+
+    if (!layout_push_row(layout, line, lineStart, lineEnd - lineStart))
+      return false;
+
+    if (i < textLen && text[i] == '\n')
+      i++;
+  }
+
+  return true;
+}
+
+static void reflow_job_free(ReflowJob * job) {
+  if (!job) return;
+  for (int c = 0; job -> chunks && c < job -> chunkCount; c++) {
+    layout_free(job -> chunks[c].rows);
+  }
+  free(job -> chunks);
+  free(job -> lines);
+  free(job -> text);
+  layout_free(job -> result);
+  free(job);
+}
+
+// Stitches the per-chunk rows into one layout (runs on the last worker to finish)
+static Layout * reflow_job_stitch(ReflowJob * job) {
+  int totalRows = 0;
+  for (int c = 0; c < job -> chunkCount; c++) {
+    if (!job -> chunks[c].rows) return NULL;
+    totalRows += job -> chunks[c].rows -> rowCount;
+  }
+
+  Layout * layout = layout_alloc(0, job -> width, job -> generation);
+  if (!layout || !layout_reserve(layout, job -> lineCount, totalRows)) {
+    layout_free(layout);
+    return NULL;
+  }
+
+  for (int c = 0; c < job -> chunkCount; c++) {
+    const Layout * part = job -> chunks[c].rows;
+    int lines = part -> lineCount - part -> firstLine;
+
+    memcpy(layout -> rows + layout -> rowCount, part -> rows, part -> rowCount * sizeof(LayoutRow));
+    for (int i = 0; i < lines; i++) {
+      layout -> lineFirstRow[part -> firstLine + i] = part -> lineFirstRow[i] + layout -> rowCount;
+    }
+    layout -> rowCount += part -> rowCount;
+  }
+  layout -> lineCount = job -> lineCount;
+
+  return layout;
+}
+
+static void layout_reflow_chunk(void * arg) {
+  ReflowChunk * chunk = (ReflowChunk * ) arg;
+  ReflowJob * job = chunk -> job;
+
+  // Skip the work entirely if a newer reflow has been requested
+  if (SDL_AtomicGet( & gEpoch) == job -> epoch) {
+    chunk -> rows = layout_alloc(chunk -> firstLine, job -> width, job -> generation);
+    for (int i = chunk -> firstLine; chunk -> rows && i < chunk -> lastLine; i++) {
+      if (!layout_append_line(chunk -> rows, job -> lines[i], i)) {
+        layout_free(chunk -> rows);
+        chunk -> rows = NULL;
+      }
+    }
+  }
+
+  if (!SDL_AtomicDecRef( & job -> remaining))
+    return;
+
+  if (SDL_AtomicGet( & gEpoch) == job -> epoch) {
+    job -> result = reflow_job_stitch(job);
+  }
+
+  // Publish atomically; an unconsumed older result is simply replaced
+  ReflowJob * previous = (ReflowJob * ) SDL_AtomicSetPtr( & gPublished, job);
+  reflow_job_free(previous);
+}
+
+void layout_request_reflow(char output[][INPUT_BUFFER_SIZE], int lineCount, int width) {
+  if (!output || lineCount < 0) return;
+
+  Uint32 generation = (Uint32) SDL_AtomicGet( & gGeneration);
+
+  if (gReflowPending && gPendingWidth == width && gPendingGeneration == generation)
+    return;
+  if (gCurrent && gCurrent -> width == width && gCurrent -> generation == generation)
+    return;
+
+  ReflowJob * job = (ReflowJob * ) calloc(1, sizeof(ReflowJob));
+  if (!job) return;
+
+  // One chunk per worker, unless that would make the chunks too small to be worth a task
+  int workers = threadpool_worker_count();
+  if (workers < 1) workers = 1;
+  int chunkLines = (lineCount + workers - 1) / workers;
+  if (chunkLines < REFLOW_MIN_CHUNK_LINES) chunkLines = REFLOW_MIN_CHUNK_LINES;
+  job -> chunkCount = (lineCount + chunkLines - 1) / chunkLines;
+  if (job -> chunkCount < 1) job -> chunkCount = 1;
+  // The UI thread keeps shifting and appending to the output while workers run, so they get a copy
+  size_t total = 0;
+  for (int i = 0; i < lineCount; i++) total += strnlen(output[i], INPUT_BUFFER_SIZE - 1) + 1;
+  job -> chunks = (ReflowChunk * ) calloc(job -> chunkCount, sizeof(ReflowChunk));
+  job -> text = (char * ) malloc(total + 1);
+  job -> lines = (char ** ) malloc((lineCount + 1) * sizeof(char * ));
+  if (!job -> chunks || !job -> text || !job -> lines) {
+    reflow_job_free(job);
+    return;
+  }
+
+  char * cursor = job -> text;
+  for (int i = 0; i < lineCount; i++) {
+    size_t length = strnlen(output[i], INPUT_BUFFER_SIZE - 1);
+    memcpy(cursor, output[i], length);
+    cursor[length] = '\0';
+    job -> lines[i] = cursor;
+    cursor += length + 1;
+  }
+
+  job -> lineCount = lineCount;
+  job -> width = width;
+  job -> generation = generation;
+  job -> epoch = SDL_AtomicAdd( & gEpoch, 1) + 1;
+  SDL_AtomicSet( & job -> remaining, job -> chunkCount);
+
+  for (int c = 0; c < job -> chunkCount; c++) {
+    job -> chunks[c].job = job;
+    job -> chunks[c].firstLine = c * chunkLines;
+    job -> chunks[c].lastLine = (c + 1) * chunkLines;
+    if (job -> chunks[c].lastLine > lineCount) job -> chunks[c].lastLine = lineCount;
+  }
+
+  gReflowPending = true;
+  gPendingWidth = width;
+  gPendingGeneration = generation;
+  gPendingEpoch = job -> epoch;
+
+  // Queue the bottom chunks first so the visible end of the scrollback is ready earliest.
+  // The job may be freed as soon as its last chunk is queued, so only use the locals after this.
+  int chunkCount = job -> chunkCount;
+  ReflowChunk * chunks = job -> chunks;
+  for (int c = chunkCount - 1; c >= 0; c--) {
+    threadpool_submit(layout_reflow_chunk, & chunks[c]);
+  }
+}
+
+// Lays out only the tail of the output so the visible rows stay correct mid-reflow
+static const Layout * layout_build_preview(char output[][INPUT_BUFFER_SIZE], int lineCount, int width, int visibleRows, Uint32 generation) {
+  if (visibleRows < 1) visibleRows = 1;
+  int firstLine = lineCount - visibleRows;
+  if (firstLine < 0) firstLine = 0;
+
+  if (!gPreview) {
+    gPreview = layout_alloc(firstLine, width, generation);
+    if (!gPreview) return NULL;
+  } else {
+    layout_reset(gPreview, firstLine, width, generation);
+  }
+
+  for (int i = firstLine; i < lineCount; i++) {
+    if (!layout_append_line(gPreview, output[i], i)) break;
+  }
+  return gPreview;
+}
+
+const Layout * layout_update(char output[][INPUT_BUFFER_SIZE], int lineCount, int width, int visibleRows) {
+  if (!output) return NULL;
+
+  Uint32 generation = (Uint32) SDL_AtomicGet( & gGeneration);
+
+  // Adopt a finished reflow if it still matches the current output and width
+  ReflowJob * done = (ReflowJob * ) SDL_AtomicSetPtr( & gPublished, NULL);
+  if (done) {
+    if (done -> epoch == gPendingEpoch) gReflowPending = false;
+    if (done -> result && done -> width == width && done -> generation == generation &&
+      done -> lineCount <= lineCount) {
+      layout_free(gCurrent);
+      gCurrent = done -> result;
+      done -> result = NULL;
+    }
+    reflow_job_free(done);
+  }
+
+  if (gCurrent && (gCurrent -> width != width || gCurrent -> generation != generation ||
+      gCurrent -> lineCount > lineCount)) {
+    layout_free(gCurrent);
+    gCurrent = NULL;
+  }
+
+  if (!gCurrent) {
+    layout_request_reflow(output, lineCount, width);
+    return layout_build_preview(output, lineCount, width, visibleRows, generation);
+  }
+
+  // Lines appended since the reflow started are cheap to lay out here
+  for (int i = gCurrent -> lineCount; i < lineCount; i++) {
+    if (!layout_append_line(gCurrent, output[i], i)) break;
+  }
+
+  return gCurrent;
+}
+
+// Lays out only the rows about to be drawn; used while output floods in and any full reflow would be stale next frame
+const Layout * layout_update_visible(char output[][INPUT_BUFFER_SIZE], int lineCount, int width, int visibleRows) {
+  if (!output) return NULL;
+
+  Uint32 generation = (Uint32) SDL_AtomicGet( & gGeneration);
+  if (gCurrent && gCurrent -> width == width && gCurrent -> generation == generation &&
+    gCurrent -> lineCount <= lineCount) {
+    return layout_update(output, lineCount, width, visibleRows);
+  }
+  return layout_build_preview(output, lineCount, width, visibleRows, generation);
+}
+
+void layout_invalidate(void) {
+  SDL_AtomicAdd( & gGeneration, 1);
+}
+
+Uint32 layout_generation(void) {
+  return (Uint32) SDL_AtomicGet( & gGeneration);
+}
+
+// Must run after threadpool_shutdown() so no reflow task is still in flight
+void layout_cleanup(void) {
+  reflow_job_free((ReflowJob * ) SDL_AtomicSetPtr( & gPublished, NULL));
+  layout_free(gCurrent);
+  layout_free(gPreview);
+  gCurrent = NULL;
+  gPreview = NULL;
+  gReflowPending = false;
+}
@@ -0,0 +1,144 @@
+#include <string.h>
+
+#include <stdint.h>
+
+#include "lz.h"
+
+// LZ77 with an LZ4-style sequence layout: a token holding the literal run and match
+// lengths (15 = more length bytes follow), the literals, then a 16-bit match offset.
+// The last sequence carries literals only.
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+
+static uint32_t lz_read32(const char * p) {
+  uint32_t value;
+  memcpy( & value, p, sizeof(value));
+  return value;
+}
+
+static uint32_t lz_hash(uint32_t value) {
+  return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Worst case output size: literals plus one length byte per 255 and the token
+size_t lz_bound(size_t length) {
+  return length + length / 255 + 16;
+}
+
+static unsigned char * lz_write_length(unsigned char * out, const unsigned char * end, size_t length) {
+  for (; length >= 255; length -= 255) {
+    if (out >= end) return NULL;
+    * out++ = 255;
+  }
+  if (out >= end) return NULL;
+  * out++ = (unsigned char) length;
+  return out;
+}
+
+static unsigned char * lz_write_sequence(unsigned char * out, const unsigned char * end,
+  const char * literals, size_t literalLength, size_t offset, size_t matchLength) {
+  if (out >= end) return NULL;
+  unsigned char * token = out++;
+  size_t matchCode = matchLength ? matchLength - LZ_MIN_MATCH : 0;
+  * token = (unsigned char)(((literalLength < 15 ? literalLength : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+
+  if (literalLength >= 15 && !(out = lz_write_length(out, end, literalLength - 15))) return NULL;
+  if ((size_t)(end - out) < literalLength) return NULL;
+  memcpy(out, literals, literalLength);
+  out += literalLength;
+
+  if (!matchLength) return out;
+  if (end - out < 2) return NULL;
+  * out++ = (unsigned char)(offset & 0xFF);
+  * out++ = (unsigned char)(offset >> 8);
+  if (matchCode >= 15 && !(out = lz_write_length(out, end, matchCode - 15))) return NULL;
+  return out;
+}
+
+// Compresses source into dest; returns the compressed size, or 0 if dest is too small
+size_t lz_compress(const char * source, size_t length, unsigned char * dest, size_t capacity) {
+  if (!source || !dest) return 0;
+
+  int32_t table[1 << LZ_HASH_BITS];
+  memset(table, 0xFF, sizeof(table));
+
+  unsigned char * out = dest;
+  const unsigned char * end = dest + capacity;
+  size_t anchor = 0;
+  size_t i = 0;
+
+  while (length >= LZ_MIN_MATCH && i <= length - LZ_MIN_MATCH) {
+    uint32_t value = lz_read32(source + i);
+    uint32_t h = lz_hash(value);
+    int32_t candidate = table[h];
+    table[h] = (int32_t) i;
+
+    if (candidate < 0 || i - (size_t) candidate > LZ_MAX_OFFSET || lz_read32(source + candidate) != value) {
+      i++;
+      continue;
+    }
+
+    size_t match = LZ_MIN_MATCH;
+    while (i + match < length && source[candidate + match] == source[i + match]) match++;
+
+    out = lz_write_sequence(out, end, source + anchor, i - anchor, i - (size_t) candidate, match);
+    if (!out) return 0;
+    i += match;
+    anchor = i;
+  }
+
+  out = lz_write_sequence(out, end, source + anchor, length - anchor, 0, 0);
+  return out ? (size_t)(out - dest) : 0;
+}
+
+static bool lz_read_length(const unsigned char ** in, const unsigned char * end, size_t * length) {
+  unsigned char byte;
+  do {
+    if ( * in >= end) return false;
+    byte = * ( * in) ++;
+    * length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+// Expands exactly rawLength bytes into dest; false on corrupt input
+bool lz_decompress(const unsigned char * source, size_t length, char * dest, size_t rawLength) {
+  if (!source || !dest) return false;
+
+  const unsigned char * in = source;
+  const unsigned char * end = source + length;
+  size_t out = 0;
+
+  while (in < end) {
+    unsigned char token = * in++;
+
+    size_t literalLength = token >> 4;
+    if (literalLength == 15 && !lz_read_length( & in, end, & literalLength)) return false;
+    if ((size_t)(end - in) < literalLength || rawLength - out < literalLength) return false;
+    memcpy(dest + out, in, literalLength);
+    in += literalLength;
+    out += literalLength;
+
+    // The final sequence stops after its literals
+    if (in == end) break;
+
+    if (end - in < 2) return false;
+    size_t offset = (size_t) in[0] | ((size_t) in[1] << 8);
+    in += 2;
+    size_t matchLength = token & 15;
+    if (matchLength == 15 && !lz_read_length( & in, end, & matchLength)) return false;
+    matchLength += LZ_MIN_MATCH;
+
+    if (offset == 0 || offset > out || rawLength - out < matchLength) return false;
+
+    // Overlapping matches repeat the last offset bytes, so they are copied byte by byte
+    if (offset >= matchLength) {
+      memcpy(dest + out, dest + out - offset, matchLength);
+      out += matchLength;
+    } else {
+      for (size_t k = 0; k < matchLength; k++, out++) dest[out] = dest[out - offset];
+    }
+  }
+  return out == rawLength;
+}
@@ -8,16 +8,42 @@
 
 #include <stdio.h>
 
+#include <string.h>
+
 #include <stdbool.h>
 
 #include "config.h"
 
+#include "batch.h"
+
 #include "gui.h"
 
 #include "input.h"
 
 #include "shell.h"
 
+#include "history.h"
+
+#include "layout.h"
+
+#include "pager.h"
+
+#include "histsearch.h"
+
+#include "complete.h"
+
+#include "recorder.h"
+
+#include "threadpool.h"
+
+#include "session.h"
+
+#include "control.h"
+
+#include "pane.h"
+
+#include "font.h"
+
 // Define the global word wrap variable
 int wordWrapEnabled = 0; // 0 = false, 1 = true
 
@@ -37,7 +63,201 @@ BackgroundConfig backgroundConfig = {
   // BACKGROUND_OVERLAY_OPACITY  // overlayOpacity
 };
 
+// Ctrl+T opens a tab, Ctrl+W closes it, Ctrl+Tab, Ctrl+Shift+Tab and Ctrl+1..9 switch; true when handled
+static bool handle_tab_key(const SDL_KeyboardEvent * key) {
+  if (!(key -> keysym.mod & KMOD_CTRL)) return false;
+
+  SDL_Keycode sym = key -> keysym.sym;
+  int count = session_count();
+  if (sym == SDLK_t) {
+    pane_new_tab();
+  } else if (sym == SDLK_w) {
+    pane_close();
+  } else if (sym == SDLK_TAB && count > 0) {
+    int step = (key -> keysym.mod & KMOD_SHIFT) ? count - 1 : 1;
+    pane_show_session((session_active_index() + step) % count);
+  } else if (sym >= SDLK_1 && sym <= SDLK_9) {
+    pane_show_session((int)(sym - SDLK_1));
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Ctrl+Shift+E splits the focused pane side by side, Ctrl+Shift+O one above the other,
+// Alt+arrows move the focus; true when handled
+static bool handle_pane_key(const SDL_KeyboardEvent * key) {
+  Uint16 mod = key -> keysym.mod;
+  SDL_Keycode sym = key -> keysym.sym;
+  if ((mod & KMOD_CTRL) && (mod & KMOD_SHIFT) && (sym == SDLK_e || sym == SDLK_o)) {
+    pane_split(sym == SDLK_e ? PANE_SPLIT_RIGHT : PANE_SPLIT_DOWN);
+    return true;
+  }
+  if (!(mod & KMOD_ALT) || (mod & KMOD_CTRL)) return false;
+
+  switch (sym) {
+  case SDLK_LEFT:
+    pane_focus_toward(-1, 0);
+    return true;
+  case SDLK_RIGHT:
+    pane_focus_toward(1, 0);
+    return true;
+  case SDLK_UP:
+    pane_focus_toward(0, -1);
+    return true;
+  case SDLK_DOWN:
+    pane_focus_toward(0, 1);
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Ctrl+Plus and Ctrl+Minus (or Ctrl+wheel) zoom the main font, Ctrl+0 resets it; true when handled.
+// A size zoomed to recently is still open, and the rows are reflowed off the UI thread as on a resize
+static bool handle_zoom_event(const SDL_Event * e, char output[][INPUT_BUFFER_SIZE], int lineCount) {
+  int steps;
+  if (e -> type == SDL_KEYDOWN && (e -> key.keysym.mod & KMOD_CTRL) && !(e -> key.keysym.mod & KMOD_ALT)) {
+    SDL_Keycode sym = e -> key.keysym.sym;
+    if (sym == SDLK_EQUALS || sym == SDLK_PLUS || sym == SDLK_KP_PLUS) {
+      steps = 1;
+    } else if (sym == SDLK_MINUS || sym == SDLK_KP_MINUS) {
+      steps = -1;
+    } else if (sym == SDLK_0 || sym == SDLK_KP_0) {
+      steps = 0;
+    } else {
+      return false;
+    }
+  } else if (e -> type == SDL_MOUSEWHEEL && (SDL_GetModState() & KMOD_CTRL) && e -> wheel.y != 0) {
+    steps = e -> wheel.y > 0 ? 1 : -1;
+  } else {
+    return false;
+  }
+
+  if (font_zoom(steps)) {
+    gui_set_font(font_current(), font_size());
+    layout_request_reflow(output, lineCount, wordWrapEnabled ? get_text_width_in_chars() : 0);
+  }
+  return true;
+}
+
+// Dispatches one input event to the handlers; returns false when the app should quit
+static bool handle_event(SDL_Event * e, char * inputBuffer, char output[][INPUT_BUFFER_SIZE],
+  int * lineCount, int * cursorPos, TextSelection * selection) {
+  // Zooming works everywhere, the pager and history search included
+  if (handle_zoom_event(e, output, * lineCount)) return true;
+
+  // The pager takes all keyboard and mouse input while it is open
+  if (pager_active() && e -> type != SDL_QUIT && e -> type != SDL_WINDOWEVENT) {
+    pager_handle_event(e);
+    return true;
+  }
+
+  // So does the history search, until it is accepted or dismissed
+  if (histsearch_active() && e -> type != SDL_QUIT && e -> type != SDL_WINDOWEVENT) {
+    histsearch_handle_event(e, inputBuffer, cursorPos);
+    return true;
+  }
+
+  switch (e -> type) {
+  case SDL_QUIT:
+    return false;
+
+  case SDL_KEYDOWN:
+    if (e -> key.keysym.sym == SDLK_ESCAPE) {
+      return false;
+    }
+    // The output and input line always belong to the tab shown, so a switch applies from the next event
+    if (handle_pane_key( & e -> key) || handle_tab_key( & e -> key)) break;
+    // Fall through to input handler
+  case SDL_TEXTINPUT:
+    input_handle_event(e, inputBuffer, output, lineCount, cursorPos, selection);
+    break;
+
+  case SDL_MOUSEBUTTONDOWN:
+  case SDL_MOUSEBUTTONUP:
+  case SDL_MOUSEMOTION:
+    gui_handle_mouse_event(e, output, inputBuffer, * lineCount, selection);
+    break;
+
+  case SDL_WINDOWEVENT:
+    if (e -> window.event == SDL_WINDOWEVENT_RESIZED) {
+      printf("Window resized to: %dx%d\n", e -> window.data1, e -> window.data2);
+      // Reflow wrapped lines in the background; the visible rows are laid out first by gui_render
+      layout_request_reflow(output, * lineCount, wordWrapEnabled ? get_text_width_in_chars() : 0);
+    }
+    break;
+
+  case SDL_RENDER_TARGETS_RESET:
+  case SDL_RENDER_DEVICE_RESET:
+    // Cached pane and watch textures lost their contents and are drawn again
+    gui_reset_targets();
+    break;
+  }
+  return true;
+}
+
+// Input gathered over one frame: typed text becomes one insert, mouse motion only its last position
+typedef struct {
+  char text[INPUT_BUFFER_SIZE];
+  int textLength;
+  SDL_Event motion;
+  bool hasMotion;
+}
+PendingInput;
+
+static PendingInput gPending;
+
+static void flush_pending(char * inputBuffer, char output[][INPUT_BUFFER_SIZE],
+  int * lineCount, int * cursorPos, TextSelection * selection) {
+  if (gPending.textLength > 0) {
+    gPending.text[gPending.textLength] = '\0';
+    gPending.textLength = 0;
+    input_insert_text(inputBuffer, cursorPos, gPending.text);
+  }
+  if (gPending.hasMotion) {
+    gPending.hasMotion = false;
+    handle_event( & gPending.motion, inputBuffer, output, lineCount, cursorPos, selection);
+  }
+}
+
+// Queues mergeable events and dispatches the rest in order; returns false when the app should quit
+static bool queue_event(SDL_Event * e, char * inputBuffer, char output[][INPUT_BUFFER_SIZE],
+  int * lineCount, int * cursorPos, TextSelection * selection) {
+  bool modal = pager_active() || histsearch_active();
+
+  if (e -> type == SDL_TEXTINPUT && !modal) {
+    int length = (int) strlen(e -> text.text);
+    if (gPending.textLength + length >= INPUT_BUFFER_SIZE - 1)
+      flush_pending(inputBuffer, output, lineCount, cursorPos, selection);
+    memcpy(gPending.text + gPending.textLength, e -> text.text, (size_t) length);
+    gPending.textLength += length;
+    return true;
+  }
+
+  if (e -> type == SDL_MOUSEMOTION) {
+    // Relative movement and button state still add up across the dropped events
+    if (gPending.hasMotion) {
+      e -> motion.xrel += gPending.motion.motion.xrel;
+      e -> motion.yrel += gPending.motion.motion.yrel;
+    }
+    gPending.motion = * e;
+    gPending.hasMotion = true;
+    return true;
+  }
+
+  // Key presses that only produce text do not touch the input line, so the batch stays open
+  if (modal || !input_key_is_text(e))
+    flush_pending(inputBuffer, output, lineCount, cursorPos, selection);
+  return handle_event(e, inputBuffer, output, lineCount, cursorPos, selection);
+}
+
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nShowCmd) {
+  // Batch mode runs commands straight to stdout without creating a window
+  if (batch_requested(__argc, __argv)) {
+    return batch_run(__argc, __argv);
+  }
+
   // Allocate console for debugging
   AllocConsole();
   freopen("CONOUT$", "w", stdout);
@@ -124,7 +344,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
   };
 
   for (int i = 0; fontPaths[i] != NULL; i++) {
-    font = TTF_OpenFont(fontPaths[i], FONT_SIZE);
+    font = font_open(fontPaths[i]);
     if (font) {
       printf("Successfully loaded font: %s\n", fontPaths[i]);
       break;
@@ -172,6 +392,15 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
   gui_init(renderer, font);
   gui_set_title_font(titleFont);
 
+  // Start worker threads used for background layout work
+  threadpool_init(WORKER_THREADS);
+
+  // Other local processes can push output and commands through the control socket
+  control_start();
+
+  // Map the command history file; entries are indexed lazily on recall
+  history_init(HISTORY_FILE_PATH);
+
   // Load background image if enabled
   if (backgroundConfig.enabled) {
     printf("Attempting to load background image: %s\n", backgroundConfig.imagePath);
@@ -223,35 +452,66 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
   TextSelection selection;
   memset( & selection, 0, sizeof(TextSelection));
 
-  // Display welcome messages
-  if (lineCount < MAX_LINES) {
-    snprintf(output[lineCount], INPUT_BUFFER_SIZE, "");
-    lineCount++;
-  }
-  if (lineCount < MAX_LINES) {
-    snprintf(output[lineCount], INPUT_BUFFER_SIZE, "Welcome to OCTO-SHELL Emulator!");
-    lineCount++;
+  // Each tab runs builtins on its own thread so a slow command never stalls rendering;
+  // the buffers above always hold the tab being shown
+  session_attach(inputBuffer, & cursorPos, & selection, output, & lineCount);
+  if (!session_open()) {
+    printf("Could not start a session, running commands inline.\n");
   }
-  if (lineCount < MAX_LINES) {
-    snprintf(output[lineCount], INPUT_BUFFER_SIZE, "");
-    lineCount++;
-  }
-  if (lineCount < MAX_LINES) {
-    snprintf(output[lineCount], INPUT_BUFFER_SIZE, "Type 'help' for available commands.");
-    lineCount++;
+  pane_init();
+
+  // Session files save and restore the editing state alongside the output
+  bool restored = SESSION_AUTOSAVE && session_load(SESSION_FILE_PATH, output, & lineCount);
+  if (restored) {
+    printf("Session restored from: %s\n", SESSION_FILE_PATH);
   }
-  if (lineCount < MAX_LINES) {
-    snprintf(output[lineCount], INPUT_BUFFER_SIZE, "");
-    lineCount++;
+
+  // Display welcome messages; a restored session already has them, and saving would stack them up
+  if (!restored) {
+    if (lineCount < MAX_LINES) {
+      snprintf(output[lineCount], INPUT_BUFFER_SIZE, "");
+      lineCount++;
+    }
+    if (lineCount < MAX_LINES) {
+      snprintf(output[lineCount], INPUT_BUFFER_SIZE, "Welcome to OCTO-SHELL Emulator!");
+      lineCount++;
+    }
+    if (lineCount < MAX_LINES) {
+      snprintf(output[lineCount], INPUT_BUFFER_SIZE, "");
+      lineCount++;
+    }
+    if (lineCount < MAX_LINES) {
+      snprintf(output[lineCount], INPUT_BUFFER_SIZE, "Type 'help' for available commands.");
+      lineCount++;
+    }
+    if (lineCount < MAX_LINES) {
+      snprintf(output[lineCount], INPUT_BUFFER_SIZE, "");
+      lineCount++;
+    }
   }
 
   const char * prompt = ">> ";
+  const char * busyPrompt = ".. ";
   bool running = true;
   SDL_Event e;
 
   // Enable text input for keyboard handling
   SDL_StartTextInput();
 
+  // Session recording / replay: --record <file>, --replay <file>, --replay-fast <file>
+  for (int i = 1; i + 1 < __argc; i++) {
+    if (strcmp(__argv[i], "--record") == 0) {
+      recorder_start(__argv[++i]);
+    } else if (strcmp(__argv[i], "--replay") == 0) {
+      replay_open(__argv[++i], false);
+    } else if (strcmp(__argv[i], "--replay-fast") == 0) {
+      if (replay_open(__argv[++i], true)) {
+        // Let frames go as fast as they can be rendered
+        SDL_RenderSetVSync(renderer, 0);
+      }
+    }
+  }
+
   printf("OCTO-Shell Emulator initialized successfully.\n");
   printf("Window size: %dx%d\n", WINDOW_WIDTH, WINDOW_HEIGHT);
   printf("Font sizes - Main: %d, Title: %d\n", FONT_SIZE, TITLE_FONT_SIZE);
@@ -263,48 +523,79 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 
   // Main application loop
   while (running && !shell_should_exit()) {
+    Uint64 loopStart = SDL_GetPerformanceCounter();
+
     // Process all pending events
     while (SDL_PollEvent( & e)) {
-      switch (e.type) {
-      case SDL_QUIT:
-        running = false;
-        break;
+      // Live keyboard and mouse input is ignored while a recording is replayed
+      if (replay_active() && e.type != SDL_QUIT && e.type != SDL_WINDOWEVENT &&
+        !(e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE))
+        continue;
 
-      case SDL_KEYDOWN:
-        if (e.key.keysym.sym == SDLK_ESCAPE) {
-          running = false;
-          break;
-        }
-        // Fall through to input handler
-      case SDL_TEXTINPUT:
-        input_handle_event( & e, inputBuffer, output, & lineCount, & cursorPos, & selection);
-        break;
+      recorder_event( & e);
+      if (!queue_event( & e, inputBuffer, output, & lineCount, & cursorPos, & selection))
+        running = false;
+    }
 
-      case SDL_MOUSEBUTTONDOWN:
-      case SDL_MOUSEBUTTONUP:
-      case SDL_MOUSEMOTION:
-        gui_handle_mouse_event( & e, output, inputBuffer, lineCount, & selection);
+    // Feed recorded input; a max-speed replay renders a frame after every event
+    while (running && replay_next_event( & e)) {
+      if (e.type == SDL_WINDOWEVENT)
+        SDL_SetWindowSize(window, e.window.data1, e.window.data2);
+      if (!queue_event( & e, inputBuffer, output, & lineCount, & cursorPos, & selection))
+        running = false;
+      if (replay_is_fast())
         break;
+    }
+    flush_pending(inputBuffer, output, & lineCount, & cursorPos, & selection);
 
-      case SDL_WINDOWEVENT:
-        if (e.window.event == SDL_WINDOWEVENT_RESIZED) {
-          printf("Window resized to: %dx%d\n", e.window.data1, e.window.data2);
-        }
-        break;
-      }
+    char replaySummary[INPUT_BUFFER_SIZE];
+    if (replay_finished(replaySummary, sizeof(replaySummary))) {
+      printf("%s\n", replaySummary);
+      shell_print(output, & lineCount, "%s", replaySummary);
+      SDL_RenderSetVSync(renderer, 1);
     }
 
+    // Pick up output streamed by the command workers; background tabs are only ingested
+    shell_poll_output(output, & lineCount);
+    control_poll(output, & lineCount);
+    session_poll();
+    input_update(inputBuffer, & cursorPos, output, & lineCount);
+
     // Render the current frame
-    gui_render(prompt, inputBuffer, output, lineCount, cursorPos, & selection);
+    Uint64 frameStart = SDL_GetPerformanceCounter();
+    gui_render(shell_busy() ? busyPrompt : prompt, inputBuffer, output, lineCount, cursorPos, & selection);
+    replay_frame_time(SDL_GetPerformanceCounter() - frameStart);
 
     // Control frame rate (~60 FPS)
-    SDL_Delay(16);
+    if (!replay_is_fast()) {
+      Uint32 delay = FRAME_INTERVAL_MS;
+      if (shell_flooding()) {
+        // Under an output flood only wait out the rest of the frame; the next drain
+        // collapses everything that arrived meanwhile into the one state that gets drawn
+        Uint32 elapsed = (Uint32)((SDL_GetPerformanceCounter() - loopStart) * 1000 / SDL_GetPerformanceFrequency());
+        delay = elapsed < FRAME_INTERVAL_MS ? FRAME_INTERVAL_MS - elapsed : 0;
+      }
+      if (delay > 0) SDL_Delay(delay);
+    }
   }
 
   printf("Shutting down OCTO-Shell Emulator...\n");
 
   // Cleanup resources
   SDL_StopTextInput();
+  control_stop();
+  if (SESSION_AUTOSAVE && !session_save(SESSION_FILE_PATH, output, lineCount)) {
+    printf("Warning: Could not save session to: %s\n", SESSION_FILE_PATH);
+  }
+  pager_close();
+  histsearch_close();
+  recorder_stop();
+  session_cleanup();
+  shell_cleanup();
+  threadpool_shutdown();
+  layout_cleanup();
+  complete_cleanup();
+  history_cleanup();
   gui_cleanup();
 
   if (titleFont && titleFont != font) {
@@ -312,10 +603,9 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     printf("Title font resources freed.\n");
   }
 
-  if (font) {
-    TTF_CloseFont(font);
-    printf("Main font resources freed.\n");
-  }
+  // Every size the main font was zoomed to, FONT_SIZE included
+  font_cleanup();
+  printf("Main font resources freed.\n");
 
   if (renderer) {
     SDL_DestroyRenderer(renderer);
@@ -0,0 +1,141 @@
+#include <string.h>
+
+#include <stdlib.h>
+
+#include <stdio.h>
+
+#include "mapfile.h"
+
+bool mapfile_open(MappedFile * file, const char * path) {
+  if (!file || !path) return false;
+
+  memset(file, 0, sizeof( * file));
+  file -> file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+    NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file -> file == INVALID_HANDLE_VALUE) return false;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file -> file, & size)) {
+    mapfile_close(file);
+    return false;
+  }
+  file -> size = (size_t) size.QuadPart;
+
+  // An empty file cannot be mapped; it simply has no lines
+  if (file -> size == 0) return true;
+
+  file -> mapping = CreateFileMappingA(file -> file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (file -> mapping) {
+    file -> data = (const char * ) MapViewOfFile(file -> mapping, FILE_MAP_READ, 0, 0, 0);
+  }
+  if (!file -> data) {
+    mapfile_close(file);
+    return false;
+  }
+  return true;
+}
+
+// Wraps a heap buffer so text can be indexed like a file; takes ownership of data
+bool mapfile_open_memory(MappedFile * file, char * data, size_t size) {
+  if (!file) return false;
+
+  memset(file, 0, sizeof( * file));
+  file -> file = INVALID_HANDLE_VALUE;
+  file -> data = data;
+  file -> size = data ? size : 0;
+  file -> ownsData = true;
+  return true;
+}
+
+void mapfile_close(MappedFile * file) {
+  if (!file) return;
+
+  if (file -> ownsData) {
+    free((void * ) file -> data);
+  } else if (file -> data) {
+    UnmapViewOfFile(file -> data);
+  }
+  if (file -> mapping) CloseHandle(file -> mapping);
+  if (file -> file && file -> file != INVALID_HANDLE_VALUE) CloseHandle(file -> file);
+  free(file -> lineStarts);
+  memset(file, 0, sizeof( * file));
+  file -> file = INVALID_HANDLE_VALUE;
+}
+
+static bool mapfile_push_line(MappedFile * file, size_t start) {
+  if (file -> lineCount == file -> lineCapacity) {
+    size_t capacity = file -> lineCapacity ? file -> lineCapacity * 2 : 4096;
+    size_t * grown = (size_t * ) realloc(file -> lineStarts, capacity * sizeof(size_t));
+    if (!grown) return false;
+    file -> lineStarts = grown;
+    file -> lineCapacity = capacity;
+  }
+  file -> lineStarts[file -> lineCount++] = start;
+  return true;
+}
+
+// Scans up to maxBytes further; false once the whole file is indexed
+bool mapfile_index_step(MappedFile * file, size_t maxBytes) {
+  if (!file || mapfile_index_complete(file)) return false;
+
+  if (file -> lineCount == 0 && !mapfile_push_line(file, 0)) return false;
+
+  size_t end = file -> indexedBytes + maxBytes;
+  if (end > file -> size || end < file -> indexedBytes) end = file -> size;
+
+  const char * cursor = file -> data + file -> indexedBytes;
+  const char * limit = file -> data + end;
+  while (cursor < limit) {
+    const char * newline = (const char * ) memchr(cursor, '\n', (size_t)(limit - cursor));
+    if (!newline) {
+      cursor = limit;
+      break;
+    }
+    cursor = newline + 1;
+
+    // A trailing newline does not start another line
+    size_t start = (size_t)(cursor - file -> data);
+    if (start < file -> size && !mapfile_push_line(file, start)) {
+      file -> indexedBytes = start - 1;
+      return false;
+    }
+  }
+
+  file -> indexedBytes = (size_t)(cursor - file -> data);
+  return !mapfile_index_complete(file);
+}
+
+bool mapfile_index_complete(const MappedFile * file) {
+  return file -> indexedBytes >= file -> size;
+}
+
+// Text of an indexed line without its line terminator
+bool mapfile_line(const MappedFile * file, size_t line, const char ** text, size_t * length) {
+  if (!file || line >= file -> lineCount) return false;
+
+  // The last indexed line may still be growing until the index reaches its newline
+  if (line + 1 == file -> lineCount && !mapfile_index_complete(file)) return false;
+
+  size_t start = file -> lineStarts[line];
+  size_t end = line + 1 < file -> lineCount ? file -> lineStarts[line + 1] : file -> size;
+  if (end > start && file -> data[end - 1] == '\n') end--;
+  if (end > start && file -> data[end - 1] == '\r') end--;
+
+  * text = file -> data + start;
+  * length = end - start;
+  return true;
+}
+
+// Byte offset where the last `lines` lines begin, found by scanning backwards
+size_t mapfile_tail_start(const MappedFile * file, size_t lines) {
+  if (!file || !file -> data || file -> size == 0 || lines == 0) return file ? file -> size : 0;
+
+  size_t position = file -> size;
+  if (file -> data[position - 1] == '\n') position--;
+
+  while (position > 0) {
+    if (file -> data[position - 1] == '\n' && --lines == 0) return position;
+    position--;
+  }
+  return 0;
+}
@@ -0,0 +1,235 @@
+#include <string.h>
+
+#include <stdlib.h>
+
+#include <stdint.h>
+
+#include <SDL.h>
+
+#include <SDL_ttf.h>
+
+#include "config.h"
+
+#include "metrics.h"
+
+#include "utf8.h"
+
+#define LINE_CACHE_SLOTS 256
+#define GLYPH_CACHE_SLOTS 1024
+
+// Cached pixel offsets of every byte boundary in one line of text
+typedef struct {
+  const char * text;
+  Uint32 version;
+  TTF_Font * font;
+  int length;
+  int capacity;
+  bool ascii;   // No multibyte characters, so every byte is a boundary
+  int * prefix; // prefix[k] = width in pixels of the first k bytes; bytes inside a character repeat its start
+} LineOffsets;
+
+// Advance of one non-ASCII codepoint (codepoint 0 marks an empty slot)
+typedef struct {
+  Uint32 codepoint;
+  int advance;
+} GlyphAdvance;
+
+// Advances measured for one font; the last few fonts keep theirs so switching back needs no measuring
+typedef struct {
+  bool used;
+  TTF_Font * font;
+  Uint32 lastUsed;
+  int advance[128];
+  int charWidth;
+  GlyphAdvance glyphs[GLYPH_CACHE_SLOTS];
+} FontMetrics;
+
+static FontMetrics fontMetrics[FONT_ZOOM_CACHED_SIZES];
+static FontMetrics * gMetrics = NULL; // Tables of the current font
+static Uint32 gMetricsClock = 0;
+
+static LineOffsets lineCache[LINE_CACHE_SLOTS];
+
+static void metrics_measure(FontMetrics * metrics, TTF_Font * font) {
+  // Kerning would make rendered widths differ from the sum of advances
+  if (font) TTF_SetFontKerning(font, 0);
+
+  metrics -> used = true;
+  metrics -> font = font;
+  memset(metrics -> glyphs, 0, sizeof(metrics -> glyphs));
+  for (int c = 0; c < 128; c++) {
+    int advance = 0;
+    if (!font || TTF_GlyphMetrics(font, (Uint16) c, NULL, NULL, NULL, NULL, & advance) != 0) {
+      advance = 8;
+    }
+    metrics -> advance[c] = advance;
+  }
+
+  metrics -> charWidth = font ? metrics -> advance['W'] : 8;
+  if (metrics -> charWidth <= 0) metrics -> charWidth = 8;
+}
+
+void metrics_set_font(TTF_Font * font) {
+  if (gMetrics && gMetrics -> font == font) return;
+
+  FontMetrics * slot = NULL;
+  for (int i = 0; i < FONT_ZOOM_CACHED_SIZES && !slot; i++) {
+    if (fontMetrics[i].used && fontMetrics[i].font == font) slot = & fontMetrics[i];
+  }
+  if (!slot) {
+    // Measure into an empty slot, or the one used longest ago
+    slot = & fontMetrics[0];
+    for (int i = 0; i < FONT_ZOOM_CACHED_SIZES && slot -> used; i++) {
+      if (!fontMetrics[i].used || fontMetrics[i].lastUsed < slot -> lastUsed) slot = & fontMetrics[i];
+    }
+    metrics_measure(slot, font);
+  }
+  slot -> lastUsed = ++gMetricsClock;
+  gMetrics = slot;
+}
+
+// Drops everything measured with a font about to be closed; a later font may reuse its address
+void metrics_forget_font(TTF_Font * font) {
+  for (int i = 0; i < FONT_ZOOM_CACHED_SIZES; i++) {
+    if (!fontMetrics[i].used || fontMetrics[i].font != font) continue;
+    if (gMetrics == & fontMetrics[i]) gMetrics = NULL;
+    fontMetrics[i].used = false;
+  }
+  for (int i = 0; i < LINE_CACHE_SLOTS; i++) {
+    if (lineCache[i].font == font) lineCache[i].text = NULL;
+  }
+}
+
+int metrics_char_width(void) {
+  return gMetrics ? gMetrics -> charWidth : 8;
+}
+
+// Advance of a non-ASCII codepoint, asked of the font once and then cached
+static int metrics_glyph_advance(Uint32 codepoint) {
+  GlyphAdvance * slot = & gMetrics -> glyphs[(codepoint * 2654435761u) % GLYPH_CACHE_SLOTS];
+  if (slot -> codepoint == codepoint) return slot -> advance;
+
+  int advance = 0;
+  if (!gMetrics -> font || TTF_GlyphMetrics32(gMetrics -> font, codepoint, NULL, NULL, NULL, NULL, & advance) != 0) {
+    advance = utf8_width(codepoint) * gMetrics -> charWidth;
+  }
+  slot -> codepoint = codepoint;
+  slot -> advance = advance;
+  return advance;
+}
+
+// Length of an ANSI escape sequence starting at text, 0 if there is none
+int metrics_escape_length(const char * text, int remaining) {
+  if (remaining < 2 || text[0] != '\033' || text[1] != '[') return 0;
+  for (int i = 2; i < remaining; i++) {
+    if (text[i] >= 0x40 && text[i] <= 0x7E) return i + 1;
+  }
+  return remaining;
+}
+
+static const LineOffsets * metrics_lookup(const char * text, Uint32 version) {
+  if (!gMetrics) metrics_set_font(NULL);
+  const int * advance = gMetrics -> advance;
+
+  uintptr_t key = (uintptr_t) text;
+  key ^= key >> 11;
+  key ^= (uintptr_t) version * 2654435761u;
+  LineOffsets * entry = & lineCache[key % LINE_CACHE_SLOTS];
+
+  if (entry -> text == text && entry -> version == version && entry -> font == gMetrics -> font)
+    return entry;
+
+  int length = (int) strnlen(text, INPUT_BUFFER_SIZE - 1);
+  if (length + 1 > entry -> capacity) {
+    int * grown = (int * ) realloc(entry -> prefix, (length + 1) * sizeof(int));
+    if (!grown) return NULL;
+    entry -> prefix = grown;
+    entry -> capacity = length + 1;
+  }
+
+  // Escape sequences are stripped when rendering, so they take no space
+  int x = 0;
+  entry -> prefix[0] = 0;
+  entry -> ascii = utf8_is_ascii(text, length);
+  for (int i = 0; i < length;) {
+    int escape = metrics_escape_length(text + i, length - i);
+    if (escape > 0) {
+      for (int k = 0; k < escape; k++) entry -> prefix[++i] = x;
+      continue;
+    }
+    if (entry -> ascii) {
+      x += advance[(unsigned char) text[i]];
+      entry -> prefix[++i] = x;
+      continue;
+    }
+
+    Uint32 codepoint;
+    int bytes = utf8_decode(text + i, length - i, & codepoint);
+    for (int k = 1; k < bytes; k++) entry -> prefix[++i] = x;
+    x += codepoint < 128 ? advance[codepoint] : metrics_glyph_advance(codepoint);
+    entry -> prefix[++i] = x;
+  }
+
+  entry -> text = text;
+  entry -> version = version;
+  entry -> font = gMetrics -> font;
+  entry -> length = length;
+  return entry;
+}
+
+int metrics_line_length(const char * text, Uint32 version) {
+  if (!text) return 0;
+  const LineOffsets * entry = metrics_lookup(text, version);
+  return entry ? entry -> length : (int) strlen(text);
+}
+
+int metrics_offset_to_x(const char * text, Uint32 version, int offset) {
+  if (!text || offset <= 0) return 0;
+  const LineOffsets * entry = metrics_lookup(text, version);
+  if (!entry) return offset * metrics_char_width();
+  if (offset > entry -> length) offset = entry -> length;
+  return entry -> prefix[offset];
+}
+
+// Binary search for the character boundary nearest to x
+int metrics_x_to_offset(const char * text, Uint32 version, int x) {
+  if (!text || x <= 0) return 0;
+  const LineOffsets * entry = metrics_lookup(text, version);
+  if (!entry) return x / metrics_char_width();
+
+  const int * prefix = entry -> prefix;
+  int low = 0;
+  int high = entry -> length;
+  if (x >= prefix[high]) return high;
+
+  while (high - low > 1) {
+    int mid = (low + high) / 2;
+    if (prefix[mid] <= x) {
+      low = mid;
+    } else {
+      high = mid;
+    }
+  }
+
+  // Inside a multibyte character the offsets repeat its start, so step back to it
+  if (!entry -> ascii) low = utf8_boundary(text, low);
+  return (x - prefix[low] < prefix[high] - x) ? low : high;
+}
+
+// Version key for text that has no generation of its own (e.g. the input line)
+Uint32 metrics_text_version(const char * text) {
+  Uint32 hash = 2166136261u;
+  for (const unsigned char * p = (const unsigned char * ) text; p && * p; p++) {
+    hash = (hash ^ * p) * 16777619u;
+  }
+  return hash;
+}
+
+void metrics_cleanup(void) {
+  for (int i = 0; i < LINE_CACHE_SLOTS; i++) {
+    free(lineCache[i].prefix);
+  }
+  memset(lineCache, 0, sizeof(lineCache));
+  memset(fontMetrics, 0, sizeof(fontMetrics));
+  gMetrics = NULL;
+}
@@ -0,0 +1,429 @@
+#include <string.h>
+
+#include <stdlib.h>
+
+#include <stdio.h>
+
+#include "config.h"
+
+#include "pager.h"
+
+#include "mapfile.h"
+
+#include "metrics.h"
+
+#include "scrollback.h"
+
+#include "shell.h"
+
+// Paged source; only the rows on screen are ever laid out
+static MappedFile gSource;
+static bool gActive = false;
+static char gTitle[256];
+static size_t gTop = 0;      // Byte offset of the first visible line, or its index when paging lines
+static int gVisibleRows = 1;
+
+// Line source: the archived scrollback followed by a copy of the output when it was opened
+static bool gLineSource = false;
+static size_t gArchivedLines = 0;
+static char( * gTail)[INPUT_BUFFER_SIZE] = NULL;
+static int gTailLines = 0;
+static bool gOpenAtEnd = false; // Jump to the last page once the page height is known
+static char gRowText[PAGER_MAX_ROWS][INPUT_BUFFER_SIZE];
+
+// Search state; a search advances a bounded number of bytes per frame
+static char gQuery[INPUT_BUFFER_SIZE];
+static int gQueryLength = 0;
+static bool gEditingQuery = false;
+static bool gSearching = false;
+static size_t gSearchPos = 0;
+static const char * gNotice = NULL;
+
+static char gStatus[INPUT_BUFFER_SIZE];
+
+static size_t pager_end(void) {
+  return gLineSource ? gArchivedLines + (size_t) gTailLines : gSource.size;
+}
+
+// Copies a line of the line source into buffer with colour codes removed
+static int pager_source_line(size_t line, char * buffer) {
+  const char * text = "";
+  int length = 0;
+  if (line < gArchivedLines) {
+    if (!scrollback_line(shell_scrollback(), line, & text, & length)) length = 0;
+  } else if (line - gArchivedLines < (size_t) gTailLines) {
+    text = gTail[line - gArchivedLines];
+    length = (int) strnlen(text, INPUT_BUFFER_SIZE - 1);
+  }
+  if (length > INPUT_BUFFER_SIZE - 1) length = INPUT_BUFFER_SIZE - 1;
+
+  int used = 0;
+  for (int k = 0; k < length;) {
+    int escape = metrics_escape_length(text + k, length - k);
+    if (escape > 0) {
+      k += escape;
+      continue;
+    }
+    buffer[used++] = text[k++];
+  }
+  buffer[used] = '\0';
+  return used;
+}
+
+static size_t pager_next_line(size_t offset) {
+  if (gLineSource) return offset < pager_end() ? offset + 1 : pager_end();
+  if (offset >= gSource.size) return gSource.size;
+  const char * newline = (const char * ) memchr(gSource.data + offset, '\n', gSource.size - offset);
+  return newline ? (size_t)(newline - gSource.data) + 1 : gSource.size;
+}
+
+static size_t pager_line_start(size_t offset) {
+  if (gLineSource) return offset;
+  while (offset > 0 && gSource.data[offset - 1] != '\n') offset--;
+  return offset;
+}
+
+static size_t pager_previous_line(size_t offset) {
+  return offset > 0 ? pager_line_start(offset - 1) : 0;
+}
+
+// Top offset that shows the last page of the source
+static size_t pager_last_top(void) {
+  if (gLineSource) return pager_end() > (size_t) gVisibleRows ? pager_end() - (size_t) gVisibleRows : 0;
+  return mapfile_tail_start( & gSource, (size_t) gVisibleRows);
+}
+
+static void pager_scroll(int lines) {
+  if (lines > 0) {
+    size_t limit = pager_last_top();
+    for (int i = 0; i < lines && gTop < limit; i++) gTop = pager_next_line(gTop);
+    if (gTop > limit) gTop = limit;
+  } else {
+    for (int i = 0; i < -lines && gTop > 0; i++) gTop = pager_previous_line(gTop);
+  }
+}
+
+static bool pager_open(const char * title) {
+  strncpy(gTitle, title, sizeof(gTitle) - 1);
+  gTitle[sizeof(gTitle) - 1] = '\0';
+  gTop = 0;
+  gEditingQuery = false;
+  gSearching = false;
+  gNotice = NULL;
+  gActive = true;
+  return true;
+}
+
+bool pager_open_file(const char * path) {
+  if (!path) return false;
+
+  pager_close();
+  if (!mapfile_open( & gSource, path)) return false;
+  return pager_open(path);
+}
+
+// Pages a copy of captured command output
+bool pager_open_text(const char * text, size_t length, const char * title) {
+  pager_close();
+
+  char * copy = (char * ) malloc(length > 0 ? length : 1);
+  if (!copy) return false;
+  if (length > 0) memcpy(copy, text, length);
+
+  mapfile_open_memory( & gSource, copy, length);
+  return pager_open(title ? title : "(output)");
+}
+
+// Pages the whole session: archived scrollback first, then the current output
+bool pager_open_scrollback(char output[][INPUT_BUFFER_SIZE], int lineCount) {
+  pager_close();
+
+  if (lineCount > 0) {
+    gTail = malloc((size_t) lineCount * INPUT_BUFFER_SIZE);
+    if (!gTail) return false;
+    memcpy(gTail, output, (size_t) lineCount * INPUT_BUFFER_SIZE);
+  }
+  gTailLines = lineCount > 0 ? lineCount : 0;
+  gArchivedLines = scrollback_line_count(shell_scrollback());
+  gLineSource = true;
+
+  pager_open("(scrollback)");
+  gOpenAtEnd = true;
+  return true;
+}
+
+bool pager_active(void) {
+  return gActive;
+}
+
+void pager_close(void) {
+  if (gActive && !gLineSource) mapfile_close( & gSource);
+  free(gTail);
+  gTail = NULL;
+  gTailLines = 0;
+  gLineSource = false;
+  gOpenAtEnd = false;
+  gActive = false;
+  gSearching = false;
+  gEditingQuery = false;
+}
+
+static void pager_start_search(size_t from) {
+  if (gQueryLength == 0) return;
+  gSearchPos = from;
+  gSearching = true;
+  gNotice = NULL;
+}
+
+static void pager_handle_key(SDL_Keycode key) {
+  if (gEditingQuery) {
+    if (key == SDLK_RETURN || key == SDLK_KP_ENTER) {
+      gEditingQuery = false;
+      pager_start_search(pager_next_line(gTop));
+    } else if (key == SDLK_ESCAPE) {
+      gEditingQuery = false;
+    } else if (key == SDLK_BACKSPACE && gQueryLength > 0) {
+      gQuery[--gQueryLength] = '\0';
+    }
+    return;
+  }
+
+  switch (key) {
+  case SDLK_ESCAPE:
+    if (gSearching) {
+      gSearching = false;
+    } else {
+      pager_close();
+    }
+    break;
+  case SDLK_UP:
+    pager_scroll(-1);
+    break;
+  case SDLK_DOWN:
+  case SDLK_RETURN:
+  case SDLK_KP_ENTER:
+    pager_scroll(1);
+    break;
+  case SDLK_PAGEUP:
+    pager_scroll(-gVisibleRows);
+    break;
+  case SDLK_PAGEDOWN:
+    pager_scroll(gVisibleRows);
+    break;
+  case SDLK_HOME:
+    gTop = 0;
+    break;
+  case SDLK_END:
+    gTop = pager_last_top();
+    break;
+  }
+}
+
+// less-style single-letter commands arrive as text so that 'G' and 'g' differ
+static void pager_handle_text(const char * text) {
+  if (gEditingQuery) {
+    for (const char * p = text; * p && gQueryLength < (int) sizeof(gQuery) - 1; p++) {
+      if ((unsigned char) * p >= 32 && (unsigned char) * p <= 126) gQuery[gQueryLength++] = * p;
+    }
+    gQuery[gQueryLength] = '\0';
+    return;
+  }
+
+  switch (text[0]) {
+  case 'q':
+    pager_close();
+    break;
+  case 'j':
+    pager_scroll(1);
+    break;
+  case 'k':
+    pager_scroll(-1);
+    break;
+  case ' ':
+  case 'f':
+    pager_scroll(gVisibleRows);
+    break;
+  case 'b':
+    pager_scroll(-gVisibleRows);
+    break;
+  case 'g':
+    gTop = 0;
+    break;
+  case 'G':
+    gTop = pager_last_top();
+    break;
+  case '/':
+    gEditingQuery = true;
+    gQueryLength = 0;
+    gQuery[0] = '\0';
+    break;
+  case 'n':
+    pager_start_search(pager_next_line(gTop));
+    break;
+  }
+}
+
+void pager_handle_event(const SDL_Event * e) {
+  if (!gActive || !e) return;
+
+  switch (e -> type) {
+  case SDL_KEYDOWN:
+    pager_handle_key(e -> key.keysym.sym);
+    break;
+  case SDL_TEXTINPUT:
+    pager_handle_text(e -> text.text);
+    break;
+  case SDL_MOUSEWHEEL:
+    pager_scroll(-e -> wheel.y * 3);
+    break;
+  }
+}
+
+// Line search over the line source; compressed blocks are expanded as it reaches them
+static bool pager_search_lines(size_t budget, size_t * found) {
+  char text[INPUT_BUFFER_SIZE];
+  size_t end = pager_end();
+  for (size_t scanned = 0; gSearchPos < end && scanned < budget; gSearchPos++) {
+    scanned += (size_t) pager_source_line(gSearchPos, text) + 1;
+    if (strstr(text, gQuery)) {
+      * found = gSearchPos;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Next occurrence of the query at or after from, scanning at most budget bytes
+static bool pager_search_step(size_t budget, size_t * found) {
+  if (gLineSource) return pager_search_lines(budget, found);
+
+  size_t length = (size_t) gQueryLength;
+  if (length > gSource.size) {
+    gSearchPos = gSource.size;
+    return false;
+  }
+
+  size_t end = gSearchPos + budget;
+  if (end > gSource.size || end < gSearchPos) end = gSource.size;
+
+  const char * p = gSource.data + gSearchPos;
+  const char * limit = gSource.data + end;
+  const char * last = gSource.data + gSource.size - length;
+  while (p < limit && p <= last) {
+    p = (const char * ) memchr(p, gQuery[0], (size_t)(limit - p));
+    if (!p || p > last) break;
+    if (memcmp(p, gQuery, length) == 0) {
+      * found = (size_t)(p - gSource.data);
+      return true;
+    }
+    p++;
+  }
+
+  gSearchPos = end;
+  return false;
+}
+
+// Per-frame work: extend the line index and advance a running search
+void pager_update(int visibleRows) {
+  if (!gActive) return;
+  gVisibleRows = visibleRows > 1 ? visibleRows : 1;
+  if (gOpenAtEnd) {
+    gTop = pager_last_top();
+    gOpenAtEnd = false;
+  }
+
+  if (!gLineSource) mapfile_index_step( & gSource, PAGER_INDEX_BYTES_PER_FRAME);
+
+  if (gSearching) {
+    size_t found;
+    if (pager_search_step(gLineSource ? SCROLLBACK_SEARCH_BYTES_PER_FRAME : PAGER_SEARCH_BYTES_PER_FRAME, & found)) {
+      gSearching = false;
+      gTop = pager_line_start(found);
+      size_t limit = pager_last_top();
+      if (gTop > limit) gTop = limit;
+    } else if (gSearchPos >= pager_end()) {
+      gSearching = false;
+      gNotice = "Pattern not found";
+    }
+  }
+}
+
+int pager_rows(PagerRow * rows, int maxRows) {
+  if (!gActive || !rows) return 0;
+
+  int count = 0;
+  if (gLineSource) {
+    for (size_t line = gTop; count < maxRows && count < PAGER_MAX_ROWS && line < pager_end(); line++) {
+      rows[count].length = pager_source_line(line, gRowText[count]);
+      rows[count].text = gRowText[count];
+      count++;
+    }
+    return count;
+  }
+
+  size_t offset = gTop;
+  while (count < maxRows && offset < gSource.size) {
+    size_t next = pager_next_line(offset);
+    size_t end = next;
+    if (end > offset && gSource.data[end - 1] == '\n') end--;
+    if (end > offset && gSource.data[end - 1] == '\r') end--;
+
+    rows[count].text = gSource.data + offset;
+    rows[count].length = (int)(end - offset < INPUT_BUFFER_SIZE - 1 ? end - offset : INPUT_BUFFER_SIZE - 1);
+    count++;
+    offset = next;
+  }
+  return count;
+}
+
+// Query whose matches are highlighted, or NULL
+const char * pager_query(void) {
+  return gActive && gQueryLength > 0 && !gEditingQuery ? gQuery : NULL;
+}
+
+// Line index into the indexed part of the source, or 0 when not indexed yet
+static size_t pager_top_line(void) {
+  if (gLineSource) return gTop + 1;
+  if (gTop >= gSource.indexedBytes && !mapfile_index_complete( & gSource)) return 0;
+
+  size_t low = 0;
+  size_t high = gSource.lineCount;
+  while (low + 1 < high) {
+    size_t middle = (low + high) / 2;
+    if (gSource.lineStarts[middle] <= gTop) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+  return low + 1;
+}
+
+const char * pager_status(void) {
+  if (!gActive) return "";
+
+  if (gEditingQuery) {
+    snprintf(gStatus, sizeof(gStatus), "/%s", gQuery);
+    return gStatus;
+  }
+
+  // Like less, the percentage is measured at the bottom of the screen
+  size_t bottom = gTop;
+  for (int i = 0; i < gVisibleRows; i++) bottom = pager_next_line(bottom);
+  int percent = pager_end() > 0 ? (int)((double) bottom * 100.0 / pager_end()) : 100;
+  size_t line = pager_top_line();
+  char position[96];
+  if (gLineSource) {
+    snprintf(position, sizeof(position), "line %zu of %zu", line, pager_end());
+  } else if (line > 0 && mapfile_index_complete( & gSource)) {
+    snprintf(position, sizeof(position), "line %zu of %zu", line, gSource.lineCount);
+  } else if (line > 0) {
+    snprintf(position, sizeof(position), "line %zu of %zu+", line, gSource.lineCount);
+  } else {
+    snprintf(position, sizeof(position), "line ?");
+  }
+
+  snprintf(gStatus, sizeof(gStatus), "%s  %s  %d%%  %s", gTitle, position, percent,
+    gSearching ? "searching..." : gNotice ? gNotice : "(q to quit, / to search)");
+  return gStatus;
+}
@@ -0,0 +1,225 @@
+#include <string.h>
+
+#include <limits.h>
+
+#include "pane.h"
+
+#include "session.h"
+
+// The window is a tree of splits whose leaves are the panes
+typedef struct {
+  bool used;
+  bool leaf;
+  PaneSplit split;   // Inner nodes: how the two children share the area
+  int children[2];
+  int parent;
+  int session;       // Leaves: id of the tab shown
+  SDL_Rect viewport; // Leaves: where the pane was last laid out
+}
+PaneNode;
+
+static PaneNode gNodes[PANE_NODES];
+static int gRoot = -1;
+static int gFocus = -1; // Leaf showing the active tab
+static int gLeaves = 0;
+
+static int pane_alloc(void) {
+  for (int i = 0; i < PANE_NODES; i++) {
+    if (!gNodes[i].used) {
+      memset( & gNodes[i], 0, sizeof(gNodes[i]));
+      gNodes[i].used = true;
+      gNodes[i].leaf = true;
+      gNodes[i].parent = -1;
+      return i;
+    }
+  }
+  return -1;
+}
+
+// The focused pane always shows the active tab
+static void pane_sync(void) {
+  if (gFocus >= 0) gNodes[gFocus].session = session_id(session_active_index());
+}
+
+static int pane_showing(int id) {
+  for (int i = 0; i < PANE_NODES; i++) {
+    if (gNodes[i].used && gNodes[i].leaf && gNodes[i].session == id) return i;
+  }
+  return -1;
+}
+
+// Starts with one pane showing the active tab; run after the first session_open()
+void pane_init(void) {
+  memset(gNodes, 0, sizeof(gNodes));
+  gRoot = gFocus = pane_alloc();
+  gLeaves = 1;
+  pane_sync();
+}
+
+// Opens a tab in a new pane beside or below the focused one and focuses it
+bool pane_split(PaneSplit split) {
+  if (gFocus < 0 || gLeaves >= PANE_MAX) return false;
+
+  int kept = pane_alloc();
+  int added = pane_alloc();
+  if (kept < 0 || added < 0 || !session_open()) {
+    if (kept >= 0) gNodes[kept].used = false;
+    if (added >= 0) gNodes[added].used = false;
+    return false;
+  }
+
+  // The focused leaf becomes the split, keeping its tab in the first half
+  PaneNode * node = & gNodes[gFocus];
+  gNodes[kept].session = node -> session;
+  gNodes[kept].parent = gFocus;
+  gNodes[added].session = session_id(session_active_index());
+  gNodes[added].parent = gFocus;
+  node -> leaf = false;
+  node -> split = split;
+  node -> children[0] = kept;
+  node -> children[1] = added;
+
+  gFocus = added;
+  gLeaves++;
+  return true;
+}
+
+// Closes the focused tab, and its pane unless that is the last one
+bool pane_close(void) {
+  if (gFocus < 0) return false;
+  if (gLeaves == 1) {
+    bool closed = session_close();
+    pane_sync();
+    return closed;
+  }
+  if (!session_close()) return false;
+
+  // The other half of the split takes its place
+  int parent = gNodes[gFocus].parent;
+  int sibling = gNodes[parent].children[0] == gFocus ? gNodes[parent].children[1] : gNodes[parent].children[0];
+  int grandparent = gNodes[parent].parent;
+  gNodes[sibling].parent = grandparent;
+  if (grandparent < 0) {
+    gRoot = sibling;
+  } else {
+    int side = gNodes[grandparent].children[0] == parent ? 0 : 1;
+    gNodes[grandparent].children[side] = sibling;
+  }
+  gNodes[gFocus].used = false;
+  gNodes[parent].used = false;
+  gLeaves--;
+
+  gFocus = sibling;
+  while (!gNodes[gFocus].leaf) gFocus = gNodes[gFocus].children[0];
+  int index = session_find(gNodes[gFocus].session);
+  if (index < 0 || !session_activate(index)) pane_sync();
+  return true;
+}
+
+// Opens a tab in the focused pane; the tab it showed carries on in the background
+bool pane_new_tab(void) {
+  if (!session_open()) return false;
+  pane_sync();
+  return true;
+}
+
+// Shows a tab, focusing the pane it is already in or else putting it in the focused pane
+bool pane_show_session(int index) {
+  if (gFocus < 0 || index < 0 || index >= session_count()) return false;
+
+  int shown = pane_showing(session_id(index));
+  if (shown >= 0) {
+    gFocus = shown;
+  } else {
+    gNodes[gFocus].session = session_id(index);
+  }
+  session_activate(index);
+  return true;
+}
+
+static bool pane_contains(const SDL_Rect * rect, int x, int y) {
+  return x >= rect -> x && x < rect -> x + rect -> w && y >= rect -> y && y < rect -> y + rect -> h;
+}
+
+// Focuses the pane under a click; true when focus moved
+bool pane_focus_at(int x, int y) {
+  for (int i = 0; i < PANE_NODES; i++) {
+    if (i != gFocus && gNodes[i].used && gNodes[i].leaf && pane_contains( & gNodes[i].viewport, x, y))
+      return pane_show_session(session_find(gNodes[i].session));
+  }
+  return false;
+}
+
+// Focuses the nearest pane in a direction, e.g. (1, 0) for the one to the right
+bool pane_focus_toward(int dx, int dy) {
+  if (gFocus < 0) return false;
+
+  const SDL_Rect * from = & gNodes[gFocus].viewport;
+  int fromX = from -> x + from -> w / 2;
+  int fromY = from -> y + from -> h / 2;
+  int best = -1;
+  long bestDistance = LONG_MAX;
+  for (int i = 0; i < PANE_NODES; i++) {
+    if (i == gFocus || !gNodes[i].used || !gNodes[i].leaf) continue;
+    const SDL_Rect * to = & gNodes[i].viewport;
+    bool ahead = (dx > 0 && to -> x >= from -> x + from -> w) || (dx < 0 && to -> x + to -> w <= from -> x) ||
+      (dy > 0 && to -> y >= from -> y + from -> h) || (dy < 0 && to -> y + to -> h <= from -> y);
+    if (!ahead) continue;
+
+    long offsetX = to -> x + to -> w / 2 - fromX;
+    long offsetY = to -> y + to -> h / 2 - fromY;
+    long distance = offsetX * offsetX + offsetY * offsetY;
+    if (distance < bestDistance) {
+      best = i;
+      bestDistance = distance;
+    }
+  }
+  return best >= 0 && pane_show_session(session_find(gNodes[best].session));
+}
+
+static int pane_layout(int node, SDL_Rect area, PaneView * views, int count) {
+  PaneNode * pane = & gNodes[node];
+  if (pane -> leaf) {
+    pane -> viewport = area;
+    int index = session_find(pane -> session);
+    if (index < 0 || node == gFocus) {
+      index = session_active_index();
+      pane -> session = session_id(index);
+    }
+    views[count].id = node;
+    views[count].viewport = area;
+    views[count].session = index;
+    views[count].focused = node == gFocus;
+    return count + 1;
+  }
+
+  SDL_Rect first = area;
+  SDL_Rect second = area;
+  if (pane -> split == PANE_SPLIT_RIGHT) {
+    first.w = (area.w - PANE_GAP) / 2;
+    second.x = area.x + first.w + PANE_GAP;
+    second.w = area.w - first.w - PANE_GAP;
+  } else {
+    first.h = (area.h - PANE_GAP) / 2;
+    second.y = area.y + first.h + PANE_GAP;
+    second.h = area.h - first.h - PANE_GAP;
+  }
+  count = pane_layout(pane -> children[0], first, views, count);
+  return pane_layout(pane -> children[1], second, views, count);
+}
+
+// Lays the panes out in area; views needs room for PANE_MAX. Returns how many there are.
+int pane_views(SDL_Rect area, PaneView * views) {
+  if (gRoot < 0) {
+    views[0].id = 0;
+    views[0].viewport = area;
+    views[0].session = session_active_index();
+    views[0].focused = true;
+    return 1;
+  }
+  return pane_layout(gRoot, area, views, 0);
+}
+
+int pane_count(void) {
+  return gRoot < 0 ? 1 : gLeaves;
+}
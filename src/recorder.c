@@ -0,0 +1,337 @@
+#include <string.h>
+
+#include <stdio.h>
+
+#include <stdint.h>
+
+#include <stdbool.h>
+
+#include <SDL.h>
+
+#include "config.h"
+
+#include "recorder.h"
+
+#define RECORD_MAGIC "OCTOREC"
+#define RECORD_VERSION 1
+
+// Record kinds; each record is kind (1 byte), time in ms (4), payload length (2), payload
+enum {
+  REC_KEYDOWN = 1,
+  REC_TEXTINPUT,
+  REC_MOUSE,
+  REC_RESIZE,
+  REC_OUTPUT
+};
+
+#define REC_HEADER_SIZE 7
+#define REC_MAX_PAYLOAD INPUT_BUFFER_SIZE
+
+static FILE * gRecordFile = NULL;
+static Uint32 gRecordStart = 0;
+
+static FILE * gReplayFile = NULL;
+static bool gReplayFast = false;
+static bool gReplayDone = false;
+static bool gReplayReported = true;
+static Uint32 gReplayStart = 0;
+static Uint64 gReplayCounterStart = 0;
+static Uint64 gReplayCounterEnd = 0;
+
+static SDL_Event gPending;
+static Uint32 gPendingTime = 0;
+static bool gHavePending = false;
+
+static int gEventsReplayed = 0;
+static int gFramesRendered = 0;
+static Uint64 gFrameTicksTotal = 0;
+static Uint64 gFrameTicksMax = 0;
+
+// Output produced during the replay vs. output captured in the log
+static Uint32 gExpectedHash = 2166136261u;
+static Uint32 gProducedHash = 2166136261u;
+static int gExpectedLines = 0;
+static int gProducedLines = 0;
+
+static void put_u16(Uint8 * p, Uint16 v) {
+  p[0] = (Uint8) v;
+  p[1] = (Uint8)(v >> 8);
+}
+
+static void put_u32(Uint8 * p, Uint32 v) {
+  p[0] = (Uint8) v;
+  p[1] = (Uint8)(v >> 8);
+  p[2] = (Uint8)(v >> 16);
+  p[3] = (Uint8)(v >> 24);
+}
+
+static Uint16 get_u16(const Uint8 * p) {
+  return (Uint16)(p[0] | (p[1] << 8));
+}
+
+static Uint32 get_u32(const Uint8 * p) {
+  return (Uint32) p[0] | ((Uint32) p[1] << 8) | ((Uint32) p[2] << 16) | ((Uint32) p[3] << 24);
+}
+
+static Uint32 hash_line(Uint32 hash, const char * text, int length) {
+  for (int i = 0; i < length; i++) {
+    hash = (hash ^ (unsigned char) text[i]) * 16777619u;
+  }
+  return (hash ^ '\n') * 16777619u;
+}
+
+static void recorder_write(Uint8 kind, const void * payload, int length) {
+  Uint8 header[REC_HEADER_SIZE];
+  header[0] = kind;
+  put_u32(header + 1, SDL_GetTicks() - gRecordStart);
+  put_u16(header + 5, (Uint16) length);
+  fwrite(header, 1, REC_HEADER_SIZE, gRecordFile);
+  if (length > 0) fwrite(payload, 1, length, gRecordFile);
+}
+
+bool recorder_start(const char * path) {
+  if (!path || gRecordFile) return false;
+
+  gRecordFile = fopen(path, "wb");
+  if (!gRecordFile) {
+    printf("Warning: Could not create session recording: %s\n", path);
+    return false;
+  }
+
+  fwrite(RECORD_MAGIC, 1, sizeof(RECORD_MAGIC) - 1, gRecordFile);
+  fputc(RECORD_VERSION, gRecordFile);
+  gRecordStart = SDL_GetTicks();
+  printf("Recording session to: %s\n", path);
+  return true;
+}
+
+void recorder_event(const SDL_Event * e) {
+  if (!gRecordFile || !e) return;
+
+  Uint8 payload[16];
+  switch (e -> type) {
+  case SDL_KEYDOWN:
+    // Escape closes the emulator and is not part of the session
+    if (e -> key.keysym.sym == SDLK_ESCAPE) break;
+    put_u32(payload, (Uint32) e -> key.keysym.sym);
+    put_u16(payload + 4, e -> key.keysym.mod);
+    recorder_write(REC_KEYDOWN, payload, 6);
+    break;
+
+  case SDL_TEXTINPUT:
+    recorder_write(REC_TEXTINPUT, e -> text.text, (int) strnlen(e -> text.text, sizeof(e -> text.text) - 1));
+    break;
+
+  case SDL_MOUSEBUTTONDOWN:
+  case SDL_MOUSEBUTTONUP:
+    payload[0] = (e -> type == SDL_MOUSEBUTTONDOWN) ? 0 : 1;
+    payload[1] = e -> button.button;
+    put_u32(payload + 2, (Uint32) e -> button.x);
+    put_u32(payload + 6, (Uint32) e -> button.y);
+    put_u32(payload + 10, 0);
+    recorder_write(REC_MOUSE, payload, 14);
+    break;
+
+  case SDL_MOUSEMOTION:
+    payload[0] = 2;
+    payload[1] = 0;
+    put_u32(payload + 2, (Uint32) e -> motion.x);
+    put_u32(payload + 6, (Uint32) e -> motion.y);
+    put_u32(payload + 10, e -> motion.state);
+    recorder_write(REC_MOUSE, payload, 14);
+    break;
+
+  case SDL_WINDOWEVENT:
+    if (e -> window.event == SDL_WINDOWEVENT_RESIZED) {
+      put_u32(payload, (Uint32) e -> window.data1);
+      put_u32(payload + 4, (Uint32) e -> window.data2);
+      recorder_write(REC_RESIZE, payload, 8);
+    }
+    break;
+  }
+}
+
+void recorder_output_line(const char * line) {
+  if (!line) return;
+
+  int length = (int) strnlen(line, INPUT_BUFFER_SIZE - 1);
+  if (gRecordFile) {
+    recorder_write(REC_OUTPUT, line, length);
+  }
+  if (gReplayFile) {
+    gProducedHash = hash_line(gProducedHash, line, length);
+    gProducedLines++;
+  }
+}
+
+void recorder_stop(void) {
+  if (gRecordFile) {
+    fclose(gRecordFile);
+    gRecordFile = NULL;
+  }
+  if (gReplayFile) {
+    fclose(gReplayFile);
+    gReplayFile = NULL;
+  }
+}
+
+bool replay_open(const char * path, bool fast) {
+  if (!path || gReplayFile) return false;
+
+  gReplayFile = fopen(path, "rb");
+  if (!gReplayFile) {
+    printf("Warning: Could not open session recording: %s\n", path);
+    return false;
+  }
+
+  char magic[sizeof(RECORD_MAGIC)];
+  if (fread(magic, 1, sizeof(magic), gReplayFile) != sizeof(magic) ||
+    memcmp(magic, RECORD_MAGIC, sizeof(RECORD_MAGIC) - 1) != 0 ||
+    (Uint8) magic[sizeof(RECORD_MAGIC) - 1] != RECORD_VERSION) {
+    printf("Warning: %s is not a session recording.\n", path);
+    fclose(gReplayFile);
+    gReplayFile = NULL;
+    return false;
+  }
+
+  gReplayFast = fast;
+  gReplayDone = false;
+  gReplayReported = false;
+  gHavePending = false;
+  gEventsReplayed = 0;
+  gFramesRendered = 0;
+  gFrameTicksTotal = 0;
+  gFrameTicksMax = 0;
+  gExpectedHash = gProducedHash = 2166136261u;
+  gExpectedLines = gProducedLines = 0;
+  gReplayStart = SDL_GetTicks();
+  gReplayCounterStart = SDL_GetPerformanceCounter();
+
+  printf("Replaying session from: %s (%s)\n", path, fast ? "max speed" : "real time");
+  return true;
+}
+
+bool replay_active(void) {
+  return gReplayFile != NULL;
+}
+
+bool replay_is_fast(void) {
+  return gReplayFile != NULL && gReplayFast;
+}
+
+// Reads the next input event, folding recorded output into the expected hash
+static bool replay_read(SDL_Event * e, Uint32 * time) {
+  Uint8 header[REC_HEADER_SIZE];
+  static char payload[REC_MAX_PAYLOAD];
+
+  while (fread(header, 1, REC_HEADER_SIZE, gReplayFile) == REC_HEADER_SIZE) {
+    Uint8 kind = header[0];
+    Uint16 length = get_u16(header + 5);
+    if (length > REC_MAX_PAYLOAD || fread(payload, 1, length, gReplayFile) != length)
+      return false;
+
+    const Uint8 * p = (const Uint8 * ) payload;
+    memset(e, 0, sizeof( * e));
+    * time = get_u32(header + 1);
+
+    switch (kind) {
+    case REC_KEYDOWN:
+      if (length < 6) return false;
+      e -> type = SDL_KEYDOWN;
+      e -> key.keysym.sym = (SDL_Keycode) get_u32(p);
+      e -> key.keysym.mod = get_u16(p + 4);
+      return true;
+
+    case REC_TEXTINPUT:
+      e -> type = SDL_TEXTINPUT;
+      if (length >= sizeof(e -> text.text)) length = sizeof(e -> text.text) - 1;
+      memcpy(e -> text.text, payload, length);
+      e -> text.text[length] = '\0';
+      return true;
+
+    case REC_MOUSE:
+      if (length < 14) return false;
+      if (p[0] == 2) {
+        e -> type = SDL_MOUSEMOTION;
+        e -> motion.x = (Sint32) get_u32(p + 2);
+        e -> motion.y = (Sint32) get_u32(p + 6);
+        e -> motion.state = get_u32(p + 10);
+      } else {
+        e -> type = (p[0] == 0) ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP;
+        e -> button.button = p[1];
+        e -> button.x = (Sint32) get_u32(p + 2);
+        e -> button.y = (Sint32) get_u32(p + 6);
+      }
+      return true;
+
+    case REC_RESIZE:
+      if (length < 8) return false;
+      e -> type = SDL_WINDOWEVENT;
+      e -> window.event = SDL_WINDOWEVENT_RESIZED;
+      e -> window.data1 = (Sint32) get_u32(p);
+      e -> window.data2 = (Sint32) get_u32(p + 4);
+      return true;
+
+    case REC_OUTPUT:
+      gExpectedHash = hash_line(gExpectedHash, payload, length);
+      gExpectedLines++;
+      break;
+
+    default:
+      // Unknown record kinds from newer versions are skipped
+      break;
+    }
+  }
+  return false;
+}
+
+bool replay_next_event(SDL_Event * e) {
+  if (!gReplayFile || !e) return false;
+
+  if (!gHavePending) {
+    if (!replay_read( & gPending, & gPendingTime)) {
+      fclose(gReplayFile);
+      gReplayFile = NULL;
+      gReplayDone = true;
+      gReplayCounterEnd = SDL_GetPerformanceCounter();
+      return false;
+    }
+    gHavePending = true;
+  }
+
+  // In real time mode events wait until their recorded offset has elapsed
+  if (!gReplayFast && gPendingTime > SDL_GetTicks() - gReplayStart)
+    return false;
+
+  * e = gPending;
+  gHavePending = false;
+  gEventsReplayed++;
+  return true;
+}
+
+void replay_frame_time(Uint64 ticks) {
+  if (!gReplayFile) return;
+  gFramesRendered++;
+  gFrameTicksTotal += ticks;
+  if (ticks > gFrameTicksMax) gFrameTicksMax = ticks;
+}
+
+// Fills in the timing summary once, right after the last recorded event was replayed
+bool replay_finished(char * summary, int summarySize) {
+  if (!gReplayDone || gReplayReported) return false;
+  gReplayReported = true;
+
+  double frequency = (double) SDL_GetPerformanceFrequency();
+  double elapsedMs = (gReplayCounterEnd - gReplayCounterStart) * 1000.0 / frequency;
+  double avgFrameMs = gFramesRendered ? gFrameTicksTotal * 1000.0 / frequency / gFramesRendered : 0.0;
+  double maxFrameMs = gFrameTicksMax * 1000.0 / frequency;
+  bool matched = gExpectedLines == gProducedLines && gExpectedHash == gProducedHash;
+
+  if (summary && summarySize > 0) {
+    snprintf(summary, summarySize,
+      "Replay: %d events, %d frames in %.1f ms (frame avg %.2f ms, max %.2f ms), output %s",
+      gEventsReplayed, gFramesRendered, elapsedMs, avgFrameMs, maxFrameMs,
+      matched ? "matched" : "differs");
+  }
+  return true;
+}
@@ -0,0 +1,772 @@
+#include <string.h>
+
+#include <stdlib.h>
+
+#include <stdio.h>
+
+#include <SDL.h>
+
+#include <windows.h>
+
+#include "config.h"
+
+#include "scrollback.h"
+
+#include "lz.h"
+
+#include "mapfile.h"
+
+#include "threadpool.h"
+
+// Restored blocks are read straight from the mapped session file
+#define SCROLLBACK_SESSION_SEGMENT -2
+
+// SCROLLBACK_BLOCK_LINES archived lines; all but the tail block are full
+typedef struct {
+  Scrollback * owner;
+  char * text;            // Lines, each ending in '\n'; NULL once only the compressed copy is kept
+  size_t length;          // Size of the text, also after it has been compressed
+  size_t capacity;
+  int * offsets;          // Start of each line in text
+  int lineCount;
+  unsigned char * packed; // Compressed copy, written by the worker that made it
+  size_t packedLength;
+  int segment;            // Spill file holding the compressed copy, -1 while it is in memory,
+                          // SCROLLBACK_SESSION_SEGMENT when it lives in a restored session file
+  size_t fileOffset;
+  bool cold;              // Handed to a worker for compression
+  bool compressing;
+}
+ScrollbackBlock;
+
+// A decompressed cold block (UI thread only)
+typedef struct {
+  int block; // -1 = unused
+  char * text;
+  int * offsets;
+  Uint32 lastUse;
+}
+ScrollbackCacheEntry;
+
+// Read-only views of segment files, shared by all readers under the lock
+typedef struct {
+  int segment; // -1 = unused
+  MappedFile file;
+  Uint32 lastUse;
+}
+ScrollbackSegmentView;
+
+// The archive of one session
+struct Scrollback {
+  SDL_mutex * lock; // Guards the block table against workers
+  ScrollbackBlock ** blocks;
+  int blockCount;
+  int blockCapacity;
+  size_t lineCount;
+  int firstRawBlock; // Blocks before this one keep only their compressed copy
+
+  ScrollbackCacheEntry cache[SCROLLBACK_CACHE_BLOCKS];
+  Uint32 clock; // Block cache use counter (UI thread only)
+
+  // Spilling: compressed blocks beyond SCROLLBACK_MEMORY_LIMIT move to segment files
+  size_t packedBytes; // Compressed bytes still held in memory
+  bool spilling;      // A spill task is running
+  int nextSpill;      // Oldest block that may still be in memory
+  int id;             // Names the spill directory
+  char spillDir[MAX_PATH];
+  HANDLE segmentFile; // Segment being appended to (spill task only)
+  size_t segmentSize;
+  int segmentCount;
+  ScrollbackSegmentView views[SCROLLBACK_MAPPED_SEGMENTS];
+  Uint32 viewClock; // Segment view use counter, guarded by the lock
+
+  MappedFile session;
+  bool sessionMapped;
+
+  SDL_atomic_t tasks; // Compression and spill tasks still running
+};
+
+static SDL_atomic_t gNextId;
+
+static void scrollback_compress(void * arg) {
+  ScrollbackBlock * block = (ScrollbackBlock * ) arg;
+  Scrollback * archive = block -> owner;
+
+  // Sealed blocks never change, so the text is read without the lock
+  size_t capacity = lz_bound(block -> length);
+  unsigned char * packed = (unsigned char * ) malloc(capacity);
+  size_t packedLength = packed ? lz_compress(block -> text, block -> length, packed, capacity) : 0;
+  if (packedLength > 0) {
+    unsigned char * shrunk = (unsigned char * ) realloc(packed, packedLength);
+    if (shrunk) packed = shrunk;
+  } else {
+    free(packed);
+    packed = NULL;
+  }
+
+  SDL_LockMutex(archive -> lock);
+  block -> packed = packed;
+  block -> packedLength = packedLength;
+  block -> compressing = false;
+  archive -> packedBytes += packedLength;
+  SDL_UnlockMutex(archive -> lock);
+  SDL_AtomicAdd( & archive -> tasks, -1);
+}
+
+static void scrollback_segment_path(const Scrollback * archive, int segment, char * path, size_t size) {
+  snprintf(path, size, "%s\\segment-%04d.bin", archive -> spillDir, segment);
+}
+
+// Appends compressed bytes to the current segment file (spill task only)
+static bool scrollback_write_segment(Scrollback * archive, const unsigned char * data, size_t length, int * segment, size_t * offset) {
+  if (archive -> segmentFile && archive -> segmentSize + length > SCROLLBACK_SEGMENT_BYTES) {
+    CloseHandle(archive -> segmentFile);
+    archive -> segmentFile = NULL;
+  }
+
+  if (!archive -> segmentFile) {
+    if (!archive -> spillDir[0]) {
+      char temp[MAX_PATH];
+      if (!GetTempPathA(sizeof(temp), temp)) return false;
+      snprintf(archive -> spillDir, sizeof(archive -> spillDir), "%socto-shell-%lu-%d", temp, (unsigned long) GetCurrentProcessId(), archive -> id);
+      CreateDirectoryA(archive -> spillDir, NULL);
+    }
+
+    char path[MAX_PATH];
+    scrollback_segment_path(archive, archive -> segmentCount, path, sizeof(path));
+    HANDLE file = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+      NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    archive -> segmentFile = file;
+    archive -> segmentSize = 0;
+    archive -> segmentCount++;
+  }
+
+  DWORD written = 0;
+  if (!WriteFile(archive -> segmentFile, data, (DWORD) length, & written, NULL) || written != length) return false;
+
+  * segment = archive -> segmentCount - 1;
+  * offset = archive -> segmentSize;
+  archive -> segmentSize += length;
+  return true;
+}
+
+// Called with the lock held; blocks are spilled oldest first
+static ScrollbackBlock * scrollback_next_spill(Scrollback * archive) {
+  for (; archive -> nextSpill < archive -> blockCount; archive -> nextSpill++) {
+    ScrollbackBlock * block = archive -> blocks[archive -> nextSpill];
+    if (!block -> cold || block -> compressing) return NULL;
+    if (block -> packed) return block;
+    // Already on disk, or it failed to compress and stays raw
+  }
+  return NULL;
+}
+
+// Moves the oldest compressed blocks to disk until memory is back under three quarters of the limit
+static void scrollback_spill_blocks(Scrollback * archive) {
+  for (;;) {
+    SDL_LockMutex(archive -> lock);
+    ScrollbackBlock * block = archive -> packedBytes > SCROLLBACK_MEMORY_LIMIT / 4 * 3 ? scrollback_next_spill(archive) : NULL;
+    if (!block) {
+      archive -> spilling = false;
+      SDL_UnlockMutex(archive -> lock);
+      return;
+    }
+    // Only this task frees compressed copies, so they can be written without the lock
+    const unsigned char * packed = block -> packed;
+    size_t length = block -> packedLength;
+    SDL_UnlockMutex(archive -> lock);
+
+    int segment = -1;
+    size_t offset = 0;
+    bool written = scrollback_write_segment(archive, packed, length, & segment, & offset);
+
+    SDL_LockMutex(archive -> lock);
+    if (written) {
+      block -> segment = segment;
+      block -> fileOffset = offset;
+      block -> packed = NULL;
+      archive -> packedBytes -= length;
+      archive -> nextSpill++;
+    } else {
+      // Keep everything in memory when the disk refuses the write
+      archive -> spilling = false;
+    }
+    SDL_UnlockMutex(archive -> lock);
+
+    if (!written) return;
+    free((void * ) packed);
+  }
+}
+
+static void scrollback_spill(void * arg) {
+  Scrollback * archive = (Scrollback * ) arg;
+  scrollback_spill_blocks(archive);
+  SDL_AtomicAdd( & archive -> tasks, -1);
+}
+
+// Mapped view of a segment covering at least end bytes (lock held)
+static const unsigned char * scrollback_segment_data(Scrollback * archive, int segment, size_t end) {
+  ScrollbackSegmentView * view = & archive -> views[0];
+  for (int i = 0; i < SCROLLBACK_MAPPED_SEGMENTS; i++) {
+    if (archive -> views[i].segment == segment) {
+      view = & archive -> views[i];
+      if (view -> file.size >= end) {
+        view -> lastUse = ++archive -> viewClock;
+        return (const unsigned char * ) view -> file.data;
+      }
+      break;
+    }
+    if (archive -> views[i].segment < 0 || (view -> segment >= 0 && archive -> views[i].lastUse < view -> lastUse)) view = & archive -> views[i];
+  }
+
+  // The segment being appended to is remapped once it has grown past the old view
+  if (view -> segment >= 0) mapfile_close( & view -> file);
+  view -> segment = -1;
+
+  char path[MAX_PATH];
+  scrollback_segment_path(archive, segment, path, sizeof(path));
+  if (!mapfile_open( & view -> file, path)) return NULL;
+  if (view -> file.size < end) {
+    mapfile_close( & view -> file);
+    return NULL;
+  }
+  view -> segment = segment;
+  view -> lastUse = ++archive -> viewClock;
+  return (const unsigned char * ) view -> file.data;
+}
+
+// Heap copy of a block's compressed bytes from memory or its segment file (lock held)
+static unsigned char * scrollback_copy_packed(Scrollback * archive, const ScrollbackBlock * block) {
+  const unsigned char * source = block -> packed;
+  if (!source && block -> segment == SCROLLBACK_SESSION_SEGMENT) {
+    source = (const unsigned char * ) archive -> session.data + block -> fileOffset;
+  } else if (!source && block -> segment >= 0) {
+    const unsigned char * data = scrollback_segment_data(archive, block -> segment, block -> fileOffset + block -> packedLength);
+    source = data ? data + block -> fileOffset : NULL;
+  }
+  if (!source) return NULL;
+
+  unsigned char * copy = (unsigned char * ) malloc(block -> packedLength);
+  if (copy) memcpy(copy, source, block -> packedLength);
+  return copy;
+}
+
+// Records where each line starts in offsets (when given); false unless the text holds exactly
+// lineCount lines, each ending in '\n', which a corrupt session file may not
+static bool scrollback_index_lines(const char * text, size_t length, int lineCount, int * offsets) {
+  size_t start = 0;
+  for (int line = 0; line < lineCount; line++) {
+    const char * newline = (const char * ) memchr(text + start, '\n', length - start);
+    if (!newline) return false;
+    if (offsets) offsets[line] = (int) start;
+    start = (size_t)(newline - text) + 1;
+  }
+  return start == length;
+}
+
+// Expands a block whose raw text is gone into dest, which holds block -> length bytes
+static bool scrollback_expand(Scrollback * archive, const ScrollbackBlock * block, char * dest) {
+  SDL_LockMutex(archive -> lock);
+  unsigned char * packed = scrollback_copy_packed(archive, block);
+  SDL_UnlockMutex(archive -> lock);
+
+  bool expanded = packed && lz_decompress(packed, block -> packedLength, dest, block -> length);
+  free(packed);
+  return expanded;
+}
+
+// Called with the lock held
+static ScrollbackBlock * scrollback_tail(Scrollback * archive) {
+  if (archive -> blockCount > 0 && archive -> blocks[archive -> blockCount - 1] -> lineCount < SCROLLBACK_BLOCK_LINES)
+    return archive -> blocks[archive -> blockCount - 1];
+
+  if (archive -> blockCount == archive -> blockCapacity) {
+    int capacity = archive -> blockCapacity ? archive -> blockCapacity * 2 : 64;
+    ScrollbackBlock ** grown = (ScrollbackBlock ** ) realloc(archive -> blocks, (size_t) capacity * sizeof(ScrollbackBlock * ));
+    if (!grown) return NULL;
+    archive -> blocks = grown;
+    archive -> blockCapacity = capacity;
+  }
+
+  ScrollbackBlock * block = (ScrollbackBlock * ) calloc(1, sizeof(ScrollbackBlock));
+  if (!block) return NULL;
+  block -> offsets = (int * ) malloc(SCROLLBACK_BLOCK_LINES * sizeof(int));
+  if (!block -> offsets) {
+    free(block);
+    return NULL;
+  }
+  block -> owner = archive;
+  block -> segment = -1;
+  archive -> blocks[archive -> blockCount++] = block;
+  return block;
+}
+
+// Archives one line that scrolled out of the output (UI thread)
+void scrollback_append(Scrollback * archive, const char * text, size_t length) {
+  if (!archive || !text) return;
+  if (length > INPUT_BUFFER_SIZE - 1) length = INPUT_BUFFER_SIZE - 1;
+
+  SDL_LockMutex(archive -> lock);
+  ScrollbackBlock * block = scrollback_tail(archive);
+  if (block && block -> length + length + 1 > block -> capacity) {
+    size_t capacity = block -> capacity ? block -> capacity * 2 : 65536;
+    while (capacity < block -> length + length + 1) capacity *= 2;
+    char * grown = (char * ) realloc(block -> text, capacity);
+    if (grown) {
+      block -> text = grown;
+      block -> capacity = capacity;
+    } else {
+      block = NULL;
+    }
+  }
+  if (!block) {
+    SDL_UnlockMutex(archive -> lock);
+    return;
+  }
+
+  block -> offsets[block -> lineCount++] = (int) block -> length;
+  memcpy(block -> text + block -> length, text, length);
+  block -> length += length;
+  block -> text[block -> length++] = '\n';
+  archive -> lineCount++;
+
+  // Once a block is sealed, the one SCROLLBACK_HOT_BLOCKS before it goes cold
+  ScrollbackBlock * cold = NULL;
+  int coldIndex = archive -> blockCount - 1 - SCROLLBACK_HOT_BLOCKS;
+  // Restored blocks are cold from the start
+  if (block -> lineCount == SCROLLBACK_BLOCK_LINES && coldIndex >= 0 && !archive -> blocks[coldIndex] -> cold) {
+    cold = archive -> blocks[coldIndex];
+    cold -> cold = true;
+    cold -> compressing = true;
+    SDL_AtomicAdd( & archive -> tasks, 1);
+  }
+  SDL_UnlockMutex(archive -> lock);
+
+  if (cold && !threadpool_submit(scrollback_compress, cold))
+    scrollback_compress(cold);
+}
+
+// Per-frame work: drop the raw text of blocks whose compressed copy is ready, and
+// start spilling to disk once the compressed copies outgrow SCROLLBACK_MEMORY_LIMIT
+void scrollback_update(Scrollback * archive) {
+  if (!archive) return;
+
+  SDL_LockMutex(archive -> lock);
+  for (int b = archive -> firstRawBlock; b < archive -> blockCount && archive -> blocks[b] -> cold; b++) {
+    ScrollbackBlock * block = archive -> blocks[b];
+    if ((block -> packed || block -> segment >= 0) && block -> text) {
+      free(block -> text);
+      free(block -> offsets);
+      block -> text = NULL;
+      block -> offsets = NULL;
+      block -> capacity = 0;
+    }
+    // Blocks that failed to compress stay raw and keep the cursor here
+    if (!block -> text && b == archive -> firstRawBlock) archive -> firstRawBlock++;
+  }
+
+  bool spill = !archive -> spilling && archive -> packedBytes > SCROLLBACK_MEMORY_LIMIT;
+  if (spill) {
+    archive -> spilling = true;
+    SDL_AtomicAdd( & archive -> tasks, 1);
+  }
+  SDL_UnlockMutex(archive -> lock);
+
+  if (spill && !threadpool_submit(scrollback_spill, archive))
+    scrollback_spill(archive);
+}
+
+size_t scrollback_line_count(Scrollback * archive) {
+  if (!archive) return 0;
+
+  SDL_LockMutex(archive -> lock);
+  size_t count = archive -> lineCount;
+  SDL_UnlockMutex(archive -> lock);
+  return count;
+}
+
+static ScrollbackCacheEntry * scrollback_cache_load(Scrollback * archive, int index) {
+  ScrollbackCacheEntry * victim = & archive -> cache[0];
+  for (int i = 0; i < SCROLLBACK_CACHE_BLOCKS; i++) {
+    if (archive -> cache[i].block == index) {
+      archive -> cache[i].lastUse = ++archive -> clock;
+      return & archive -> cache[i];
+    }
+    if (archive -> cache[i].block < 0 || (victim -> block >= 0 && archive -> cache[i].lastUse < victim -> lastUse)) victim = & archive -> cache[i];
+  }
+
+  const ScrollbackBlock * block = archive -> blocks[index];
+  char * text = (char * ) malloc(block -> length);
+  int * offsets = (int * ) malloc((size_t) block -> lineCount * sizeof(int));
+  if (!text || !offsets || !scrollback_expand(archive, block, text) ||
+    !scrollback_index_lines(text, block -> length, block -> lineCount, offsets)) {
+    free(text);
+    free(offsets);
+    return NULL;
+  }
+
+  free(victim -> text);
+  free(victim -> offsets);
+  victim -> block = index;
+  victim -> text = text;
+  victim -> offsets = offsets;
+  victim -> lastUse = ++archive -> clock;
+  return victim;
+}
+
+// Text of an archived line without its newline; valid until the next call (UI thread)
+bool scrollback_line(Scrollback * archive, size_t line, const char ** text, int * length) {
+  if (!archive || !text || !length || line >= archive -> lineCount) return false;
+
+  int index = (int)(line / SCROLLBACK_BLOCK_LINES);
+  int within = (int)(line % SCROLLBACK_BLOCK_LINES);
+  const ScrollbackBlock * block = archive -> blocks[index];
+
+  const char * base = block -> text;
+  const int * offsets = block -> offsets;
+  if (!base) {
+    ScrollbackCacheEntry * entry = scrollback_cache_load(archive, index);
+    if (!entry) return false;
+    base = entry -> text;
+    offsets = entry -> offsets;
+  }
+
+  int end = within + 1 < block -> lineCount ? offsets[within + 1] : (int) block -> length;
+  * text = base + offsets[within];
+  * length = end - offsets[within] - 1;
+  return true;
+}
+
+int scrollback_block_count(Scrollback * archive) {
+  if (!archive) return 0;
+
+  SDL_LockMutex(archive -> lock);
+  int count = archive -> blockCount;
+  SDL_UnlockMutex(archive -> lock);
+  return count;
+}
+
+// Heap copy of one block's lines, each ending in '\n'; safe from any thread
+char * scrollback_read_block(Scrollback * archive, int index, size_t * length) {
+  if (!archive || !length) return NULL;
+
+  SDL_LockMutex(archive -> lock);
+  if (index < 0 || index >= archive -> blockCount) {
+    SDL_UnlockMutex(archive -> lock);
+    return NULL;
+  }
+  const ScrollbackBlock * block = archive -> blocks[index];
+  size_t size = block -> length;
+  size_t packedLength = block -> packedLength;
+  int lineCount = block -> lineCount;
+  char * copy = (char * ) malloc(size + 1);
+  unsigned char * packed = NULL;
+  if (copy && block -> text) {
+    memcpy(copy, block -> text, size);
+  } else if (copy && !(packed = scrollback_copy_packed(archive, block))) {
+    free(copy);
+    copy = NULL;
+  }
+  SDL_UnlockMutex(archive -> lock);
+
+  // Only the compressed bytes are copied under the lock; a session load may free the block meanwhile
+  if (packed && (!lz_decompress(packed, packedLength, copy, size) || !scrollback_index_lines(copy, size, lineCount, NULL))) {
+    free(copy);
+    copy = NULL;
+  }
+  free(packed);
+
+  if (!copy) return NULL;
+  copy[size] = '\0';
+  * length = size;
+  return copy;
+}
+
+// Writes every line archived so far to stream; safe from any thread
+bool scrollback_write(Scrollback * archive, FILE * stream, size_t limit, size_t * lines) {
+  if (!archive || !stream || !lines) return false;
+
+  // Lines archived while this runs are left out so the copy ends where it started
+  size_t remaining = scrollback_line_count(archive);
+  if (remaining > limit) remaining = limit;
+  * lines = 0;
+  for (int b = 0; remaining > 0; b++) {
+    size_t length = 0;
+    char * text = scrollback_read_block(archive, b, & length);
+    if (!text) return false;
+
+    size_t take = 0;
+    for (const char * p = text; remaining > 0 && take < length; remaining--, ( * lines) ++) {
+      const char * newline = (const char * ) memchr(p, '\n', length - take);
+      if (!newline) {
+        // A block that stops short of its line count is damaged
+        free(text);
+        return false;
+      }
+      take = (size_t)(newline - text) + 1;
+      p = newline + 1;
+    }
+    bool written = fwrite(text, 1, take, stream) == take;
+    free(text);
+    if (!written) return false;
+  }
+  return true;
+}
+
+void scrollback_stats(Scrollback * archive, ScrollbackStats * stats) {
+  if (!stats) return;
+  memset(stats, 0, sizeof( * stats));
+  if (!archive) return;
+
+  SDL_LockMutex(archive -> lock);
+  stats -> lines = archive -> lineCount;
+  stats -> blocks = archive -> blockCount;
+  for (int b = 0; b < archive -> blockCount; b++) {
+    const ScrollbackBlock * block = archive -> blocks[b];
+    stats -> rawBytes += block -> length;
+    if (block -> text) stats -> storedBytes += block -> capacity + SCROLLBACK_BLOCK_LINES * sizeof(int);
+    if (block -> packed) stats -> storedBytes += block -> packedLength;
+    if (block -> segment != -1) {
+      stats -> diskBytes += block -> packedLength;
+      stats -> spilledBlocks++;
+    }
+    if (!block -> text) stats -> compressedBlocks++;
+  }
+  SDL_UnlockMutex(archive -> lock);
+}
+
+// Compressed copy of one block for a session file; safe from any thread
+unsigned char * scrollback_pack_block(Scrollback * archive, int index, ScrollbackBlockInfo * info) {
+  if (!archive || !info) return NULL;
+
+  SDL_LockMutex(archive -> lock);
+  if (index < 0 || index >= archive -> blockCount) {
+    SDL_UnlockMutex(archive -> lock);
+    return NULL;
+  }
+  const ScrollbackBlock * block = archive -> blocks[index];
+  memset(info, 0, sizeof( * info));
+  info -> length = (Uint32) block -> length;
+  info -> lineCount = (Uint32) block -> lineCount;
+
+  // Cold blocks are copied as they are; hot ones are compressed from a snapshot of their text
+  char * text = NULL;
+  unsigned char * packed = NULL;
+  if (block -> text && !block -> packed && block -> segment == -1) {
+    text = (char * ) malloc(block -> length);
+    if (text) memcpy(text, block -> text, block -> length);
+  } else {
+    packed = scrollback_copy_packed(archive, block);
+    info -> packedLength = (Uint32) block -> packedLength;
+  }
+  SDL_UnlockMutex(archive -> lock);
+
+  if (text) {
+    size_t capacity = lz_bound(info -> length);
+    packed = (unsigned char * ) malloc(capacity);
+    size_t packedLength = packed ? lz_compress(text, info -> length, packed, capacity) : 0;
+    if (packedLength == 0 && info -> length > 0) {
+      free(packed);
+      packed = NULL;
+    }
+    info -> packedLength = (Uint32) packedLength;
+    free(text);
+  }
+  return packed;
+}
+
+// Frees every block and spill file; callers make sure no task still holds a block
+static void scrollback_release(Scrollback * archive) {
+  SDL_LockMutex(archive -> lock);
+  for (int b = 0; b < archive -> blockCount; b++) {
+    free(archive -> blocks[b] -> text);
+    free(archive -> blocks[b] -> offsets);
+    free(archive -> blocks[b] -> packed);
+    free(archive -> blocks[b]);
+  }
+  free(archive -> blocks);
+  for (int i = 0; i < SCROLLBACK_CACHE_BLOCKS; i++) {
+    free(archive -> cache[i].text);
+    free(archive -> cache[i].offsets);
+    archive -> cache[i].text = NULL;
+    archive -> cache[i].offsets = NULL;
+    archive -> cache[i].block = -1;
+  }
+
+  // The spill files only ever live as long as the session
+  for (int i = 0; i < SCROLLBACK_MAPPED_SEGMENTS; i++) {
+    if (archive -> views[i].segment >= 0) mapfile_close( & archive -> views[i].file);
+    archive -> views[i].segment = -1;
+  }
+  if (archive -> segmentFile) CloseHandle(archive -> segmentFile);
+  for (int segment = 0; segment < archive -> segmentCount; segment++) {
+    char path[MAX_PATH];
+    scrollback_segment_path(archive, segment, path, sizeof(path));
+    DeleteFileA(path);
+  }
+  if (archive -> spillDir[0]) RemoveDirectoryA(archive -> spillDir);
+  if (archive -> sessionMapped) mapfile_close( & archive -> session);
+
+  archive -> sessionMapped = false;
+  archive -> segmentFile = NULL;
+  archive -> segmentSize = 0;
+  archive -> segmentCount = 0;
+  archive -> spillDir[0] = '\0';
+  archive -> packedBytes = 0;
+  archive -> spilling = false;
+  archive -> nextSpill = 0;
+  archive -> blocks = NULL;
+  archive -> blockCount = 0;
+  archive -> blockCapacity = 0;
+  archive -> lineCount = 0;
+  archive -> firstRawBlock = 0;
+  SDL_UnlockMutex(archive -> lock);
+}
+
+// Replaces the archive with the blocks of a mapped session file and takes ownership of
+// the mapping; nothing is decompressed except a partly filled tail block (UI thread)
+bool scrollback_restore(Scrollback * archive, MappedFile * file, const ScrollbackBlockInfo * blocks, int count) {
+  if (!archive || !file || count < 0 || (count > 0 && !blocks)) return false;
+
+  // Reject anything that would make a lookup read past the mapping
+  for (int b = 0; b < count; b++) {
+    const ScrollbackBlockInfo * info = & blocks[b];
+    bool full = info -> lineCount == SCROLLBACK_BLOCK_LINES;
+    if (info -> lineCount == 0 || info -> lineCount > SCROLLBACK_BLOCK_LINES || (!full && b != count - 1) ||
+      info -> length < info -> lineCount || info -> length > (Uint64) SCROLLBACK_BLOCK_LINES * INPUT_BUFFER_SIZE ||
+      info -> offset > file -> size || info -> packedLength > file -> size - info -> offset)
+      return false;
+  }
+
+  ScrollbackBlock ** table = (ScrollbackBlock ** ) calloc(count > 0 ? (size_t) count : 1, sizeof(ScrollbackBlock * ));
+  bool built = table != NULL;
+  size_t lines = 0;
+  for (int b = 0; built && b < count; b++) {
+    ScrollbackBlock * block = (ScrollbackBlock * ) calloc(1, sizeof(ScrollbackBlock));
+    if (!block) {
+      built = false;
+      break;
+    }
+    table[b] = block;
+    block -> owner = archive;
+    block -> length = blocks[b].length;
+    block -> lineCount = (int) blocks[b].lineCount;
+    block -> packedLength = blocks[b].packedLength;
+    block -> segment = SCROLLBACK_SESSION_SEGMENT;
+    block -> fileOffset = (size_t) blocks[b].offset;
+    block -> cold = true;
+    lines += blocks[b].lineCount;
+  }
+
+  // A partial tail keeps growing, so it is expanded back into an appendable raw block
+  ScrollbackBlock * tail = built && count > 0 && table[count - 1] -> lineCount < SCROLLBACK_BLOCK_LINES ? table[count - 1] : NULL;
+  if (tail) {
+    tail -> capacity = 65536;
+    while (tail -> capacity < tail -> length) tail -> capacity *= 2;
+    tail -> text = (char * ) malloc(tail -> capacity);
+    tail -> offsets = (int * ) malloc(SCROLLBACK_BLOCK_LINES * sizeof(int));
+    built = tail -> text && tail -> offsets &&
+      lz_decompress((const unsigned char * ) file -> data + tail -> fileOffset, tail -> packedLength, tail -> text, tail -> length);
+    built = built && scrollback_index_lines(tail -> text, tail -> length, tail -> lineCount, tail -> offsets);
+    tail -> packedLength = 0;
+    tail -> segment = -1;
+    tail -> fileOffset = 0;
+    tail -> cold = false;
+  }
+
+  if (!built) {
+    for (int b = 0; table && b < count; b++) {
+      if (!table[b]) continue;
+      free(table[b] -> text);
+      free(table[b] -> offsets);
+      free(table[b]);
+    }
+    free(table);
+    return false;
+  }
+
+  // Compression and spill tasks hold block pointers; they finish within a block's worth of work
+  while (SDL_AtomicGet( & archive -> tasks) > 0) SDL_Delay(1);
+  scrollback_release(archive);
+
+  SDL_LockMutex(archive -> lock);
+  archive -> blocks = table;
+  archive -> blockCount = count;
+  archive -> blockCapacity = count > 0 ? count : 1;
+  archive -> lineCount = lines;
+  archive -> firstRawBlock = tail ? count - 1 : count;
+  archive -> nextSpill = count;
+  archive -> session = * file;
+  archive -> sessionMapped = true;
+  SDL_UnlockMutex(archive -> lock);
+  return true;
+}
+
+// Copies the blocks still read from a restored session file into memory and unmaps it,
+// so the file can be replaced; the spill task moves them to disk again if needed (UI thread)
+bool scrollback_detach(Scrollback * archive) {
+  if (!archive || !archive -> sessionMapped) return true;
+
+  SDL_LockMutex(archive -> lock);
+  bool copied = true;
+  for (int b = 0; b < archive -> blockCount; b++) {
+    ScrollbackBlock * block = archive -> blocks[b];
+    if (block -> segment != SCROLLBACK_SESSION_SEGMENT) continue;
+
+    unsigned char * packed = scrollback_copy_packed(archive, block);
+    if (!packed) {
+      copied = false;
+      break;
+    }
+    block -> packed = packed;
+    block -> segment = -1;
+    block -> fileOffset = 0;
+    archive -> packedBytes += block -> packedLength;
+    if (b < archive -> nextSpill) archive -> nextSpill = b;
+  }
+  if (copied) {
+    mapfile_close( & archive -> session);
+    archive -> sessionMapped = false;
+  }
+  SDL_UnlockMutex(archive -> lock);
+  return copied;
+}
+
+// Drops the decompressed blocks kept for paging, e.g. when a session goes to the background (UI thread)
+void scrollback_trim(Scrollback * archive) {
+  if (!archive) return;
+
+  for (int i = 0; i < SCROLLBACK_CACHE_BLOCKS; i++) {
+    free(archive -> cache[i].text);
+    free(archive -> cache[i].offsets);
+    archive -> cache[i].text = NULL;
+    archive -> cache[i].offsets = NULL;
+    archive -> cache[i].block = -1;
+  }
+}
+
+Scrollback * scrollback_create(void) {
+  Scrollback * archive = (Scrollback * ) calloc(1, sizeof(Scrollback));
+  if (!archive) return NULL;
+
+  archive -> lock = SDL_CreateMutex();
+  if (!archive -> lock) {
+    free(archive);
+    return NULL;
+  }
+  for (int i = 0; i < SCROLLBACK_CACHE_BLOCKS; i++) archive -> cache[i].block = -1;
+  for (int i = 0; i < SCROLLBACK_MAPPED_SEGMENTS; i++) archive -> views[i].segment = -1;
+  archive -> id = SDL_AtomicAdd( & gNextId, 1);
+  return archive;
+}
+
+// Waits for the archive's compression and spill tasks, then frees it with its spill files
+void scrollback_destroy(Scrollback * archive) {
+  if (!archive) return;
+
+  while (SDL_AtomicGet( & archive -> tasks) > 0) SDL_Delay(1);
+  scrollback_release(archive);
+  SDL_DestroyMutex(archive -> lock);
+  free(archive);
+}
@@ -0,0 +1,409 @@
+#include <string.h>
+
+#include <stdlib.h>
+
+#include <stdio.h>
+
+#include <SDL.h>
+
+#include <windows.h>
+
+#include "session.h"
+
+#include "scrollback.h"
+
+#include "mapfile.h"
+
+#include "gui.h"
+
+#include "layout.h"
+
+#include "pager.h"
+
+#include "shell.h"
+
+#include "input.h"
+
+#include "histsearch.h"
+
+#define SESSION_MAGIC "OCTOSESS"
+#define SESSION_VERSION 1
+
+// Start of a session file. The archived scrollback follows as the same compressed blocks
+// the scrollback keeps in memory, so a load maps the file and reads them in place.
+typedef struct {
+  char magic[8];
+  Uint32 version;
+  Uint32 headerSize;    // Files written with other buffer sizes are rejected
+  Uint64 blockTable;    // blockCount ScrollbackBlockInfo records, 8-byte aligned
+  Uint64 outputTable;   // outputLines Uint32 lengths, then the text of each line
+  Uint64 archivedLines;
+  Sint32 blockCount;
+  Sint32 outputLines;
+  Sint32 cursorPos;
+  Sint32 wordWrap;
+  TextSelection selection;
+  Sint32 backgroundEnabled;
+  Sint32 backgroundScaleMode;
+  float backgroundOpacity;
+  char backgroundPath[512];
+  char input[INPUT_BUFFER_SIZE];
+}
+SessionHeader;
+
+// One tab. The shown tab's output and input line live in the main loop; the others keep
+// theirs here and in their shell context, which goes on taking in their commands' output.
+typedef struct {
+  int id; // Stays the same while tabs before it are closed
+  ShellContext * shell;
+  Scrollback * archive;
+  char input[INPUT_BUFFER_SIZE];
+  int cursorPos;
+  TextSelection selection;
+  bool unseen; // Output arrived while in the background
+}
+Session;
+
+static Session * gSessions[SESSION_MAX_TABS];
+static int gCount = 0;
+static int gActive = -1;
+static int gNextId = 1;
+
+// Editing state owned by the main loop, shown for the active tab
+static char * gInputBuffer = NULL;
+static int * gCursorPos = NULL;
+static TextSelection * gSelection = NULL;
+static char( * gOutput)[INPUT_BUFFER_SIZE] = NULL;
+static int * gLineCount = NULL;
+
+void session_attach(char * inputBuffer, int * cursorPos, TextSelection * selection,
+  char output[][INPUT_BUFFER_SIZE], int * lineCount) {
+  gInputBuffer = inputBuffer;
+  gCursorPos = cursorPos;
+  gSelection = selection;
+  gOutput = output;
+  gLineCount = lineCount;
+}
+
+// Moves the shown tab's state into it before another tab is shown
+static void session_store(Session * session) {
+  // The pager and history search work on what is about to leave the screen
+  if (pager_active()) pager_close();
+  histsearch_close();
+
+  shell_park(session -> shell, gOutput, * gLineCount);
+  memcpy(session -> input, gInputBuffer, INPUT_BUFFER_SIZE);
+  session -> cursorPos = * gCursorPos;
+  session -> selection = * gSelection;
+  scrollback_trim(session -> archive);
+}
+
+static void session_show(int index) {
+  Session * session = gSessions[index];
+  gActive = index;
+  shell_use(session -> shell);
+  shell_unpark(session -> shell, gOutput, gLineCount);
+
+  memcpy(gInputBuffer, session -> input, INPUT_BUFFER_SIZE);
+  * gCursorPos = session -> cursorPos;
+  // Lines may have scrolled under a selection made before the tab was left
+  if (session -> unseen) {
+    memset(gSelection, 0, sizeof( * gSelection));
+  } else {
+    * gSelection = session -> selection;
+  }
+  session -> unseen = false;
+  input_reset();
+}
+
+static void session_free(Session * session) {
+  shell_destroy(session -> shell);
+  scrollback_destroy(session -> archive);
+  free(session);
+}
+
+// Opens a tab with its own command worker and scrollback and shows it (UI thread)
+bool session_open(void) {
+  if (!gInputBuffer || gCount >= SESSION_MAX_TABS) return false;
+
+  Session * session = (Session * ) calloc(1, sizeof(Session));
+  if (!session) return false;
+  session -> archive = scrollback_create();
+  session -> shell = session -> archive ? shell_create(session -> archive) : NULL;
+  if (!session -> shell) {
+    scrollback_destroy(session -> archive);
+    free(session);
+    return false;
+  }
+
+  if (gActive >= 0) session_store(gSessions[gActive]);
+  session -> id = gNextId++;
+  gSessions[gCount++] = session;
+  session_show(gCount - 1);
+  return true;
+}
+
+// Closes the shown tab, cancelling its commands; the last tab stays open (UI thread)
+bool session_close(void) {
+  if (gCount <= 1) return false;
+
+  if (pager_active()) pager_close();
+  histsearch_close();
+
+  int index = gActive;
+  session_free(gSessions[index]);
+  memmove( & gSessions[index], & gSessions[index + 1], (size_t)(gCount - index - 1) * sizeof(Session * ));
+  gCount--;
+  session_show(index < gCount ? index : gCount - 1);
+  return true;
+}
+
+// Shows another tab; switching only swaps the lines on screen (UI thread)
+bool session_activate(int index) {
+  if (index < 0 || index >= gCount || index == gActive) return false;
+  session_store(gSessions[gActive]);
+  session_show(index);
+  return true;
+}
+
+int session_count(void) {
+  return gCount;
+}
+
+int session_active_index(void) {
+  return gActive;
+}
+
+// Label for a tab: the last command run in it
+const char * session_title(int index) {
+  return index >= 0 && index < gCount ? shell_title(gSessions[index] -> shell) : "";
+}
+
+bool session_unseen(int index) {
+  return index >= 0 && index < gCount && gSessions[index] -> unseen;
+}
+
+int session_id(int index) {
+  return index >= 0 && index < gCount ? gSessions[index] -> id : 0;
+}
+
+// Index of the tab with the given id, or -1 once it is closed
+int session_find(int id) {
+  for (int i = 0; i < gCount; i++) {
+    if (gSessions[i] -> id == id) return i;
+  }
+  return -1;
+}
+
+// Lines of a background tab, for showing it in a pane; the active tab's are in the main loop
+int session_line_count(int index) {
+  return index >= 0 && index < gCount ? shell_parked_count(gSessions[index] -> shell) : 0;
+}
+
+const char * session_line(int index, int line) {
+  return index >= 0 && index < gCount ? shell_parked_line(gSessions[index] -> shell, line) : "";
+}
+
+// Changes whenever a background tab's lines do
+Uint32 session_version(int index) {
+  return index >= 0 && index < gCount ? shell_parked_version(gSessions[index] -> shell) : 0;
+}
+
+// A background tab shown in a pane has no output left unseen
+void session_mark_seen(int index) {
+  if (index >= 0 && index < gCount) gSessions[index] -> unseen = false;
+}
+
+// Takes in the output of background tabs and lets every archive compress and spill.
+// Background tabs are never laid out or drawn (UI thread)
+void session_poll(void) {
+  for (int i = 0; i < gCount; i++) {
+    if (i != gActive && shell_poll_parked(gSessions[i] -> shell)) gSessions[i] -> unseen = true;
+    scrollback_update(gSessions[i] -> archive);
+  }
+}
+
+// Stops every tab's worker and frees its scrollback; must run before threadpool_shutdown()
+void session_cleanup(void) {
+  for (int i = 0; i < gCount; i++) session_free(gSessions[i]);
+  gCount = 0;
+  gActive = -1;
+}
+
+static Scrollback * session_archive(void) {
+  return gActive >= 0 ? gSessions[gActive] -> archive : NULL;
+}
+
+static bool session_write(FILE * stream, const void * data, size_t length, Uint64 * offset) {
+  if (length > 0 && fwrite(data, 1, length, stream) != length) return false;
+  * offset += length;
+  return true;
+}
+
+// Pads to the next 8-byte boundary so mapped tables can be read in place
+static bool session_align(FILE * stream, Uint64 * offset) {
+  static const char zeros[8] = { 0 };
+  return session_write(stream, zeros, (size_t)((8 - * offset % 8) % 8), offset);
+}
+
+// Saves the shown tab. Writes to a temporary file first so a failed save never loses the
+// previous one (UI thread)
+bool session_save(const char * path, char output[][INPUT_BUFFER_SIZE], int lineCount) {
+  if (!path || !output || !gInputBuffer || lineCount < 0 || lineCount > MAX_LINES) return false;
+
+  char temp[MAX_PATH];
+  if (snprintf(temp, sizeof(temp), "%s.tmp", path) >= (int) sizeof(temp)) return false;
+  FILE * stream = fopen(temp, "wb");
+  if (!stream) return false;
+
+  SessionHeader header;
+  memset( & header, 0, sizeof(header));
+  Uint64 offset = 0;
+  bool saved = session_write(stream, & header, sizeof(header), & offset);
+
+  // Cold blocks are copied still compressed, so saving costs little more than the copy
+  Scrollback * archive = session_archive();
+  int blockCount = scrollback_block_count(archive);
+  ScrollbackBlockInfo * blocks = (ScrollbackBlockInfo * ) calloc(blockCount > 0 ? (size_t) blockCount : 1, sizeof(ScrollbackBlockInfo));
+  if (!blocks) saved = false;
+  for (int b = 0; saved && b < blockCount; b++) {
+    unsigned char * packed = scrollback_pack_block(archive, b, & blocks[b]);
+    blocks[b].offset = offset;
+    saved = packed && session_write(stream, packed, blocks[b].packedLength, & offset);
+    header.archivedLines += blocks[b].lineCount;
+    free(packed);
+  }
+
+  saved = saved && session_align(stream, & offset);
+  header.blockTable = offset;
+  saved = saved && session_write(stream, blocks, (size_t) blockCount * sizeof(ScrollbackBlockInfo), & offset);
+  free(blocks);
+
+  Uint32 lengths[MAX_LINES];
+  for (int i = 0; i < lineCount; i++) lengths[i] = (Uint32) strlen(output[i]);
+  saved = saved && session_align(stream, & offset);
+  header.outputTable = offset;
+  saved = saved && session_write(stream, lengths, (size_t) lineCount * sizeof(Uint32), & offset);
+  for (int i = 0; saved && i < lineCount; i++) {
+    saved = session_write(stream, output[i], lengths[i], & offset);
+  }
+
+  memcpy(header.magic, SESSION_MAGIC, sizeof(header.magic));
+  header.version = SESSION_VERSION;
+  header.headerSize = sizeof(SessionHeader);
+  header.blockCount = blockCount;
+  header.outputLines = lineCount;
+  header.cursorPos = gCursorPos ? * gCursorPos : 0;
+  header.wordWrap = wordWrapEnabled;
+  if (gSelection) header.selection = * gSelection;
+  header.backgroundEnabled = backgroundConfig.enabled;
+  header.backgroundScaleMode = backgroundConfig.scaleMode;
+  header.backgroundOpacity = gui_get_background_opacity();
+  memcpy(header.backgroundPath, backgroundConfig.imagePath, sizeof(header.backgroundPath));
+  header.backgroundPath[sizeof(header.backgroundPath) - 1] = '\0';
+  memcpy(header.input, gInputBuffer, sizeof(header.input));
+  header.input[sizeof(header.input) - 1] = '\0';
+
+  // The header goes in last, so a torn write never looks like a valid session
+  saved = saved && fseek(stream, 0, SEEK_SET) == 0 && fwrite( & header, sizeof(header), 1, stream) == 1;
+  if (fclose(stream) != 0) saved = false;
+
+  // A restored session may still be mapped from the file being replaced
+  if (saved && !MoveFileExA(temp, path, MOVEFILE_REPLACE_EXISTING))
+    saved = scrollback_detach(archive) && MoveFileExA(temp, path, MOVEFILE_REPLACE_EXISTING);
+  if (!saved) DeleteFileA(temp);
+  return saved;
+}
+
+// Bounds checks every table so nothing read later can fall outside the mapping
+static bool session_valid(const MappedFile * file) {
+  if (file -> size < sizeof(SessionHeader)) return false;
+  const SessionHeader * header = (const SessionHeader * ) file -> data;
+  if (memcmp(header -> magic, SESSION_MAGIC, sizeof(header -> magic)) != 0 ||
+    header -> version != SESSION_VERSION || header -> headerSize != sizeof(SessionHeader))
+    return false;
+
+  if (header -> blockCount < 0 || header -> outputLines < 0 || header -> outputLines > MAX_LINES ||
+    header -> blockTable % 8 != 0 || header -> outputTable % 8 != 0 ||
+    header -> blockTable > file -> size || header -> outputTable > file -> size ||
+    (Uint64) header -> blockCount * sizeof(ScrollbackBlockInfo) > file -> size - header -> blockTable ||
+    (Uint64) header -> outputLines * sizeof(Uint32) > file -> size - header -> outputTable)
+    return false;
+
+  const Uint32 * lengths = (const Uint32 * )(file -> data + header -> outputTable);
+  Uint64 text = header -> outputTable + (Uint64) header -> outputLines * sizeof(Uint32);
+  for (int i = 0; i < header -> outputLines; i++) {
+    if (lengths[i] >= INPUT_BUFFER_SIZE || lengths[i] > file -> size - text) return false;
+    text += lengths[i];
+  }
+  return true;
+}
+
+// Maps a saved session into the shown tab; the archived blocks stay in the mapping and are
+// only expanded when scrolled to (UI thread)
+bool session_load(const char * path, char output[][INPUT_BUFFER_SIZE], int * lineCount) {
+  if (!path || !output || !lineCount || !gInputBuffer) return false;
+
+  MappedFile file;
+  if (!mapfile_open( & file, path)) return false;
+
+  const SessionHeader * header = (const SessionHeader * ) file.data;
+  if (!session_valid( & file)) {
+    mapfile_close( & file);
+    return false;
+  }
+
+  // The pager reads archived lines by index, which the restore is about to change
+  if (pager_active()) pager_close();
+
+  const char * data = file.data;
+  const ScrollbackBlockInfo * blocks = (const ScrollbackBlockInfo * )(data + header -> blockTable);
+  if (!scrollback_restore(session_archive(), & file, blocks, header -> blockCount)) {
+    mapfile_close( & file);
+    return false;
+  }
+  // The scrollback owns the mapping now and keeps it open, so the header stays readable
+
+  const Uint32 * lengths = (const Uint32 * )(data + header -> outputTable);
+  const char * text = (const char * )(lengths + header -> outputLines);
+  for (int i = 0; i < header -> outputLines; i++) {
+    memcpy(output[i], text, lengths[i]);
+    output[i][lengths[i]] = '\0';
+    text += lengths[i];
+  }
+  * lineCount = header -> outputLines;
+
+  memcpy(gInputBuffer, header -> input, INPUT_BUFFER_SIZE);
+  gInputBuffer[INPUT_BUFFER_SIZE - 1] = '\0';
+  int inputLength = (int) strlen(gInputBuffer);
+  if (gCursorPos) * gCursorPos = header -> cursorPos < 0 ? 0 : header -> cursorPos > inputLength ? inputLength : header -> cursorPos;
+
+  // A selection that no longer fits the restored lines is dropped
+  if (gSelection) {
+    TextSelection selection = header -> selection;
+    bool fits = selection.startLine >= 0 && selection.endLine >= 0 &&
+      selection.startLine <= * lineCount && selection.endLine <= * lineCount;
+    if (fits) {
+      * gSelection = selection;
+    } else {
+      memset(gSelection, 0, sizeof( * gSelection));
+    }
+  }
+
+  wordWrapEnabled = header -> wordWrap ? 1 : 0;
+  gui_set_background_opacity(header -> backgroundOpacity);
+  backgroundConfig.scaleMode = header -> backgroundScaleMode;
+  char imagePath[sizeof(header -> backgroundPath)];
+  memcpy(imagePath, header -> backgroundPath, sizeof(imagePath));
+  imagePath[sizeof(imagePath) - 1] = '\0';
+  if (header -> backgroundEnabled && imagePath[0] && gui_set_background_image(imagePath)) {
+    snprintf(backgroundConfig.imagePath, sizeof(backgroundConfig.imagePath), "%s", imagePath);
+    backgroundConfig.enabled = 1;
+  } else {
+    gui_cleanup_background();
+    backgroundConfig.enabled = 0;
+  }
+
+  layout_invalidate();
+  return true;
+}
@@ -8,6 +8,8 @@
 
 #include <stdbool.h>
 
+#include <stdarg.h>
+
 #include <SDL.h>
 
 #include "config.h"
@@ -16,6 +18,24 @@
 
 #include "gui.h"
 
+#include "layout.h"
+
+#include "fileview.h"
+
+#include "grep.h"
+
+#include "follow.h"
+
+#include "pager.h"
+
+#include "watch.h"
+
+#include "recorder.h"
+
+#include "scrollback.h"
+
+#include "session.h"
+
 // External declaration for wordWrapEnabled (defined in main.c)
 extern int wordWrapEnabled;
 
@@ -23,17 +43,899 @@ static bool shouldExit = false;
 static bool exitRequested = false;
 static Uint32 exitRequestTime = 0;
 
+// Messages streamed from the command worker to the UI thread
+typedef enum {
+  MSG_LINE,
+  MSG_BLOCK, // Several lines, each terminated by '\n'
+  MSG_CLEAR,
+  MSG_BACKGROUND,
+  MSG_WORDWRAP,   // index is the new setting
+  MSG_OPACITY,    // text is the new background opacity
+  MSG_EXIT,       // exit/quit ran; starts the grace period on the UI thread
+  // Requests that open a view, from here to MSG_SESSION_LOAD
+  MSG_PAGER_FILE, // Open the named file in the pager
+  MSG_PAGER_TEXT, // Open captured output in the pager
+  MSG_PAGER_SCROLLBACK, // Page through the archived and current output
+  MSG_SESSION_SAVE, // Save the session to the named file
+  MSG_SESSION_LOAD, // Replace the session with the named file
+  MSG_WATCH_OPEN,
+  MSG_WATCH_SIZE,
+  MSG_WATCH_LINE,
+  MSG_DONE
+} ShellMessageKind;
+
+typedef struct ShellMessage {
+  ShellMessageKind kind;
+  int taskId;
+  int index;             // MSG_WATCH_SIZE: row count, MSG_WATCH_LINE: row
+  SDL_Surface * surface; // MSG_BACKGROUND: image to show, NULL clears it
+  struct ShellMessage * next;
+  char text[];
+}
+ShellMessage;
+
+typedef struct ShellTask {
+  int id;
+  struct ShellTask * next;
+  struct ShellContext * context; // Session the task was submitted from
+  char( * scrollback)[INPUT_BUFFER_SIZE]; // Copy of the output for commands that read it
+  int scrollbackLines;
+  size_t archivedLines; // Lines in the archive when the copy was taken
+  char * capture; // Output collected for "| less" instead of being printed
+  size_t captureLength;
+  size_t captureCapacity;
+  bool capturing;
+  char input[];
+}
+ShellTask;
+
+// A session's command worker, the messages it streams back and the output kept while
+// the session is in the background
+struct ShellContext {
+  Scrollback * archive; // Owned by the session
+
+  SDL_Thread * workerThread;
+  SDL_mutex * workerLock;
+  SDL_cond * workerCond;
+  ShellTask * taskHead;
+  ShellTask * taskTail;
+  bool workerStopping;
+
+  SDL_mutex * messageLock;
+  ShellMessage * messageHead;
+  ShellMessage * messageTail;
+  ShellMessage * deferredHead; // Pager and session requests held until the session is shown (UI thread only)
+  ShellMessage * deferredTail;
+
+  SDL_atomic_t cancelThrough; // Tasks with an id up to this one are cancelled
+  int newestTaskId;           // UI thread only
+  int lastDoneId;             // UI thread only
+
+  // The output while the session is in the background, oldest line first. Each line is its
+  // own allocation so an idle session costs about what it shows.
+  char * parked[MAX_LINES];
+  int parkedStart;
+  int parkedCount;
+  Uint32 parkedVersion; // Bumped whenever the parked lines change
+  char title[SHELL_TITLE_LENGTH]; // Last command submitted
+  FileView view;                  // Paged file, touched only by the thread running the commands
+  WatchPanel * watch;             // Created by the first watch run in the session (UI thread only)
+};
+
+static SDL_TLSID currentTaskKey = 0; // Task being run by the calling thread, if any
+static ShellContext * active = NULL; // Session shown in the window (UI thread only)
+static int nextTaskId = 1;           // Ids increase across all sessions (UI thread only)
+static FileView inlineView;          // For commands run without a session, e.g. in batch mode
+static ShellLineSink lineSink = NULL; // Takes inline output line by line instead of the output buffer
+
+// Output rate, measured by the UI thread as it drains messages
+static Uint32 floodWindowStart = 0;
+static size_t floodWindowBytes = 0;
+static bool flooding = false;
+
+static ShellTask * shell_current_task(void) {
+  return currentTaskKey ? (ShellTask * ) SDL_TLSGet(currentTaskKey) : NULL;
+}
+
+static void shell_capture_append(ShellTask * task, const char * text, size_t length, bool addNewline) {
+  size_t needed = task -> captureLength + length + 1;
+  if (needed > task -> captureCapacity) {
+    size_t capacity = task -> captureCapacity ? task -> captureCapacity * 2 : 65536;
+    while (capacity < needed) capacity *= 2;
+    char * grown = (char * ) realloc(task -> capture, capacity);
+    if (!grown) return;
+    task -> capture = grown;
+    task -> captureCapacity = capacity;
+  }
+  memcpy(task -> capture + task -> captureLength, text, length);
+  task -> captureLength += length;
+  if (addNewline) task -> capture[task -> captureLength++] = '\n';
+}
+
+static void shell_post_indexed(ShellTask * task, ShellMessageKind kind, int index, const char * text, size_t length, SDL_Surface * surface) {
+  ShellMessage * message = (ShellMessage * ) malloc(sizeof(ShellMessage) + length + 1);
+  if (!message) {
+    if (surface) SDL_FreeSurface(surface);
+    return;
+  }
+
+  message -> kind = kind;
+  message -> taskId = task -> id;
+  message -> index = index;
+  message -> surface = surface;
+  message -> next = NULL;
+  if (length > 0) memcpy(message -> text, text, length);
+  message -> text[length] = '\0';
+
+  ShellContext * context = task -> context;
+  SDL_LockMutex(context -> messageLock);
+  if (context -> messageTail) {
+    context -> messageTail -> next = message;
+  } else {
+    context -> messageHead = message;
+  }
+  context -> messageTail = message;
+  SDL_UnlockMutex(context -> messageLock);
+}
+
+static void shell_post(ShellTask * task, ShellMessageKind kind, const char * text, size_t length, SDL_Surface * surface) {
+  shell_post_indexed(task, kind, 0, text, length, surface);
+}
+
+// Moves the oldest lines into the archive so that count more fit, shifting the rest once
+static void shell_make_room_in(Scrollback * archive, char output[][INPUT_BUFFER_SIZE], int * lineCount, int count) {
+  int drop = * lineCount + count - MAX_LINES;
+  if (drop <= 0) return;
+  if (drop > * lineCount) drop = * lineCount;
+
+  for (int i = 0; archive && i < drop; i++) scrollback_append(archive, output[i], strlen(output[i]));
+
+  for (int i = 0; i + drop < * lineCount; i++) {
+    strcpy(output[i], output[i + drop]);
+  }
+  * lineCount -= drop;
+  layout_invalidate();
+}
+
+static void shell_make_room(char output[][INPUT_BUFFER_SIZE], int * lineCount, int count) {
+  // A worker task scrolls its own copy of the output, which is not archived again
+  shell_make_room_in(shell_current_task() ? NULL : shell_scrollback(), output, lineCount, count);
+}
+
+// Drops the oldest line when the output is full
+static void shell_scroll_output(char output[][INPUT_BUFFER_SIZE], int * lineCount) {
+  shell_make_room(output, lineCount, 1);
+}
+
+// Sends every line printed outside a worker task to sink as it is produced, so nothing is
+// lost to the size of the output buffer (batch mode); NULL goes back to the buffer
+void shell_set_line_sink(ShellLineSink sink) {
+  lineSink = sink;
+}
+
+// Appends one formatted line to the output if there is room for it
+void shell_print(char output[][INPUT_BUFFER_SIZE], int * lineCount, const char * format, ...) {
+  if (!format) return;
+
+  va_list args;
+  va_start(args, format);
+
+  // Inside a worker task the line is streamed to the UI thread instead
+  ShellTask * task = shell_current_task();
+  if (task) {
+    char line[INPUT_BUFFER_SIZE];
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (task -> capturing) {
+      shell_capture_append(task, line, strlen(line), true);
+    } else {
+      shell_post(task, MSG_LINE, line, strlen(line), NULL);
+    }
+    return;
+  }
+
+  if (lineSink) {
+    char line[INPUT_BUFFER_SIZE];
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    lineSink(line);
+    return;
+  }
+
+  if (!output || !lineCount || * lineCount >= MAX_LINES) {
+    va_end(args);
+    return;
+  }
+
+  vsnprintf(output[ * lineCount], INPUT_BUFFER_SIZE, format, args);
+  va_end(args);
+
+  recorder_output_line(output[ * lineCount]);
+  ( * lineCount) ++;
+}
+
+static void shell_store_line(char output[][INPUT_BUFFER_SIZE], int * lineCount, const char * text, size_t length) {
+  if (length > INPUT_BUFFER_SIZE - 1) length = INPUT_BUFFER_SIZE - 1;
+
+  shell_scroll_output(output, lineCount);
+  memcpy(output[ * lineCount], text, length);
+  output[ * lineCount][length] = '\0';
+  ( * lineCount) ++;
+}
+
+// Appends a line, scrolling the oldest one out when the output is full
+void shell_append_line(char output[][INPUT_BUFFER_SIZE], int * lineCount, const char * text) {
+  if (!output || !lineCount || !text) return;
+  if (lineSink && !shell_current_task()) {
+    lineSink(text);
+    return;
+  }
+
+  shell_store_line(output, lineCount, text, strlen(text));
+  recorder_output_line(output[ * lineCount - 1]);
+}
+
+// Prints a block of '\n'-terminated lines; a worker task sends it as one message
+void shell_print_lines(char output[][INPUT_BUFFER_SIZE], int * lineCount, const char * text, size_t length) {
+  if (!text || length == 0) return;
+
+  ShellTask * task = shell_current_task();
+  if (task && task -> capturing) {
+    shell_capture_append(task, text, length, false);
+    return;
+  }
+  if (task) {
+    shell_post(task, MSG_BLOCK, text, length, NULL);
+    return;
+  }
+
+  const char * end = text + length;
+  while (text < end) {
+    const char * newline = (const char * ) memchr(text, '\n', (size_t)(end - text));
+    const char * lineEnd = newline ? newline : end;
+    shell_print(output, lineCount, "%.*s", (int)(lineEnd - text), text);
+    text = lineEnd + 1;
+  }
+}
+
+static void shell_clear_output(int * lineCount) {
+  ShellTask * task = shell_current_task();
+  if (task && task -> capturing) {
+    task -> captureLength = 0;
+    return;
+  }
+  if (task) {
+    shell_post(task, MSG_CLEAR, NULL, 0, NULL);
+    return;
+  }
+  * lineCount = 0;
+  layout_invalidate();
+}
+
+// Keeps the configuration in step with the image shown so a session save records it (UI thread)
+static void shell_note_background(const char * imagePath) {
+  backgroundConfig.enabled = imagePath != NULL;
+  if (imagePath) snprintf(backgroundConfig.imagePath, sizeof(backgroundConfig.imagePath), "%s", imagePath);
+}
+
+// Session files hold the editing state, so they are saved and loaded on the UI thread
+static void shell_session(bool save, const char * path, char output[][INPUT_BUFFER_SIZE], int * lineCount) {
+  char line[INPUT_BUFFER_SIZE];
+  if (save && session_save(path, output, * lineCount)) {
+    snprintf(line, sizeof(line), "Session saved to %.*s", INPUT_BUFFER_SIZE - 32, path);
+  } else if (save) {
+    snprintf(line, sizeof(line), "\033[31msession: cannot write %.*s\033[0m", INPUT_BUFFER_SIZE - 32, path);
+  } else if (session_load(path, output, lineCount)) {
+    snprintf(line, sizeof(line), "Session restored from %.*s (%zu lines)", INPUT_BUFFER_SIZE - 64, path,
+      scrollback_line_count(shell_scrollback()) + (size_t) * lineCount);
+  } else {
+    snprintf(line, sizeof(line), "\033[31msession: %.*s is not a session file\033[0m", INPUT_BUFFER_SIZE - 48, path);
+  }
+  shell_append_line(output, lineCount, line);
+}
+
+// The renderer reads these every frame, so a worker hands them to the UI thread
+static void shell_set_wordwrap(int enabled) {
+  ShellTask * task = shell_current_task();
+  if (task) {
+    shell_post_indexed(task, MSG_WORDWRAP, enabled, NULL, 0, NULL);
+  } else {
+    wordWrapEnabled = enabled;
+  }
+}
+
+static void shell_set_opacity(const char * opacity) {
+  ShellTask * task = shell_current_task();
+  if (task) {
+    shell_post(task, MSG_OPACITY, opacity, strlen(opacity), NULL);
+  } else {
+    gui_set_background_opacity((float) atof(opacity));
+  }
+}
+
+// shell_should_exit() reads the request every frame, so a worker hands it to the UI thread
+static void shell_request_exit(void) {
+  ShellTask * task = shell_current_task();
+  if (task) {
+    shell_post(task, MSG_EXIT, NULL, 0, NULL);
+  } else {
+    exitRequestTime = SDL_GetTicks();
+    exitRequested = true;
+  }
+}
+
+static void shell_set_background(const char * imagePath) {
+  ShellTask * task = shell_current_task();
+  if (task) {
+    // Decode on the worker; the texture is created on the render thread
+    SDL_Surface * surface = imagePath ? gui_load_background_surface(imagePath) : NULL;
+    if (!imagePath || surface) shell_post(task, MSG_BACKGROUND, imagePath, imagePath ? strlen(imagePath) : 0, surface);
+    return;
+  }
+
+  if (imagePath) {
+    if (gui_set_background_image(imagePath)) shell_note_background(imagePath);
+  } else {
+    gui_cleanup_background();
+    shell_note_background(NULL);
+  }
+}
+
+static int shell_worker(void * data) {
+  ShellContext * context = (ShellContext * ) data;
+  char scratch[1][INPUT_BUFFER_SIZE];
+
+  for (;;) {
+    SDL_LockMutex(context -> workerLock);
+    while (!context -> taskHead && !context -> workerStopping) {
+      SDL_CondWait(context -> workerCond, context -> workerLock);
+    }
+    ShellTask * task = context -> taskHead;
+    if (!task) {
+      SDL_UnlockMutex(context -> workerLock);
+      break;
+    }
+    context -> taskHead = task -> next;
+    if (!context -> taskHead) context -> taskTail = NULL;
+    SDL_UnlockMutex(context -> workerLock);
+
+    if (task -> id > SDL_AtomicGet( & context -> cancelThrough)) {
+      int scratchCount = 0;
+      SDL_TLSSet(currentTaskKey, task, NULL);
+      if (task -> scrollback) {
+        shell_execute(task -> input, task -> scrollback, & task -> scrollbackLines);
+      } else {
+        shell_execute(task -> input, scratch, & scratchCount);
+      }
+      SDL_TLSSet(currentTaskKey, NULL, NULL);
+    }
+
+    shell_post(task, MSG_DONE, NULL, 0, NULL);
+    free(task -> scrollback);
+    free(task -> capture);
+    free(task);
+  }
+
+  return 0;
+}
+
+// Archives the oldest background lines so that count more fit
+static void shell_parked_room(ShellContext * context, int count) {
+  while (context -> parkedCount > 0 && context -> parkedCount + count > MAX_LINES) {
+    char * line = context -> parked[context -> parkedStart];
+    scrollback_append(context -> archive, line, strlen(line));
+    free(line);
+    context -> parkedStart = (context -> parkedStart + 1) % MAX_LINES;
+    context -> parkedCount--;
+    context -> parkedVersion++;
+  }
+}
+
+static void shell_parked_store(ShellContext * context, const char * text, size_t length) {
+  if (length > INPUT_BUFFER_SIZE - 1) length = INPUT_BUFFER_SIZE - 1;
+  shell_parked_room(context, 1);
+
+  char * line = (char * ) malloc(length + 1);
+  if (!line) return;
+  memcpy(line, text, length);
+  line[length] = '\0';
+  context -> parked[(context -> parkedStart + context -> parkedCount) % MAX_LINES] = line;
+  context -> parkedCount++;
+  context -> parkedVersion++;
+}
+
+static void shell_parked_clear(ShellContext * context) {
+  for (int i = 0; i < context -> parkedCount; i++) free(context -> parked[(context -> parkedStart + i) % MAX_LINES]);
+  context -> parkedStart = 0;
+  context -> parkedCount = 0;
+  context -> parkedVersion++;
+}
+
+static void shell_free_messages(ShellMessage * message) {
+  while (message) {
+    ShellMessage * next = message -> next;
+    if (message -> surface) SDL_FreeSurface(message -> surface);
+    free(message);
+    message = next;
+  }
+}
+
+// Creates a session's command worker; commands run inline when its thread cannot be started.
+// The archive stays owned by the caller and must outlive the context.
+ShellContext * shell_create(Scrollback * archive) {
+  ShellContext * context = (ShellContext * ) calloc(1, sizeof(ShellContext));
+  if (!context) return NULL;
+
+  context -> archive = archive;
+  context -> messageLock = SDL_CreateMutex();
+  if (!context -> messageLock) {
+    shell_destroy(context);
+    return NULL;
+  }
+
+  if (!currentTaskKey) currentTaskKey = SDL_TLSCreate();
+  context -> workerLock = SDL_CreateMutex();
+  context -> workerCond = SDL_CreateCond();
+  if (currentTaskKey && context -> workerLock && context -> workerCond) {
+    context -> workerThread = SDL_CreateThread(shell_worker, "octo-shell", context);
+  }
+  if (!context -> workerThread) {
+    printf("Command worker unavailable, running commands inline: %s\n", SDL_GetError());
+  }
+  return context;
+}
+
+// Stops the worker, abandoning anything still queued (UI thread)
+void shell_destroy(ShellContext * context) {
+  if (!context) return;
+  if (active == context) active = NULL;
+
+  if (context -> workerThread) {
+    SDL_AtomicSet( & context -> cancelThrough, nextTaskId - 1);
+    SDL_LockMutex(context -> workerLock);
+    context -> workerStopping = true;
+    SDL_CondBroadcast(context -> workerCond);
+    SDL_UnlockMutex(context -> workerLock);
+    SDL_WaitThread(context -> workerThread, NULL);
+  }
+
+  shell_free_messages(context -> messageHead);
+  shell_free_messages(context -> deferredHead);
+  if (context -> workerCond) SDL_DestroyCond(context -> workerCond);
+  if (context -> workerLock) SDL_DestroyMutex(context -> workerLock);
+  if (context -> messageLock) SDL_DestroyMutex(context -> messageLock);
+  shell_parked_clear(context);
+  fileview_cleanup( & context -> view);
+  watch_panel_destroy(context -> watch);
+  free(context);
+}
+
+// Makes context the session that typed commands, Ctrl+C and shell_poll_output apply to (UI thread)
+void shell_use(ShellContext * context) {
+  active = context;
+}
+
+// The archive of the session a command runs in, or of the session shown on the UI thread
+Scrollback * shell_scrollback(void) {
+  ShellTask * task = shell_current_task();
+  if (task) return task -> context -> archive;
+  return active ? active -> archive : NULL;
+}
+
+// Archived lines that come before the output a command sees: for a copy of the output,
+// the archive as it was when the copy was taken
+size_t shell_archived_lines(void) {
+  ShellTask * task = shell_current_task();
+  if (task && task -> scrollback) return task -> archivedLines;
+  return scrollback_line_count(shell_scrollback());
+}
+
+// The paged file of the session a command runs in
+FileView * shell_file_view(void) {
+  ShellTask * task = shell_current_task();
+  if (task) return & task -> context -> view;
+  return active ? & active -> view : & inlineView;
+}
+
+// Watch rows of the session shown, drawn above its output (UI thread)
+WatchPanel * shell_watch_panel(void) {
+  return active ? active -> watch : NULL;
+}
+
+// Last command submitted to the session, for its tab
+const char * shell_title(const ShellContext * context) {
+  return context ? context -> title : "";
+}
+
+// Stores the shown output in the context when its session goes to the background (UI thread)
+void shell_park(ShellContext * context, char output[][INPUT_BUFFER_SIZE], int lineCount) {
+  if (!context || !output) return;
+  shell_parked_clear(context);
+  for (int i = 0; i < lineCount; i++) shell_parked_store(context, output[i], strlen(output[i]));
+}
+
+// Puts a background session's output back on screen (UI thread)
+void shell_unpark(ShellContext * context, char output[][INPUT_BUFFER_SIZE], int * lineCount) {
+  if (!context || !output || !lineCount) return;
+  * lineCount = 0;
+  for (int i = 0; i < context -> parkedCount; i++) {
+    const char * line = context -> parked[(context -> parkedStart + i) % MAX_LINES];
+    snprintf(output[( * lineCount) ++], INPUT_BUFFER_SIZE, "%s", line);
+  }
+  shell_parked_clear(context);
+  layout_invalidate();
+}
+
+// Output of a background session, oldest line first, for drawing it in a pane (UI thread)
+int shell_parked_count(const ShellContext * context) {
+  return context ? context -> parkedCount : 0;
+}
+
+const char * shell_parked_line(const ShellContext * context, int line) {
+  if (!context || line < 0 || line >= context -> parkedCount) return "";
+  return context -> parked[(context -> parkedStart + line) % MAX_LINES];
+}
+
+Uint32 shell_parked_version(const ShellContext * context) {
+  return context ? context -> parkedVersion : 0;
+}
+
+// Frees state shared by every session; run after all contexts are destroyed
+void shell_cleanup(void) {
+  fileview_cleanup( & inlineView);
+}
+
+// Queues a command for the worker; runs it inline when there is no worker
+void shell_submit(const char * input, char output[][INPUT_BUFFER_SIZE], int * lineCount) {
+  if (!input) return;
+
+  if (active) snprintf(active -> title, sizeof(active -> title), "%s", input);
+  if (!active || !active -> workerThread) {
+    shell_execute(input, output, lineCount);
+    return;
+  }
+
+  size_t length = strlen(input);
+  ShellTask * task = (ShellTask * ) malloc(sizeof(ShellTask) + length + 1);
+  if (!task) return;
+  task -> id = nextTaskId++;
+  task -> next = NULL;
+  task -> context = active;
+  task -> scrollback = NULL;
+  task -> scrollbackLines = 0;
+  task -> archivedLines = 0;
+  task -> capture = NULL;
+  task -> captureLength = 0;
+  task -> captureCapacity = 0;
+  task -> capturing = false;
+  memcpy(task -> input, input, length + 1);
+  active -> newestTaskId = task -> id;
+
+  // The worker cannot read the live output, so searches and saves get a copy of it
+  const char * command = input;
+  while (isspace((unsigned char) * command)) command++;
+  bool readsOutput = strncmp(command, "grep ", 5) == 0 || strncmp(command, "scrollback save ", 16) == 0;
+  if (readsOutput && * lineCount > 0) {
+    int lines = * lineCount;
+
+    // Leave out the echo of this command
+    if (strncmp(output[lines - 1], "> ", 2) == 0 && strcmp(output[lines - 1] + 2, input) == 0) lines--;
+
+    task -> scrollback = malloc((size_t) lines * INPUT_BUFFER_SIZE + 1);
+    if (task -> scrollback) {
+      memcpy(task -> scrollback, output, (size_t) lines * INPUT_BUFFER_SIZE);
+      task -> scrollbackLines = lines;
+      // Lines archived after this are already in the copy, so searches stop short of them
+      task -> archivedLines = scrollback_line_count(active -> archive);
+    }
+  }
+
+  ShellContext * context = active;
+  SDL_LockMutex(context -> workerLock);
+  if (context -> taskTail) {
+    context -> taskTail -> next = task;
+  } else {
+    context -> taskHead = task;
+  }
+  context -> taskTail = task;
+  SDL_CondSignal(context -> workerCond);
+  SDL_UnlockMutex(context -> workerLock);
+}
+
+// Applies everything the worker produced since the last frame (UI thread)
+// Flood mode starts once output arrives faster than it could usefully be drawn
+static void shell_track_rate(size_t bytes) {
+  Uint32 now = SDL_GetTicks();
+  floodWindowBytes += bytes;
+
+  Uint32 elapsed = now - floodWindowStart;
+  if (elapsed < FLOOD_WINDOW_MS) return;
+  flooding = (Uint64) floodWindowBytes * 1000 / elapsed >= FLOOD_BYTES_PER_SEC;
+  floodWindowStart = now;
+  floodWindowBytes = 0;
+}
+
+// True while command output is arriving faster than FLOOD_BYTES_PER_SEC
+bool shell_flooding(void) {
+  return flooding;
+}
+
+// Stores one drained line on screen, or in the context when output is NULL
+static void shell_drain_line(ShellContext * context, char output[][INPUT_BUFFER_SIZE], int * lineCount, const char * text, size_t length) {
+  if (output) {
+    shell_store_line(output, lineCount, text, length);
+  } else {
+    shell_parked_store(context, text, length);
+  }
+}
+
+// Applies what a session's worker produced since the last frame. Without output the session
+// is in the background: lines are parked and requests that open a view wait (UI thread)
+static bool shell_drain(ShellContext * context, char output[][INPUT_BUFFER_SIZE], int * lineCount) {
+  bool visible = output != NULL;
+  SDL_LockMutex(context -> messageLock);
+  ShellMessage * message = context -> messageHead;
+  context -> messageHead = context -> messageTail = NULL;
+  SDL_UnlockMutex(context -> messageLock);
+
+  if (visible && context -> deferredHead) {
+    context -> deferredTail -> next = message;
+    message = context -> deferredHead;
+    context -> deferredHead = context -> deferredTail = NULL;
+  }
+
+  int cancelled = SDL_AtomicGet( & context -> cancelThrough);
+
+  // Only the newest MAX_LINES lines since the last clear can survive this batch
+  ShellMessage * lastClear = NULL;
+  int pending = 0;
+  size_t bytes = 0;
+  for (ShellMessage * scan = message; scan; scan = scan -> next) {
+    if (scan -> taskId <= cancelled) continue;
+    if (scan -> kind == MSG_CLEAR) {
+      lastClear = scan;
+      pending = 0;
+    } else if (scan -> kind == MSG_LINE) {
+      pending++;
+      bytes += strlen(scan -> text) + 1;
+    } else if (scan -> kind == MSG_BLOCK) {
+      for (const char * p = scan -> text;
+        (p = strchr(p, '\n')) != NULL; p++) pending++;
+      bytes += strlen(scan -> text);
+    }
+  }
+  if (visible) shell_track_rate(bytes);
+
+  bool changed = pending > 0 || lastClear != NULL;
+  bool storing = lastClear == NULL;
+  int skip = pending > MAX_LINES ? pending - MAX_LINES : 0;
+
+  // Scroll the surviving lines in with one shift rather than one per line
+  if (storing && visible) {
+    shell_make_room_in(context -> archive, output, lineCount, pending - skip);
+  } else if (storing) {
+    shell_parked_room(context, pending - skip);
+  }
+
+  while (message) {
+    ShellMessage * next = message -> next;
+    bool live = message -> taskId > cancelled;
+
+    // Opening a view now would cover the session being shown
+    if (live && !visible && message -> kind >= MSG_PAGER_FILE && message -> kind <= MSG_SESSION_LOAD) {
+      message -> next = NULL;
+      if (context -> deferredTail) {
+        context -> deferredTail -> next = message;
+      } else {
+        context -> deferredHead = message;
+      }
+      context -> deferredTail = message;
+      message = next;
+      continue;
+    }
+
+    switch (message -> kind) {
+    case MSG_LINE:
+      if (!live) break;
+      if (visible) recorder_output_line(message -> text);
+      if (!storing) break;
+      if (skip > 0) {
+        // Lines that would scroll straight out again go to the scrollback directly
+        scrollback_append(context -> archive, message -> text, strlen(message -> text));
+        skip--;
+        break;
+      }
+      shell_drain_line(context, output, lineCount, message -> text, strlen(message -> text));
+      break;
+    case MSG_BLOCK:
+      if (!live) break;
+      for (char * line = message -> text, * newline;
+        (newline = strchr(line, '\n')) != NULL; line = newline + 1) {
+        * newline = '\0';
+        if (visible) recorder_output_line(line);
+        if (!storing) continue;
+        if (skip > 0) {
+          scrollback_append(context -> archive, line, (size_t)(newline - line));
+          skip--;
+          continue;
+        }
+        shell_drain_line(context, output, lineCount, line, (size_t)(newline - line));
+      }
+      break;
+    case MSG_CLEAR:
+      if (live && visible) {
+        * lineCount = 0;
+        layout_invalidate();
+      } else if (live) {
+        shell_parked_clear(context);
+      }
+      if (message == lastClear) storing = true;
+      break;
+    case MSG_BACKGROUND:
+      if (live && message -> surface) {
+        if (gui_set_background_surface(message -> surface)) shell_note_background(message -> text);
+      } else if (live) {
+        gui_cleanup_background();
+        shell_note_background(NULL);
+      } else if (message -> surface) {
+        SDL_FreeSurface(message -> surface);
+      }
+      break;
+    case MSG_WORDWRAP:
+      if (live) wordWrapEnabled = message -> index;
+      break;
+    case MSG_OPACITY:
+      if (live) gui_set_background_opacity((float) atof(message -> text));
+      break;
+    case MSG_EXIT:
+      if (live) {
+        exitRequestTime = SDL_GetTicks();
+        exitRequested = true;
+      }
+      break;
+    case MSG_PAGER_FILE:
+      if (live && !pager_open_file(message -> text)) {
+        char error[INPUT_BUFFER_SIZE];
+        snprintf(error, sizeof(error), "\033[31mless: cannot open %.*s\033[0m", INPUT_BUFFER_SIZE - 32, message -> text);
+        shell_append_line(output, lineCount, error);
+      }
+      break;
+    case MSG_PAGER_TEXT:
+      if (live) pager_open_text(message -> text, strlen(message -> text), "(output)");
+      break;
+    case MSG_PAGER_SCROLLBACK:
+      if (live) pager_open_scrollback(output, * lineCount);
+      break;
+    case MSG_SESSION_SAVE:
+    case MSG_SESSION_LOAD:
+      if (live) shell_session(message -> kind == MSG_SESSION_SAVE, message -> text, output, lineCount);
+      break;
+    case MSG_WATCH_OPEN:
+      // A background session's panel keeps up to date and appears when the session is shown
+      if (live && !context -> watch) context -> watch = watch_panel_create();
+      if (live) watch_panel_open(context -> watch, message -> taskId, message -> text);
+      break;
+    case MSG_WATCH_SIZE:
+      if (live) watch_panel_resize(context -> watch, message -> index);
+      break;
+    case MSG_WATCH_LINE:
+      if (live) watch_panel_set_line(context -> watch, message -> index, message -> text);
+      break;
+    case MSG_DONE:
+      watch_panel_task_done(context -> watch, message -> taskId);
+      context -> lastDoneId = message -> taskId;
+      break;
+    }
+
+    free(message);
+    message = next;
+  }
+  return changed;
+}
+
+void shell_poll_output(char output[][INPUT_BUFFER_SIZE], int * lineCount) {
+  if (!active || !output || !lineCount) return;
+  shell_drain(active, output, lineCount);
+}
+
+// Takes in a background session's output; true when its lines changed (UI thread)
+bool shell_poll_parked(ShellContext * context) {
+  if (!context || context == active) return false;
+  return shell_drain(context, NULL, NULL);
+}
+
+// Appends '\n'-separated lines that arrived from outside the command worker, such as
+// the control socket, with the same flood handling as worker output (UI thread)
+void shell_append_block(char output[][INPUT_BUFFER_SIZE], int * lineCount, const char * text, size_t length) {
+  if (!output || !lineCount || !text || length == 0) return;
+  shell_track_rate(length);
+
+  const char * end = text + length;
+  int pending = text[length - 1] != '\n';
+  for (const char * p = text; (p = (const char * ) memchr(p, '\n', (size_t)(end - p))) != NULL; p++) pending++;
+  int skip = pending > MAX_LINES ? pending - MAX_LINES : 0;
+  shell_make_room(output, lineCount, pending - skip);
+
+  char line[INPUT_BUFFER_SIZE];
+  while (text < end) {
+    const char * newline = (const char * ) memchr(text, '\n', (size_t)(end - text));
+    const char * lineEnd = newline ? newline : end;
+    size_t lineLength = (size_t)(lineEnd - text);
+    if (lineLength > 0 && text[lineLength - 1] == '\r') lineLength--;
+    if (lineLength > INPUT_BUFFER_SIZE - 1) lineLength = INPUT_BUFFER_SIZE - 1;
+    memcpy(line, text, lineLength);
+    line[lineLength] = '\0';
+    text = lineEnd + 1;
+
+    recorder_output_line(line);
+    if (skip > 0) {
+      scrollback_append(shell_scrollback(), line, lineLength);
+      skip--;
+      continue;
+    }
+    shell_store_line(output, lineCount, line, lineLength);
+  }
+}
+
+bool shell_busy(void) {
+  if (!active) return false;
+  int newest = active -> newestTaskId;
+  return active -> lastDoneId < newest && SDL_AtomicGet( & active -> cancelThrough) < newest;
+}
+
+// Cancels the shown session's running command and anything queued behind it (UI thread)
+bool shell_cancel(void) {
+  if (!shell_busy()) return false;
+  SDL_AtomicSet( & active -> cancelThrough, active -> newestTaskId);
+  return true;
+}
+
+// Runs a command on the worker and returns its output as '\n'-terminated lines (caller frees)
+char * shell_run_captured(const char * command, char output[][INPUT_BUFFER_SIZE], int * lineCount, size_t * length) {
+  ShellTask * task = shell_current_task();
+  if (!task || task -> capturing || !command) return NULL;
+
+  task -> capturing = true;
+  task -> captureLength = 0;
+  shell_execute(command, output, lineCount);
+  task -> capturing = false;
+
+  char * text = task -> capture;
+  if (!text) text = (char * ) malloc(1);
+  if (length) * length = text ? task -> captureLength : 0;
+
+  task -> capture = NULL;
+  task -> captureLength = 0;
+  task -> captureCapacity = 0;
+  return text;
+}
+
+// Sends a watch panel update to the UI thread; false outside the command worker
+bool shell_watch_post(ShellWatchUpdate update, int index, const char * text, size_t length) {
+  ShellTask * task = shell_current_task();
+  if (!task) return false;
+
+  static const ShellMessageKind kinds[] = {
+    MSG_WATCH_OPEN,
+    MSG_WATCH_SIZE,
+    MSG_WATCH_LINE
+  };
+  shell_post_indexed(task, kinds[update], index, text, length, NULL);
+  return true;
+}
+
+// Long-running builtins poll this to stop early after Ctrl+C
+bool shell_cancelled(void) {
+  ShellTask * task = shell_current_task();
+  return task && task -> id <= SDL_AtomicGet( & task -> context -> cancelThrough);
+}
+
 void shell_execute(const char * input, char output[][INPUT_BUFFER_SIZE], int * lineCount) {
   if (!input || !output || !lineCount)
     return;
 
   // Scroll output if buffer is full
-  if ( * lineCount >= MAX_LINES) {
-    for (int i = 0; i < MAX_LINES - 1; i++) {
-      strcpy(output[i], output[i + 1]);
-    }
-    ( * lineCount) --;
-  }
+  shell_scroll_output(output, lineCount);
 
   // Trim whitespace from input
   char trimmedInput[INPUT_BUFFER_SIZE];
@@ -48,18 +950,32 @@ void shell_execute(const char * input, char output[][INPUT_BUFFER_SIZE], int * l
   strncpy(trimmedInput, start, len);
   trimmedInput[len] = '\0';
 
+  // "<command> | less" collects the command's output and pages it
+  char * pipe = strrchr(trimmedInput, '|');
+  if (pipe) {
+    const char * target = pipe + 1;
+    while ( * target == ' ') target++;
+    ShellTask * task = shell_current_task();
+
+    if (task && !task -> capturing && (strcmp(target, "less") == 0 || strcmp(target, "pager") == 0)) {
+      * pipe = '\0';
+      size_t length = 0;
+      char * text = shell_run_captured(trimmedInput, output, lineCount, & length);
+      if (text && !shell_cancelled()) shell_post(task, MSG_PAGER_TEXT, text, length, NULL);
+      free(text);
+      return;
+    }
+  }
+
   if (strcmp(trimmedInput, "clear") == 0) {
-    * lineCount = 0;
+    shell_clear_output(lineCount);
     return;
   } else if (strncmp(trimmedInput, "echo ", 5) == 0) {
-    if ( * lineCount < MAX_LINES) {
-      const char * echoText = trimmedInput + 5;
-      // Skip leading spaces after "echo"
-      while ( * echoText == ' ') echoText++;
+    const char * echoText = trimmedInput + 5;
+    // Skip leading spaces after "echo"
+    while ( * echoText == ' ') echoText++;
 
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "\033[32m%s\033[0m", echoText);
-      ( * lineCount) ++;
-    }
+    shell_print(output, lineCount, "\033[32m%s\033[0m", echoText);
   } else if (strncmp(trimmedInput, "wordwrap ", 9) == 0) {
     const char * value = trimmedInput + 9;
 
@@ -67,33 +983,18 @@ void shell_execute(const char * input, char output[][INPUT_BUFFER_SIZE], int * l
     while ( * value == ' ') value++;
 
     if (strcmp(value, "true") == 0 || strcmp(value, "on") == 0 || strcmp(value, "1") == 0) {
-      wordWrapEnabled = 1;
-      if ( * lineCount < MAX_LINES) {
-        snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "\033[32mWord-wrap Enabled \033[0m");
-        ( * lineCount) ++;
-      }
+      shell_set_wordwrap(1);
+      shell_print(output, lineCount, "\033[32mWord-wrap Enabled \033[0m");
     } else if (strcmp(value, "false") == 0 || strcmp(value, "off") == 0 || strcmp(value, "0") == 0) {
-      wordWrapEnabled = 0;
-      if ( * lineCount < MAX_LINES) {
-        snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "Word wrap disabled");
-        ( * lineCount) ++;
-      }
+      shell_set_wordwrap(0);
+      shell_print(output, lineCount, "Word wrap disabled");
     } else {
-      if ( * lineCount < MAX_LINES) {
-        snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "Invalid wordwrap value. Use: true/false, on/off, or 1/0");
-        ( * lineCount) ++;
-      }
+      shell_print(output, lineCount, "Invalid wordwrap value. Use: true/false, on/off, or 1/0");
     }
   } else if (strcmp(trimmedInput, "wordwrap") == 0) {
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "Word wrap is currently: %s",
+    shell_print(output, lineCount, "Word wrap is currently: %s",
         wordWrapEnabled ? "enabled" : "disabled");
-      ( * lineCount) ++;
-    }
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "Usage: wordwrap <true/false>");
-      ( * lineCount) ++;
-    }
+    shell_print(output, lineCount, "Usage: wordwrap <true/false>");
   } else if (strncmp(trimmedInput, "background ", 11) == 0 || strncmp(trimmedInput, "bg ", 3) == 0) {
     const char * args = trimmedInput + (strncmp(trimmedInput, "bg ", 3) == 0 ? 3 : 11);
     while ( * args == ' ') args++; // Skip whitespace
@@ -102,148 +1003,150 @@ void shell_execute(const char * input, char output[][INPUT_BUFFER_SIZE], int * l
       const char * imagePath = args + 4;
       while ( * imagePath == ' ') imagePath++; // Skip whitespace
 
-      gui_set_background_image(imagePath);
-      if ( * lineCount < MAX_LINES) {
-        snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "Background image set to: %s", imagePath);
-        ( * lineCount) ++;
-      }
+      shell_set_background(imagePath);
+      shell_print(output, lineCount, "Background image set to: %s", imagePath);
     } else if (strncmp(args, "opacity ", 8) == 0) {
       const char * opacityStr = args + 8;
       while ( * opacityStr == ' ') opacityStr++; // Skip whitespace
 
       float opacity = atof(opacityStr);
-      gui_set_background_opacity(opacity);
-      if ( * lineCount < MAX_LINES) {
-        snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "Background opacity set to: %.2f", opacity);
-        ( * lineCount) ++;
-      }
+      shell_set_opacity(opacityStr);
+      shell_print(output, lineCount, "Background opacity set to: %.2f", opacity);
     } else if (strcmp(args, "clear") == 0) {
-      gui_cleanup_background();
-      if ( * lineCount < MAX_LINES) {
-        snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "Background image cleared");
-        ( * lineCount) ++;
-      }
+      shell_set_background(NULL);
+      shell_print(output, lineCount, "Background image cleared");
     } else {
-      if ( * lineCount < MAX_LINES) {
-        snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "Usage: background <set path|opacity value|clear>");
-        ( * lineCount) ++;
-      }
+      shell_print(output, lineCount, "Usage: background <set path|opacity value|clear>");
     }
   }  else if (strcmp(trimmedInput, "background") == 0 || strcmp(trimmedInput, "bg") == 0) {
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "Background commands:");
-      ( * lineCount) ++;
-    }
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "  bg set <path> - Set background image");
-      ( * lineCount) ++;
-    }
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "  bg clear - Remove background");
-      ( * lineCount) ++;
-    }
-  } else if (strcmp(trimmedInput, "version") == 0) {
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "OCTO-SHELL Emulator v2.1");
-      ( * lineCount) ++;
-    }
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "Built by Daksh Verma with SDL2");
-      ( * lineCount) ++;
-    }
-  } else if (strcmp(trimmedInput, "help") == 0) {
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "Available commands:");
-      ( * lineCount) ++;
-    }
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "  clear - Clear the screen");
-      ( * lineCount) ++;
-    }
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "  echo <text> - Display text");
-      ( * lineCount) ++;
-    }
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "  wordwrap <true/false> - Toggle word wrapping");
-      ( * lineCount) ++;
+    shell_print(output, lineCount, "Background commands:");
+    shell_print(output, lineCount, "  bg set <path> - Set background image");
+    shell_print(output, lineCount, "  bg clear - Remove background");
+  } else if (strncmp(trimmedInput, "cat ", 4) == 0) {
+    const char * path = trimmedInput + 4;
+    while ( * path == ' ') path++;
+    fileview_cat(path, output, lineCount);
+  } else if (strncmp(trimmedInput, "view ", 5) == 0 || strcmp(trimmedInput, "view") == 0) {
+    fileview_view(trimmedInput + 4, output, lineCount);
+  } else if (strncmp(trimmedInput, "follow ", 7) == 0 || strncmp(trimmedInput, "tail -f ", 8) == 0) {
+    const char * path = trimmedInput + (trimmedInput[0] == 'f' ? 7 : 8);
+    while ( * path == ' ') path++;
+    follow_run(path, output, lineCount);
+  } else if (strncmp(trimmedInput, "less ", 5) == 0 || strncmp(trimmedInput, "pager ", 6) == 0) {
+    const char * path = trimmedInput + (trimmedInput[0] == 'l' ? 5 : 6);
+    while ( * path == ' ') path++;
+
+    ShellTask * task = shell_current_task();
+    if (task) {
+      shell_post(task, MSG_PAGER_FILE, path, strlen(path), NULL);
+    } else if (!pager_open_file(path)) {
+      shell_print(output, lineCount, "\033[31mless: cannot open %s\033[0m", path);
     }
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "  bg - Background image commands");
-      ( * lineCount) ++;
+  } else if (strcmp(trimmedInput, "scrollback") == 0) {
+    ShellTask * task = shell_current_task();
+    if (task) {
+      shell_post(task, MSG_PAGER_SCROLLBACK, NULL, 0, NULL);
+    } else {
+      pager_open_scrollback(output, * lineCount);
     }
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "  version - Show version information");
-      ( * lineCount) ++;
+  } else if (strcmp(trimmedInput, "scrollback stats") == 0) {
+    ScrollbackStats stats;
+    scrollback_stats(shell_scrollback(), & stats);
+    shell_print(output, lineCount, "Scrollback: %zu lines in %d blocks (%d compressed, %d on disk)",
+      stats.lines, stats.blocks, stats.compressedBlocks, stats.spilledBlocks);
+    shell_print(output, lineCount, "  %zu KB of text: %zu KB in memory, %zu KB on disk", stats.rawBytes / 1024,
+      stats.storedBytes / 1024, stats.diskBytes / 1024);
+  } else if (strncmp(trimmedInput, "scrollback save ", 16) == 0) {
+    const char * path = trimmedInput + 16;
+    while ( * path == ' ') path++;
+
+    // The archived lines, then the output as it was when the command was submitted
+    FILE * stream = fopen(path, "wb");
+    size_t lines = 0;
+    bool saved = stream && scrollback_write(shell_scrollback(), stream, shell_archived_lines(), & lines);
+    for (int i = 0; saved && i < * lineCount; i++) {
+      saved = fprintf(stream, "%s\n", output[i]) >= 0;
     }
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "  help - Show this help");
-      ( * lineCount) ++;
+    if (stream && fclose(stream) != 0) saved = false;
+
+    if (saved) {
+      shell_print(output, lineCount, "Saved %zu lines to %s", lines + (size_t) * lineCount, path);
+    } else {
+      shell_print(output, lineCount, "\033[31mscrollback: cannot write %s\033[0m", path);
     }
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "  shortcuts - Show keyboard shortcuts");
-      ( * lineCount) ++;
+  } else if (strncmp(trimmedInput, "session save", 12) == 0 || strncmp(trimmedInput, "session load", 12) == 0) {
+    bool save = trimmedInput[8] == 's';
+    const char * path = trimmedInput + 12;
+    if ( * path && * path != ' ') {
+      shell_print(output, lineCount, "Usage: session <save|load> [file]");
+      return;
     }
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "  exit/quit - Close the application");
-      ( * lineCount) ++;
+    while ( * path == ' ') path++;
+    if (! * path) path = SESSION_FILE_PATH;
+
+    ShellTask * task = shell_current_task();
+    if (task) {
+      shell_post(task, save ? MSG_SESSION_SAVE : MSG_SESSION_LOAD, path, strlen(path), NULL);
+    } else {
+      shell_session(save, path, output, lineCount);
     }
+  } else if (strcmp(trimmedInput, "session") == 0) {
+    shell_print(output, lineCount, "Session commands:");
+    shell_print(output, lineCount, "  session save [file] - Save output, scrollback and settings (default %s)", SESSION_FILE_PATH);
+    shell_print(output, lineCount, "  session load [file] - Restore a saved session");
+  } else if (strncmp(trimmedInput, "watch ", 6) == 0) {
+    watch_run(trimmedInput + 6, output, lineCount);
+  } else if (strncmp(trimmedInput, "grep ", 5) == 0) {
+    grep_run(trimmedInput + 5, output, lineCount);
+  } else if (strcmp(trimmedInput, "version") == 0) {
+    shell_print(output, lineCount, "OCTO-SHELL Emulator v2.1");
+    shell_print(output, lineCount, "Built by Daksh Verma with SDL2");
+  } else if (strcmp(trimmedInput, "help") == 0) {
+    shell_print(output, lineCount, "Available commands:");
+    shell_print(output, lineCount, "  clear - Clear the screen");
+    shell_print(output, lineCount, "  echo <text> - Display text");
+    shell_print(output, lineCount, "  wordwrap <true/false> - Toggle word wrapping");
+    shell_print(output, lineCount, "  bg - Background image commands");
+    shell_print(output, lineCount, "  cat <file> - Show the end of a file");
+    shell_print(output, lineCount, "  view <file> [line] - Page through a file (bare 'view' shows the next page)");
+    shell_print(output, lineCount, "  less <file> - Scroll and search a file (also <command> | less)");
+    shell_print(output, lineCount, "  scrollback [stats|save <file>] - Page through all earlier output, show its size, or save it");
+    shell_print(output, lineCount, "  session <save|load> [file] - Save or restore output, scrollback and settings");
+    shell_print(output, lineCount, "  watch <seconds> <command> - Re-run a command in a panel above the output");
+    shell_print(output, lineCount, "  follow <file> - Show lines as they are appended (also tail -f)");
+    shell_print(output, lineCount, "  grep [-i] <text> [file...] - Search files, or the output when no file is given");
+    shell_print(output, lineCount, "  version - Show version information");
+    shell_print(output, lineCount, "  help - Show this help");
+    shell_print(output, lineCount, "  shortcuts - Show keyboard shortcuts");
+    shell_print(output, lineCount, "  exit/quit - Close the application");
   } else if (strcmp(trimmedInput, "shortcuts") == 0) {
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "Keyboard shortcuts:");
-      ( * lineCount) ++;
-    }
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "  Ctrl+C - Copy selected text");
-      ( * lineCount) ++;
-    }
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "  Ctrl+V - Paste text");
-      ( * lineCount) ++;
-    }
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "  Ctrl+A - Select all text");
-      ( * lineCount) ++;
-    }
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "  Ctrl+Z - Undo last action");
-      ( * lineCount) ++;
-    }
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "  Ctrl+Y - Redo last undone action");
-      ( * lineCount) ++;
-    }
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "  Arrow keys - Move cursor");
-      ( * lineCount) ++;
-    }
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "  Home/End Keys - Jump to start/end of line");
-      ( * lineCount) ++;
-    }
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "  Escape Key - Close application");
-      ( * lineCount) ++;
-    }
+    shell_print(output, lineCount, "Keyboard shortcuts:");
+    shell_print(output, lineCount, "  Ctrl+C - Copy selected text / cancel running command");
+    shell_print(output, lineCount, "  Ctrl+V - Paste text");
+    shell_print(output, lineCount, "  Ctrl+A - Select all text");
+    shell_print(output, lineCount, "  Ctrl+Z - Undo last action");
+    shell_print(output, lineCount, "  Ctrl+Y - Redo last undone action");
+    shell_print(output, lineCount, "  Arrow keys - Move cursor");
+    shell_print(output, lineCount, "  Up/Down - Recall command history");
+    shell_print(output, lineCount, "  Ctrl+R - Fuzzy search the command history");
+    shell_print(output, lineCount, "  Tab - Complete commands, arguments and file names");
+    shell_print(output, lineCount, "  Ctrl+T / Ctrl+W - Open / close a tab");
+    shell_print(output, lineCount, "  Ctrl+Tab, Ctrl+1..9 - Switch tabs");
+    shell_print(output, lineCount, "  Ctrl+Shift+E / Ctrl+Shift+O - Split the pane right / down");
+    shell_print(output, lineCount, "  Alt+Arrow keys - Focus the neighbouring pane");
+    shell_print(output, lineCount, "  Ctrl+Plus / Ctrl+Minus / Ctrl+Wheel - Zoom the font");
+    shell_print(output, lineCount, "  Ctrl+0 - Reset the font size");
+    shell_print(output, lineCount, "  Home/End Keys - Jump to start/end of line");
+    shell_print(output, lineCount, "  Escape Key - Close application");
   } else if (strcmp(trimmedInput, "exit") == 0 || strcmp(trimmedInput, "quit") == 0) {
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "Goodbye! Closing OCTO-Shell...");
-      ( * lineCount) ++;
-    }
-    exitRequested = true;
-    exitRequestTime = SDL_GetTicks();
+    shell_print(output, lineCount, "Goodbye! Closing OCTO-Shell...");
+    shell_request_exit();
   } else if (strlen(trimmedInput) == 0) {
     // Empty command - do nothing
     return;
   } else {
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "Unknown command: %s", trimmedInput);
-      ( * lineCount) ++;
-    }
-    if ( * lineCount < MAX_LINES) {
-      snprintf(output[ * lineCount], INPUT_BUFFER_SIZE, "Type 'help' for available commands.");
-      ( * lineCount) ++;
-    }
+    shell_print(output, lineCount, "Unknown command: %s", trimmedInput);
+    shell_print(output, lineCount, "Type 'help' for available commands.");
   }
 }
 
@@ -259,6 +1162,11 @@ bool shell_should_exit() {
   return shouldExit;
 }
 
+// True as soon as exit/quit ran, without the GUI's one second grace period
+bool shell_exit_requested(void) {
+  return exitRequested;
+}
+
 void shell_reset_exit_flag() {
   shouldExit = false;
   exitRequested = false;
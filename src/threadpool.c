@@ -0,0 +1,145 @@
+#include <stdlib.h>
+
+#include <stdio.h>
+
+#include <stdbool.h>
+
+#include <SDL.h>
+
+#include "config.h"
+
+#include "threadpool.h"
+
+typedef struct PoolTask {
+  ThreadPoolTask run;
+  void * arg;
+  struct PoolTask * next;
+}
+PoolTask;
+
+static SDL_Thread * workers[MAX_WORKER_THREADS];
+static int workerCount = 0;
+
+static SDL_mutex * queueLock = NULL;
+static SDL_cond * queueCond = NULL;
+static PoolTask * queueHead = NULL;
+static PoolTask * queueTail = NULL;
+static bool stopping = false;
+
+static int threadpool_worker(void * data) {
+  (void) data;
+
+  for (;;) {
+    SDL_LockMutex(queueLock);
+    while (!queueHead && !stopping) {
+      SDL_CondWait(queueCond, queueLock);
+    }
+
+    // Drain the queue before honouring a shutdown request
+    PoolTask * task = queueHead;
+    if (!task) {
+      SDL_UnlockMutex(queueLock);
+      break;
+    }
+    queueHead = task -> next;
+    if (!queueHead) queueTail = NULL;
+    SDL_UnlockMutex(queueLock);
+
+    task -> run(task -> arg);
+    free(task);
+  }
+
+  return 0;
+}
+
+bool threadpool_init(int count) {
+  if (workerCount > 0) return true;
+
+  // Default to one worker per core, leaving a core for the UI thread
+  if (count <= 0) count = SDL_GetCPUCount() - 1;
+  if (count < 1) count = 1;
+  if (count > MAX_WORKER_THREADS) count = MAX_WORKER_THREADS;
+
+  queueLock = SDL_CreateMutex();
+  queueCond = SDL_CreateCond();
+  if (!queueLock || !queueCond) {
+    fprintf(stderr, "Thread pool initialization failed: %s\n", SDL_GetError());
+    threadpool_shutdown();
+    return false;
+  }
+
+  stopping = false;
+  for (int i = 0; i < count; i++) {
+    workers[workerCount] = SDL_CreateThread(threadpool_worker, "octo-worker", NULL);
+    if (!workers[workerCount]) {
+      fprintf(stderr, "Failed to create worker thread: %s\n", SDL_GetError());
+      break;
+    }
+    workerCount++;
+  }
+
+  if (workerCount == 0) {
+    threadpool_shutdown();
+    return false;
+  }
+
+  fprintf(stderr, "Thread pool started with %d worker(s).\n", workerCount);
+  return true;
+}
+
+bool threadpool_submit(ThreadPoolTask run, void * arg) {
+  if (!run) return false;
+
+  // Without workers (e.g. pool never started) the task runs on the caller
+  if (workerCount == 0) {
+    run(arg);
+    return true;
+  }
+
+  PoolTask * task = (PoolTask * ) malloc(sizeof(PoolTask));
+  if (!task) return false;
+  task -> run = run;
+  task -> arg = arg;
+  task -> next = NULL;
+
+  SDL_LockMutex(queueLock);
+  if (queueTail) {
+    queueTail -> next = task;
+  } else {
+    queueHead = task;
+  }
+  queueTail = task;
+  SDL_CondSignal(queueCond);
+  SDL_UnlockMutex(queueLock);
+
+  return true;
+}
+
+int threadpool_worker_count(void) {
+  return workerCount;
+}
+
+void threadpool_shutdown(void) {
+  if (queueLock) {
+    SDL_LockMutex(queueLock);
+    stopping = true;
+    SDL_CondBroadcast(queueCond);
+    SDL_UnlockMutex(queueLock);
+  }
+
+  for (int i = 0; i < workerCount; i++) {
+    SDL_WaitThread(workers[i], NULL);
+    workers[i] = NULL;
+  }
+  workerCount = 0;
+
+  if (queueCond) {
+    SDL_DestroyCond(queueCond);
+    queueCond = NULL;
+  }
+  if (queueLock) {
+    SDL_DestroyMutex(queueLock);
+    queueLock = NULL;
+  }
+  stopping = false;
+}
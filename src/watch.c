@@ -0,0 +1,185 @@
+#include <string.h>
+
+#include <stdlib.h>
+
+#include <stdio.h>
+
+#include <stdbool.h>
+
+#include <SDL.h>
+
+#include "config.h"
+
+#include "watch.h"
+
+#include "shell.h"
+
+// Panel shown above the output of its session while a watch runs there (UI thread only)
+struct WatchPanel {
+  bool open;
+  int task;
+  int lineCount;
+  char title[INPUT_BUFFER_SIZE];
+  char lines[WATCH_MAX_LINES][INPUT_BUFFER_SIZE];
+  Uint32 versions[WATCH_MAX_LINES + 1]; // Bumped whenever a row changes; last slot is the title
+};
+
+// Shared by all panels so a row never keeps its version when another session's panel is shown
+static Uint32 gNextVersion = 1;
+
+WatchPanel * watch_panel_create(void) {
+  return (WatchPanel * ) calloc(1, sizeof(WatchPanel));
+}
+
+void watch_panel_destroy(WatchPanel * panel) {
+  free(panel);
+}
+
+void watch_panel_open(WatchPanel * panel, int taskId, const char * title) {
+  if (!panel) return;
+  panel -> open = true;
+  panel -> task = taskId;
+  panel -> lineCount = 0;
+  strncpy(panel -> title, title, sizeof(panel -> title) - 1);
+  panel -> title[sizeof(panel -> title) - 1] = '\0';
+  for (int i = 0; i <= WATCH_MAX_LINES; i++) panel -> versions[i] = gNextVersion++;
+}
+
+void watch_panel_resize(WatchPanel * panel, int lineCount) {
+  if (!panel) return;
+  if (lineCount < 0) lineCount = 0;
+  if (lineCount > WATCH_MAX_LINES) lineCount = WATCH_MAX_LINES;
+
+  // Rows that come back into view start empty until the next update fills them
+  for (int i = panel -> lineCount; i < lineCount; i++) {
+    panel -> lines[i][0] = '\0';
+    panel -> versions[i] = gNextVersion++;
+  }
+  panel -> lineCount = lineCount;
+}
+
+void watch_panel_set_line(WatchPanel * panel, int index, const char * text) {
+  if (!panel || index < 0 || index >= panel -> lineCount) return;
+
+  strncpy(panel -> lines[index], text, INPUT_BUFFER_SIZE - 1);
+  panel -> lines[index][INPUT_BUFFER_SIZE - 1] = '\0';
+  panel -> versions[index] = gNextVersion++;
+}
+
+// The panel disappears when the command that owns it finishes or is cancelled
+void watch_panel_task_done(WatchPanel * panel, int taskId) {
+  if (panel && panel -> open && taskId == panel -> task) watch_panel_close(panel);
+}
+
+void watch_panel_close(WatchPanel * panel) {
+  if (!panel) return;
+  panel -> open = false;
+  panel -> lineCount = 0;
+}
+
+bool watch_panel_active(const WatchPanel * panel) {
+  return panel && panel -> open;
+}
+
+int watch_panel_line_count(const WatchPanel * panel) {
+  return watch_panel_active(panel) ? panel -> lineCount : 0;
+}
+
+// Row text and its version; index -1 is the title row
+const char * watch_panel_line(const WatchPanel * panel, int index, Uint32 * version) {
+  if (!panel) return "";
+  if (index < 0) {
+    if (version) * version = panel -> versions[WATCH_MAX_LINES];
+    return panel -> title;
+  }
+  if (index >= panel -> lineCount) return "";
+  if (version) * version = panel -> versions[index];
+  return panel -> lines[index];
+}
+
+// Sleeps until the deadline in short slices so Ctrl+C stays responsive
+static void watch_wait(Uint32 deadline) {
+  while (!shell_cancelled()) {
+    Uint32 now = SDL_GetTicks();
+    if ((Sint32)(deadline - now) <= 0) return;
+
+    Uint32 remaining = deadline - now;
+    SDL_Delay(remaining < 20 ? remaining : 20);
+  }
+}
+
+// watch <seconds> <command>: re-runs the command and sends only the rows that changed
+void watch_run(const char * args, char output[][INPUT_BUFFER_SIZE], int * lineCount) {
+  char * end;
+  double seconds = strtod(args, & end);
+  const char * command = end;
+  while ( * command == ' ') command++;
+
+  if (end == args || seconds <= 0.0 || * command == '\0') {
+    shell_print(output, lineCount, "Usage: watch <seconds> <command>");
+    return;
+  }
+
+  Uint32 interval = (Uint32)(seconds * 1000.0);
+  if (interval < WATCH_MIN_INTERVAL_MS) interval = WATCH_MIN_INTERVAL_MS;
+
+  // Previous run, kept on this side so unchanged rows are never sent
+  char( * previous)[INPUT_BUFFER_SIZE] = calloc(WATCH_MAX_LINES, INPUT_BUFFER_SIZE);
+  if (!previous) {
+    shell_print(output, lineCount, "\033[31mwatch: out of memory\033[0m");
+    return;
+  }
+  int previousCount = -1;
+
+  char title[INPUT_BUFFER_SIZE];
+  snprintf(title, sizeof(title), "Every %.2gs: %.*s  (Ctrl+C to stop)", interval / 1000.0,
+    INPUT_BUFFER_SIZE - 64, command);
+  if (!shell_watch_post(SHELL_WATCH_OPEN, 0, title, strlen(title))) {
+    shell_print(output, lineCount, "\033[31mwatch: only available in the window\033[0m");
+    free(previous);
+    return;
+  }
+
+  while (!shell_cancelled()) {
+    Uint32 started = SDL_GetTicks();
+
+    size_t length = 0;
+    char * text = shell_run_captured(command, output, lineCount, & length);
+    if (!text) break;
+
+    // Compare each row with the previous run; only differences are sent
+    int count = 0;
+    int changed[WATCH_MAX_LINES];
+    int changedCount = 0;
+    const char * p = text;
+    const char * limit = text + length;
+    while (p < limit && count < WATCH_MAX_LINES) {
+      const char * newline = (const char * ) memchr(p, '\n', (size_t)(limit - p));
+      const char * lineEnd = newline ? newline : limit;
+      size_t lineLength = (size_t)(lineEnd - p);
+      if (lineLength > INPUT_BUFFER_SIZE - 1) lineLength = INPUT_BUFFER_SIZE - 1;
+
+      bool same = count < previousCount && strlen(previous[count]) == lineLength &&
+        memcmp(previous[count], p, lineLength) == 0;
+      if (!same) {
+        memcpy(previous[count], p, lineLength);
+        previous[count][lineLength] = '\0';
+        changed[changedCount++] = count;
+      }
+
+      count++;
+      p = newline ? newline + 1 : limit;
+    }
+    free(text);
+
+    if (count != previousCount) shell_watch_post(SHELL_WATCH_SIZE, count, NULL, 0);
+    for (int i = 0; i < changedCount; i++) {
+      shell_watch_post(SHELL_WATCH_LINE, changed[i], previous[changed[i]], strlen(previous[changed[i]]));
+    }
+    previousCount = count;
+
+    watch_wait(started + interval);
+  }
+
+  free(previous);
+}